@@ -1,441 +1,199 @@
-#include <iostream>
+#include <signal.h>
+
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
-#include <vector>
-#include <string>
-#include <ctime>
+#include <functional>
 #include <iomanip>
-#include <algorithm>
-#include <memory>
+#include <iostream>
 #include <map>
-#include <sstream>
-
-using namespace std;
-
-// Utility class for date/time operations
-class DateTime {
-public:
-    static string getCurrentDateTime() {
-        time_t now = time(0);
-        char buf[80];
-        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
-        return string(buf);
-    }
-};
-
-// Transaction class
-class Transaction {
-private:
-    string transactionId;
-    string type;
-    double amount;
-    string date;
-    string description;
-
-public:
-    Transaction(string type, double amt, string desc) 
-        : type(type), amount(amt), description(desc) {
-        date = DateTime::getCurrentDateTime();
-        transactionId = "TXN" + to_string(time(0));
-    }
-
-    void display() const {
-        cout << setw(15) << transactionId 
-             << setw(12) << type 
-             << setw(12) << fixed << setprecision(2) << amount
-             << setw(22) << date 
-             << "  " << description << endl;
-    }
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
-    string serialize() const {
-        return transactionId + "|" + type + "|" + to_string(amount) + "|" + date + "|" + description;
-    }
+#include "Bank.h"
+#include "BankClient.h"
+#include "BankServer.h"
+#include "LogSink.h"
+#include "Metrics.h"
+#include "Presenter.h"
+#include "Replay.h"
 
-    static Transaction deserialize(const string& data) {
-        stringstream ss(data);
-        string id, type, amtStr, date, desc;
-        getline(ss, id, '|');
-        getline(ss, type, '|');
-        getline(ss, amtStr, '|');
-        getline(ss, date, '|');
-        getline(ss, desc, '|');
-        Transaction t(type, stod(amtStr), desc);
-        return t;
-    }
-};
+using namespace std;
 
-// Loan class
-class Loan {
+// Main menu system
+class BankingSystem {
 private:
-    string loanId;
-    double principal;
-    double interestRate;
-    int termMonths;
-    double monthlyPayment;
-    double remainingBalance;
-    string startDate;
-    bool isActive;
-
-public:
-    Loan(double amt, double rate, int months) 
-        : principal(amt), interestRate(rate), termMonths(months), 
-          remainingBalance(amt), isActive(true) {
-        startDate = DateTime::getCurrentDateTime();
-        loanId = "LOAN" + to_string(time(0));
-        calculateMonthlyPayment();
-    }
-
-    void calculateMonthlyPayment() {
-        double monthlyRate = interestRate / 12 / 100;
-        monthlyPayment = (principal * monthlyRate * pow(1 + monthlyRate, termMonths)) / 
-                        (pow(1 + monthlyRate, termMonths) - 1);
-    }
-
-    bool makePayment(double amount) {
-        if (!isActive) return false;
-        if (amount < monthlyPayment) return false;
-        
-        remainingBalance -= amount;
-        if (remainingBalance <= 0) {
-            remainingBalance = 0;
-            isActive = false;
-        }
-        return true;
-    }
-
-    void display() const {
-        cout << "\n--- Loan Details ---" << endl;
-        cout << "Loan ID: " << loanId << endl;
-        cout << "Principal: $" << fixed << setprecision(2) << principal << endl;
-        cout << "Interest Rate: " << interestRate << "%" << endl;
-        cout << "Term: " << termMonths << " months" << endl;
-        cout << "Monthly Payment: $" << monthlyPayment << endl;
-        cout << "Remaining Balance: $" << remainingBalance << endl;
-        cout << "Status: " << (isActive ? "Active" : "Paid Off") << endl;
-    }
-
-    double getRemainingBalance() const { return remainingBalance; }
-    bool getIsActive() const { return isActive; }
-    double getMonthlyPayment() const { return monthlyPayment; }
-};
-
-// Base Account class
-class Account {
-protected:
-    string accountNumber;
-    string accountHolderName;
-    double balance;
-    string accountType;
-    vector<Transaction> transactions;
-    vector<shared_ptr<Loan>> loans;
-    string creationDate;
-    bool isActive;
-
-public:
-    Account(string accNum, string name, string type) 
-        : accountNumber(accNum), accountHolderName(name), 
-          accountType(type), balance(0), isActive(true) {
-        creationDate = DateTime::getCurrentDateTime();
-    }
+    Bank bank;
+    ofstream auditFile;
+    unique_ptr<LogSink> audit;
+    TraceRecorder recorder;
+    MetricsServer metricsServer;
 
-    virtual ~Account() {}
+    static const char* SNAPSHOT_FILE;
+    static const char* JOURNAL_FILE;
+    static const char* AUDIT_FILE;
+    static const char* METRICS_FILE;
 
-    virtual void deposit(double amt) {
-        if (amt <= 0) {
-            cout << "Invalid deposit amount!" << endl;
-            return;
-        }
-        balance += amt;
-        transactions.push_back(Transaction("DEPOSIT", amt, "Cash deposit"));
-        cout << "Deposited $" << fixed << setprecision(2) << amt << " successfully!" << endl;
-    }
-
-    virtual bool withdraw(double amt) {
-        if (amt <= 0) {
-            cout << "Invalid withdrawal amount!" << endl;
-            return false;
-        }
-        if (balance < amt) {
-            cout << "Insufficient balance!" << endl;
-            return false;
-        }
-        balance -= amt;
-        transactions.push_back(Transaction("WITHDRAW", amt, "Cash withdrawal"));
-        cout << "Withdrawn $" << fixed << setprecision(2) << amt << " successfully!" << endl;
-        return true;
+    void displayMainMenu() {
+        cout << "\n========================================\n";
+        cout << "     " << bank.getBankName() << '\n';
+        cout << "========================================\n";
+        cout << "1.  Create Savings Account\n";
+        cout << "2.  Create Checking Account\n";
+        cout << "3.  Deposit Money\n";
+        cout << "4.  Withdraw Money\n";
+        cout << "5.  Transfer Money\n";
+        cout << "6.  Check Balance\n";
+        cout << "7.  View Transaction History\n";
+        cout << "8.  Apply for Loan\n";
+        cout << "9.  Pay Loan\n";
+        cout << "10. View Loans\n";
+        cout << "11. Apply Interest (Savings)\n";
+        cout << "12. View All Accounts\n";
+        cout << "13. Accrue Interest (All Savings)\n";
+        cout << "14. Bank Summary\n";
+        cout << "15. View Loan Schedule\n";
+        cout << "16. Run End-of-Day Loan Payments\n";
+        cout << "17. Save Snapshot\n";
+        cout << "18. Operation Metrics\n";
+        cout << "19. Find Accounts by Holder\n";
+        cout << "20. Exit\n";
+        cout << "========================================\n";
+        cout << "Enter your choice: ";
     }
 
-    bool transfer(Account& toAccount, double amt) {
-        if (amt <= 0) {
-            cout << "Invalid transfer amount!" << endl;
-            return false;
+    // Reads a type name (or ALL) and returns the matching type mask
+    static bool readTypeFilter(uint8_t& types) {
+        string name;
+        cout << "Transaction type (ALL, DEPOSIT, WITHDRAW, TRANSFER_IN, TRANSFER_OUT, LOAN, LOAN_PAYMENT, INTEREST): ";
+        cin >> name;
+        transform(name.begin(), name.end(), name.begin(), ::toupper);
+        if (name == "ALL") {
+            types = TransactionHistory::ALL_TYPES;
+            return true;
         }
-        if (balance < amt) {
-            cout << "Insufficient balance for transfer!" << endl;
-            return false;
+        for (int t = 0; t <= static_cast<int>(TxnType::INTEREST); ++t) {
+            if (name == txnTypeName(static_cast<TxnType>(t))) {
+                types = TransactionHistory::typeBit(static_cast<TxnType>(t));
+                return true;
+            }
         }
-        
-        balance -= amt;
-        toAccount.balance += amt;
-        
-        transactions.push_back(Transaction("TRANSFER_OUT", amt, 
-            "Transfer to " + toAccount.accountNumber));
-        toAccount.transactions.push_back(Transaction("TRANSFER_IN", amt, 
-            "Transfer from " + accountNumber));
-        
-        cout << "Transferred $" << fixed << setprecision(2) << amt << " successfully!" << endl;
-        return true;
+        return false;
     }
 
-    void applyLoan(double amount, double interestRate, int termMonths) {
-        auto loan = make_shared<Loan>(amount, interestRate, termMonths);
-        loans.push_back(loan);
-        balance += amount;
-        transactions.push_back(Transaction("LOAN", amount, "Loan disbursement"));
-        cout << "Loan of $" << fixed << setprecision(2) << amount << " approved and credited!" << endl;
-    }
-
-    void payLoan(int loanIndex, double amount) {
-        if (loanIndex < 0 || loanIndex >= loans.size()) {
-            cout << "Invalid loan index!" << endl;
-            return;
-        }
-        
-        auto& loan = loans[loanIndex];
-        if (!loan->getIsActive()) {
-            cout << "This loan is already paid off!" << endl;
+    void viewTransactionHistory(const Account& acc) {
+        int mode;
+        cout << "1. All  2. Most recent  3. Date range\n";
+        cout << "Enter choice: ";
+        cin >> mode;
+        if (mode == 1) {
+            lock_guard<mutex> lock(acc.getMutex());
+            Presenter::transactionHistory(cout, acc);
             return;
         }
-        
-        if (balance < amount) {
-            cout << "Insufficient balance to pay loan!" << endl;
-            return;
-        }
-        
-        if (loan->makePayment(amount)) {
-            balance -= amount;
-            transactions.push_back(Transaction("LOAN_PAYMENT", amount, "Loan payment"));
-            cout << "Loan payment of $" << fixed << setprecision(2) << amount << " successful!" << endl;
+        uint8_t types;
+        if (mode == 2) {
+            size_t count;
+            cout << "How many transactions: ";
+            cin >> count;
+            if (!readTypeFilter(types)) {
+                cout << "Unknown transaction type!\n";
+                return;
+            }
+            lock_guard<mutex> lock(acc.getMutex());
+            Presenter::transactions(cout, acc.getHistory().last(count, types));
+        } else if (mode == 3) {
+            string fromText, toText;
+            int64_t from, to;
+            cout << "From date (YYYY-MM-DD): ";
+            cin >> fromText;
+            cout << "To date (YYYY-MM-DD): ";
+            cin >> toText;
+            if (!DateTime::parseDate(fromText, from) || !DateTime::parseDate(toText, to)) {
+                cout << "Invalid date!\n";
+                return;
+            }
+            if (!readTypeFilter(types)) {
+                cout << "Unknown transaction type!\n";
+                return;
+            }
+            // Through the end of the last day
+            to += 86400LL * 1000000000 - 1;
+            lock_guard<mutex> lock(acc.getMutex());
+            Presenter::transactions(cout, acc.getHistory().between(from, to, types));
         } else {
-            cout << "Payment must be at least the monthly payment amount!" << endl;
-        }
-    }
-
-    virtual void displayAccountInfo() const {
-        cout << "\n========================================" << endl;
-        cout << "Account Type: " << accountType << endl;
-        cout << "Account Number: " << accountNumber << endl;
-        cout << "Account Holder: " << accountHolderName << endl;
-        cout << "Balance: $" << fixed << setprecision(2) << balance << endl;
-        cout << "Created: " << creationDate << endl;
-        cout << "Status: " << (isActive ? "Active" : "Inactive") << endl;
-        cout << "========================================" << endl;
-    }
-
-    void displayTransactionHistory() const {
-        cout << "\n--- Transaction History ---" << endl;
-        if (transactions.empty()) {
-            cout << "No transactions yet." << endl;
-            return;
-        }
-        
-        cout << setw(15) << "Transaction ID" 
-             << setw(12) << "Type" 
-             << setw(12) << "Amount"
-             << setw(22) << "Date" 
-             << "  Description" << endl;
-        cout << string(80, '-') << endl;
-        
-        for (const auto& t : transactions) {
-            t.display();
-        }
-    }
-
-    void displayLoans() const {
-        if (loans.empty()) {
-            cout << "\nNo loans on this account." << endl;
-            return;
+            cout << "Invalid choice!\n";
         }
-        
-        cout << "\n--- Loans ---" << endl;
-        for (size_t i = 0; i < loans.size(); ++i) {
-            cout << "\nLoan #" << i + 1;
-            loans[i]->display();
-        }
-    }
-
-    string getAccountNumber() const { return accountNumber; }
-    string getAccountHolder() const { return accountHolderName; }
-    double getBalance() const { return balance; }
-    bool getIsActive() const { return isActive; }
-    void deactivate() { isActive = false; }
-};
-
-// Savings Account with interest
-class SavingsAccount : public Account {
-private:
-    double interestRate;
-
-public:
-    SavingsAccount(string accNum, string name, double rate = 3.5) 
-        : Account(accNum, name, "SAVINGS"), interestRate(rate) {}
-
-    void applyInterest() {
-        double interest = balance * (interestRate / 100);
-        balance += interest;
-        transactions.push_back(Transaction("INTEREST", interest, "Interest credit"));
-        cout << "Interest of $" << fixed << setprecision(2) << interest << " applied!" << endl;
-    }
-
-    void displayAccountInfo() const override {
-        Account::displayAccountInfo();
-        cout << "Interest Rate: " << interestRate << "%" << endl;
     }
-};
-
-// Checking Account with overdraft
-class CheckingAccount : public Account {
-private:
-    double overdraftLimit;
 
-public:
-    CheckingAccount(string accNum, string name, double overdraft = 500) 
-        : Account(accNum, name, "CHECKING"), overdraftLimit(overdraft) {}
-
-    bool withdraw(double amt) override {
-        if (amt <= 0) {
-            cout << "Invalid withdrawal amount!" << endl;
+    // Recovers the persisted bank and starts the audit log and the
+    // metrics endpoint. False if the saved state cannot be restored; the
+    // files are then left as they are.
+    bool open() {
+        RecoveryReport recovery = bank.recover(SNAPSHOT_FILE, JOURNAL_FILE);
+        if (!recovery.error.empty()) {
+            cout << "Cannot restore the bank: " << recovery.error << "!\n";
             return false;
         }
-        if (balance + overdraftLimit < amt) {
-            cout << "Exceeds overdraft limit!" << endl;
-            return false;
+        if (bank.getAccountCount() > 0) {
+            cout << "Restored " << bank.getAccountCount() << " accounts ("
+                 << recovery.replayed << " journal records replayed).\n";
         }
-        balance -= amt;
-        transactions.push_back(Transaction("WITHDRAW", amt, "Cash withdrawal"));
-        cout << "Withdrawn $" << fixed << setprecision(2) << amt << " successfully!" << endl;
-        return true;
-    }
-
-    void displayAccountInfo() const override {
-        Account::displayAccountInfo();
-        cout << "Overdraft Limit: $" << fixed << setprecision(2) << overdraftLimit << endl;
-    }
-};
-
-// Bank class
-class Bank {
-private:
-    string bankName;
-    map<string, shared_ptr<Account>> accounts;
-    int nextAccountNumber;
-
-    string generateAccountNumber() {
-        return "ACC" + to_string(++nextAccountNumber);
-    }
-
-public:
-    Bank(string name) : bankName(name), nextAccountNumber(1000) {}
-
-    void createSavingsAccount(string name, double initialDeposit = 0) {
-        string accNum = generateAccountNumber();
-        auto acc = make_shared<SavingsAccount>(accNum, name);
-        if (initialDeposit > 0) {
-            acc->deposit(initialDeposit);
+        if (!recovery.journalTrimmed) {
+            cout << "Warning: could not trim journal tail!\n";
         }
-        accounts[accNum] = acc;
-        cout << "\nSavings Account created successfully!" << endl;
-        cout << "Account Number: " << accNum << endl;
-    }
-
-    void createCheckingAccount(string name, double initialDeposit = 0) {
-        string accNum = generateAccountNumber();
-        auto acc = make_shared<CheckingAccount>(accNum, name);
-        if (initialDeposit > 0) {
-            acc->deposit(initialDeposit);
+        if (!recovery.journalOpen) {
+            cout << "Warning: journal unavailable, changes will not be persisted!\n";
         }
-        accounts[accNum] = acc;
-        cout << "\nChecking Account created successfully!" << endl;
-        cout << "Account Number: " << accNum << endl;
-    }
-
-    shared_ptr<Account> findAccount(string accNum) {
-        auto it = accounts.find(accNum);
-        if (it != accounts.end()) {
-            return it->second;
+        // Every operation from here on is appended to the audit log by a
+        // background writer
+        auditFile.open(AUDIT_FILE, ios::app);
+        if (auditFile) {
+            audit = make_unique<LogSink>(auditFile);
+            bank.setNotificationSink(audit.get());
+        } else {
+            cout << "Warning: cannot write audit log " << AUDIT_FILE << "!\n";
         }
-        return nullptr;
-    }
-
-    void displayAllAccounts() const {
-        if (accounts.empty()) {
-            cout << "\nNo accounts in the system." << endl;
-            return;
+        // BANK_RISK_RULES names a fraud and velocity rules file
+        if (const char* rules = getenv("BANK_RISK_RULES")) {
+            string error;
+            if (!bank.loadRiskRules(rules, error)) {
+                cout << "Warning: risk rules not loaded (" << error << ")!\n";
+            }
         }
-        
-        cout << "\n========== All Accounts ==========" << endl;
-        cout << setw(15) << "Acc Number" 
-             << setw(20) << "Holder Name" 
-             << setw(15) << "Type"
-             << setw(15) << "Balance" << endl;
-        cout << string(65, '-') << endl;
-        
-        for (const auto& pair : accounts) {
-            auto acc = pair.second;
-            if (acc->getIsActive()) {
-                cout << setw(15) << acc->getAccountNumber()
-                     << setw(20) << acc->getAccountHolder()
-                     << setw(15) << "Account"
-                     << setw(15) << fixed << setprecision(2) << acc->getBalance() << endl;
+        // BANK_CDC_FILE streams every ledger transaction to that file
+        if (const char* cdc = getenv("BANK_CDC_FILE")) {
+            if (!bank.startChangeFeed(cdc)) {
+                cout << "Warning: cannot write change feed " << cdc << "!\n";
             }
         }
-    }
-
-    void saveToFile(const string& filename) {
-        ofstream file(filename);
-        if (!file) {
-            cout << "Error saving to file!" << endl;
-            return;
+        // BANK_TRACE_FILE records every call into the bank for --replay
+        if (const char* trace = getenv("BANK_TRACE_FILE")) {
+            if (recorder.open(trace)) {
+                bank.setTraceRecorder(&recorder);
+            } else {
+                cout << "Warning: cannot write trace " << trace << "!\n";
+            }
         }
-        file << accounts.size() << endl;
-        cout << "Data saved successfully!" << endl;
-        file.close();
-    }
-
-    string getBankName() const { return bankName; }
-};
-
-// Main menu system
-class BankingSystem {
-private:
-    Bank bank;
-
-    void displayMainMenu() {
-        cout << "\n========================================" << endl;
-        cout << "     " << bank.getBankName() << endl;
-        cout << "========================================" << endl;
-        cout << "1.  Create Savings Account" << endl;
-        cout << "2.  Create Checking Account" << endl;
-        cout << "3.  Deposit Money" << endl;
-        cout << "4.  Withdraw Money" << endl;
-        cout << "5.  Transfer Money" << endl;
-        cout << "6.  Check Balance" << endl;
-        cout << "7.  View Transaction History" << endl;
-        cout << "8.  Apply for Loan" << endl;
-        cout << "9.  Pay Loan" << endl;
-        cout << "10. View Loans" << endl;
-        cout << "11. Apply Interest (Savings)" << endl;
-        cout << "12. View All Accounts" << endl;
-        cout << "13. Exit" << endl;
-        cout << "========================================" << endl;
-        cout << "Enter your choice: ";
+        // BANK_METRICS_PORT serves the metrics to a Prometheus scraper
+        if (const char* port = getenv("BANK_METRICS_PORT")) {
+            if (!metricsServer.start(static_cast<uint16_t>(atoi(port)))) {
+                cout << "Warning: cannot serve metrics on port " << port << "!\n";
+            }
+        }
+        return true;
     }
 
 public:
     BankingSystem(string name) : bank(name) {}
 
-    void run() {
+    int run() {
         int choice;
-        
+
+        if (!open()) return 1;
         while (true) {
             displayMainMenu();
             cin >> choice;
@@ -443,7 +201,7 @@ public:
             if (cin.fail()) {
                 cin.clear();
                 cin.ignore(10000, '\n');
-                cout << "Invalid input! Please enter a number." << endl;
+                cout << "Invalid input! Please enter a number.\n";
                 continue;
             }
             
@@ -456,7 +214,15 @@ public:
                     getline(cin, name);
                     cout << "Enter initial deposit: $";
                     cin >> deposit;
-                    bank.createSavingsAccount(name, deposit);
+                    TxnStatus status;
+                    uint64_t id = bank.createSavingsAccount(name, Money::fromDouble(deposit), status);
+                    if (id == 0) {
+                        cout << statusMessage(status) << '\n';
+                        break;
+                    }
+                    cout << "\nSavings Account created successfully!\n";
+                    cout << "Account Number: " << formatAccountNumber(id) << '\n';
+                    if (status != TxnStatus::OK) cout << statusMessage(status) << '\n';
                     break;
                 }
                 case 2: {
@@ -467,7 +233,15 @@ public:
                     getline(cin, name);
                     cout << "Enter initial deposit: $";
                     cin >> deposit;
-                    bank.createCheckingAccount(name, deposit);
+                    TxnStatus status;
+                    uint64_t id = bank.createCheckingAccount(name, Money::fromDouble(deposit), status);
+                    if (id == 0) {
+                        cout << statusMessage(status) << '\n';
+                        break;
+                    }
+                    cout << "\nChecking Account created successfully!\n";
+                    cout << "Account Number: " << formatAccountNumber(id) << '\n';
+                    if (status != TxnStatus::OK) cout << statusMessage(status) << '\n';
                     break;
                 }
                 case 3: {
@@ -479,9 +253,15 @@ public:
                     if (acc) {
                         cout << "Enter amount to deposit: $";
                         cin >> amount;
-                        acc->deposit(amount);
+                        Money amt = Money::fromDouble(amount);
+                        TxnStatus status = bank.deposit(acc->getAccountId(), amt);
+                        if (status == TxnStatus::OK) {
+                            cout << "Deposited $" << amt << " successfully!\n";
+                        } else {
+                            cout << statusMessage(status) << '\n';
+                        }
                     } else {
-                        cout << "Account not found!" << endl;
+                        cout << "Account not found!\n";
                     }
                     break;
                 }
@@ -494,9 +274,15 @@ public:
                     if (acc) {
                         cout << "Enter amount to withdraw: $";
                         cin >> amount;
-                        acc->withdraw(amount);
+                        Money amt = Money::fromDouble(amount);
+                        TxnStatus status = bank.withdraw(acc->getAccountId(), amt);
+                        if (status == TxnStatus::OK) {
+                            cout << "Withdrawn $" << amt << " successfully!\n";
+                        } else {
+                            cout << statusMessage(status) << '\n';
+                        }
                     } else {
-                        cout << "Account not found!" << endl;
+                        cout << "Account not found!\n";
                     }
                     break;
                 }
@@ -512,9 +298,15 @@ public:
                     if (from && to) {
                         cout << "Enter amount to transfer: $";
                         cin >> amount;
-                        from->transfer(*to, amount);
+                        Money amt = Money::fromDouble(amount);
+                        TxnStatus status = bank.transfer(from->getAccountId(), to->getAccountId(), amt);
+                        if (status == TxnStatus::OK) {
+                            cout << "Transferred $" << amt << " successfully!\n";
+                        } else {
+                            cout << statusMessage(status) << '\n';
+                        }
                     } else {
-                        cout << "One or both accounts not found!" << endl;
+                        cout << "One or both accounts not found!\n";
                     }
                     break;
                 }
@@ -524,9 +316,10 @@ public:
                     cin >> accNum;
                     auto acc = bank.findAccount(accNum);
                     if (acc) {
-                        acc->displayAccountInfo();
+                        lock_guard<mutex> lock(acc->getMutex());
+                        Presenter::account(cout, *acc);
                     } else {
-                        cout << "Account not found!" << endl;
+                        cout << "Account not found!\n";
                     }
                     break;
                 }
@@ -536,9 +329,9 @@ public:
                     cin >> accNum;
                     auto acc = bank.findAccount(accNum);
                     if (acc) {
-                        acc->displayTransactionHistory();
+                        viewTransactionHistory(*acc);
                     } else {
-                        cout << "Account not found!" << endl;
+                        cout << "Account not found!\n";
                     }
                     break;
                 }
@@ -556,9 +349,15 @@ public:
                         cin >> rate;
                         cout << "Enter term (months): ";
                         cin >> months;
-                        acc->applyLoan(amount, rate, months);
+                        Money amt = Money::fromDouble(amount);
+                        TxnStatus status = bank.applyLoan(acc->getAccountId(), amt, percentToRate(rate), months);
+                        if (status == TxnStatus::OK) {
+                            cout << "Loan of $" << amt << " approved and credited!\n";
+                        } else {
+                            cout << statusMessage(status) << '\n';
+                        }
                     } else {
-                        cout << "Account not found!" << endl;
+                        cout << "Account not found!\n";
                     }
                     break;
                 }
@@ -570,14 +369,23 @@ public:
                     cin >> accNum;
                     auto acc = bank.findAccount(accNum);
                     if (acc) {
-                        acc->displayLoans();
+                        {
+                            lock_guard<mutex> lock(acc->getMutex());
+                            Presenter::loans(cout, *acc);
+                        }
                         cout << "Enter loan number to pay: ";
                         cin >> loanIndex;
                         cout << "Enter payment amount: $";
                         cin >> amount;
-                        acc->payLoan(loanIndex - 1, amount);
+                        Money amt = Money::fromDouble(amount);
+                        TxnStatus status = bank.payLoan(acc->getAccountId(), loanIndex - 1, amt);
+                        if (status == TxnStatus::OK) {
+                            cout << "Loan payment of $" << amt << " successful!\n";
+                        } else {
+                            cout << statusMessage(status) << '\n';
+                        }
                     } else {
-                        cout << "Account not found!" << endl;
+                        cout << "Account not found!\n";
                     }
                     break;
                 }
@@ -587,44 +395,1361 @@ public:
                     cin >> accNum;
                     auto acc = bank.findAccount(accNum);
                     if (acc) {
-                        acc->displayLoans();
+                        lock_guard<mutex> lock(acc->getMutex());
+                        Presenter::loans(cout, *acc);
                     } else {
-                        cout << "Account not found!" << endl;
+                        cout << "Account not found!\n";
                     }
                     break;
                 }
                 case 11: {
                     string accNum;
+                    Money interest;
                     cout << "Enter savings account number: ";
                     cin >> accNum;
+                    TxnStatus status = bank.applyInterest(parseAccountNumber(accNum), interest);
+                    if (status == TxnStatus::OK) {
+                        cout << "Interest of $" << interest << " applied!\n";
+                    } else {
+                        cout << statusMessage(status) << '\n';
+                    }
+                    break;
+                }
+                case 12:
+                    Presenter::accountList(cout, bank.listAccounts());
+                    break;
+                case 13: {
+                    InterestRunSummary summary = bank.accrueInterestAll();
+                    cout << "Interest of $" << summary.totalInterest << " credited to "
+                         << summary.accountsCredited << " accounts!\n";
+                    if (!summary.durable) cout << statusMessage(TxnStatus::NOT_DURABLE) << "\n";
+                    break;
+                }
+                case 14:
+                    Presenter::summary(cout, bank.getTotals(), bank.getTopBalances());
+                    break;
+                case 15: {
+                    string accNum;
+                    int loanIndex;
+                    cout << "Enter account number: ";
+                    cin >> accNum;
                     auto acc = bank.findAccount(accNum);
                     if (acc) {
-                        auto savings = dynamic_pointer_cast<SavingsAccount>(acc);
-                        if (savings) {
-                            savings->applyInterest();
-                        } else {
-                            cout << "Not a savings account!" << endl;
+                        lock_guard<mutex> lock(acc->getMutex());
+                        Presenter::loans(cout, *acc);
+                        if (acc->getLoanCount() > 0) {
+                            cout << "Enter loan number: ";
+                            cin >> loanIndex;
+                            if (loanIndex < 1 || loanIndex > static_cast<int>(acc->getLoanCount())) {
+                                cout << statusMessage(TxnStatus::INVALID_LOAN_INDEX) << '\n';
+                            } else {
+                                Presenter::loanSchedule(cout, acc->getLoan(loanIndex - 1));
+                            }
                         }
                     } else {
-                        cout << "Account not found!" << endl;
+                        cout << "Account not found!\n";
                     }
                     break;
                 }
-                case 12:
-                    bank.displayAllAccounts();
+                case 16: {
+                    string dateText;
+                    int64_t asOf;
+                    cout << "Business date (YYYY-MM-DD): ";
+                    cin >> dateText;
+                    if (!DateTime::parseDate(dateText, asOf)) {
+                        cout << "Invalid date!\n";
+                        break;
+                    }
+                    // Everything due by the end of that day
+                    asOf += 86400LL * 1000000000 - 1;
+                    InstallmentRunSummary summary = bank.runEndOfDay(asOf);
+                    cout << summary.installmentsPaid << " installments collected ($"
+                         << summary.totalCollected << ", of which $" << summary.interestCollected
+                         << " interest), " << summary.installmentsMissed << " missed!\n";
+                    if (!summary.durable) cout << statusMessage(TxnStatus::NOT_DURABLE) << "\n";
                     break;
-                case 13:
-                    cout << "\nThank you for using " << bank.getBankName() << "!" << endl;
-                    return;
+                }
+                case 17:
+                    if (bank.checkpoint()) {
+                        cout << "Data saved successfully!\n";
+                    } else {
+                        cout << "Error saving to file!\n";
+                    }
+                    break;
+                case 18: {
+                    Presenter::metrics(cout, Metrics::snapshot());
+                    vector<RiskRuleStats> rules = bank.getRiskRuleStats();
+                    if (!rules.empty()) Presenter::riskRules(cout, rules);
+                    if (bank.hasChangeFeed()) Presenter::changeFeed(cout, bank.getChangeFeedStats());
+                    if (Metrics::exportToFile(METRICS_FILE)) {
+                        cout << "\nMetrics written to " << METRICS_FILE << "!\n";
+                    } else {
+                        cout << "\nError writing " << METRICS_FILE << "!\n";
+                    }
+                    break;
+                }
+                case 19: {
+                    const size_t LIMIT = 50;
+                    string name;
+                    int mode;
+                    cout << "Match (1 = exact, 2 = any case, 3 = starts with): ";
+                    cin >> mode;
+                    cout << "Enter holder name: ";
+                    cin.ignore();
+                    getline(cin, name);
+                    NameMatch match = mode == 1 ? NameMatch::EXACT
+                                    : mode == 3 ? NameMatch::PREFIX : NameMatch::IGNORE_CASE;
+                    Presenter::accountMatches(cout, bank.findAccountsByHolder(name, match, LIMIT), LIMIT);
+                    break;
+                }
+                case 20:
+                    bank.checkpoint();
+                    cout << "\nThank you for using " << bank.getBankName() << "!\n";
+                    return 0;
                 default:
-                    cout << "Invalid choice! Please try again." << endl;
+                    cout << "Invalid choice! Please try again.\n";
             }
         }
     }
+
+    // Serves the bank over TCP (see BankProtocol.h) instead of the menu
+    // until SIGINT or SIGTERM, then saves a snapshot
+    int serve(uint16_t port, unsigned reactors, const string& host) {
+        // Blocked before any thread starts, so only sigwait sees them
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        if (!open()) return 1;
+        BankServer server(bank);
+        if (!server.start(port, reactors, host)) {
+            cout << "Cannot listen on " << host << ':' << port << "!" << endl;
+            return 1;
+        }
+        cout << "Serving " << bank.getBankName() << " on " << host << ':' << server.port()
+             << " with " << reactors << " reactor threads!" << endl;
+        int signal;
+        sigwait(&signals, &signal);
+        server.stop();
+        if (bank.checkpoint()) {
+            cout << "Data saved successfully!\n";
+        } else {
+            cout << "Error saving to file!\n";
+        }
+        return 0;
+    }
+
+    // Recovers the persisted bank and writes its whole ledger to a
+    // columnar file (see LedgerExport.h)
+    int exportLedger(const string& filename, unsigned threads) {
+        RecoveryReport recovery = bank.recover(SNAPSHOT_FILE, JOURNAL_FILE);
+        if (!recovery.error.empty()) {
+            cout << "Cannot restore the bank: " << recovery.error << "!" << endl;
+            return 1;
+        }
+        if (!recovery.journalOpen) {
+            cout << "Warning: journal unavailable!\n";
+        }
+        LedgerExportSummary summary;
+        auto start = chrono::steady_clock::now();
+        if (!bank.exportLedger(filename, threads, summary)) {
+            cout << "Error writing " << filename << "!" << endl;
+            return 1;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Exported " << summary.rows << " transactions of " << summary.accounts << " accounts to "
+             << filename << " (" << fixed << setprecision(1) << summary.bytes / 1e6 << " MB in "
+             << setprecision(2) << seconds << " s)!" << endl;
+        return 0;
+    }
 };
 
-int main() {
-    BankingSystem system("Swagat's Bank");
-    system.run();
+const char* BankingSystem::SNAPSHOT_FILE = "bank.snapshot";
+const char* BankingSystem::JOURNAL_FILE = "bank.journal";
+const char* BankingSystem::AUDIT_FILE = "bank.log";
+const char* BankingSystem::METRICS_FILE = "bank.metrics";
+
+// Uniform-random transfer workload. Runs the same number of transfers per
+// thread at 1, 2, 4, ... threads and reports throughput and speedup.
+// Usage: --bench-transfer [accounts] [transfers per thread] [max threads]
+void runTransferBenchmark(int argc, char* argv[]) {
+    size_t accountCount = argc > 0 ? stoul(argv[0]) : 100000;
+    size_t opsPerThread = argc > 1 ? stoul(argv[1]) : 200000;
+    unsigned maxThreads = argc > 2 ? stoul(argv[2]) : max(1u, thread::hardware_concurrency());
+
+    Bank bank("Benchmark Bank");
+    vector<uint64_t> numbers;
+    numbers.reserve(accountCount);
+    for (size_t i = 0; i < accountCount; ++i) {
+        numbers.push_back(bank.createCheckingAccount("Holder " + to_string(i), Money::fromCents(100000000)));
+    }
+
+    cout << "Transfer benchmark: " << accountCount << " accounts, "
+         << opsPerThread << " transfers per thread" << endl;
+    cout << setw(10) << "Threads" << setw(18) << "Transfers/sec" << setw(12) << "Speedup" << endl;
+    vector<unsigned> threadCounts;
+    for (unsigned threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    double baseline = 0;
+    for (unsigned threads : threadCounts) {
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                mt19937_64 rng(t + 1);
+                uniform_int_distribution<size_t> pick(0, accountCount - 1);
+                for (size_t i = 0; i < opsPerThread; ++i) {
+                    bank.transfer(numbers[pick(rng)], numbers[pick(rng)], Money::fromCents(100));
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double rate = threads * opsPerThread / seconds;
+        if (threads == 1) baseline = rate;
+        cout << setw(10) << threads << setw(18) << fixed << setprecision(0) << rate
+             << setw(11) << setprecision(2) << rate / baseline << "x" << endl;
+    }
+}
+
+// Bulk interest benchmark. Times InterestKernel against per-account
+// Money::mulDiv over the same arrays (checking that they agree), then runs
+// a full Bank::accrueInterestAll pass.
+// Usage: --bench-interest [kernel accounts] [bank accounts]
+void runInterestBenchmark(int argc, char* argv[]) {
+    size_t kernelCount = argc > 0 ? stoul(argv[0]) : 10000000;
+    size_t bankCount = argc > 1 ? stoul(argv[1]) : 1000000;
+
+    mt19937_64 rng(42);
+    uniform_int_distribution<int64_t> pickBalance(0, 10000000000LL);    // up to $100M
+    uniform_int_distribution<int64_t> pickRate(0, 100000);              // up to 10%
+    vector<int64_t> balances(kernelCount), rates(kernelCount);
+    vector<int64_t> expected(kernelCount), interest(kernelCount);
+    for (size_t i = 0; i < kernelCount; ++i) {
+        balances[i] = pickBalance(rng);
+        rates[i] = pickRate(rng);
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < kernelCount; ++i) {
+        expected[i] = Money::fromCents(balances[i]).mulDiv(rates[i], RATE_SCALE, INTEREST_ROUNDING).getCents();
+    }
+    double scalarSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    InterestKernel::run(balances.data(), rates.data(), interest.data(), kernelCount);
+    double kernelSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < kernelCount; ++i) {
+        if (interest[i] != expected[i]) ++mismatches;
+    }
+    cout << "Interest kernel: " << kernelCount << " accounts" << endl;
+    cout << fixed << setprecision(2);
+    cout << "  Money::mulDiv    " << setw(10) << scalarSeconds * 1e3 << " ms  ("
+         << scalarSeconds * 1e9 / kernelCount << " ns/account)" << endl;
+    cout << "  InterestKernel   " << setw(10) << kernelSeconds * 1e3 << " ms  ("
+         << kernelSeconds * 1e9 / kernelCount << " ns/account)" << endl;
+    cout << "  Mismatches: " << mismatches << endl;
+
+    Bank bank("Benchmark Bank");
+    for (size_t i = 0; i < bankCount; ++i) {
+        bank.createSavingsAccount("Holder " + to_string(i), Money::fromCents(pickBalance(rng)));
+    }
+    start = chrono::steady_clock::now();
+    InterestRunSummary summary = bank.accrueInterestAll();
+    double runSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Bank::accrueInterestAll: " << summary.accountsCredited << " accounts credited, $"
+         << summary.totalInterest << " total in " << runSeconds * 1e3 << " ms" << endl;
+}
+
+// End-of-day benchmark. Opens loans on many accounts, times schedule
+// generation, then runs Bank::runEndOfDay one month after origination (one
+// installment per loan) and checks the collected total against the loans'
+// own next installments.
+// Usage: --bench-eod [accounts] [loans per account]
+void runEndOfDayBenchmark(int argc, char* argv[]) {
+    size_t accountCount = argc > 0 ? stoul(argv[0]) : 1000000;
+    size_t loansPerAccount = argc > 1 ? stoul(argv[1]) : 2;
+
+    mt19937_64 rng(42);
+    uniform_int_distribution<int64_t> pickAmount(100000, 50000000);     // $1k to $500k
+    uniform_int_distribution<int64_t> pickRate(0, 150000);              // up to 15%
+    uniform_int_distribution<int> pickTerm(12, 360);
+
+    Bank bank("Benchmark Bank");
+    vector<uint64_t> ids(accountCount);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < accountCount; ++i) {
+        ids[i] = bank.createCheckingAccount("Holder " + to_string(i));
+        for (size_t l = 0; l < loansPerAccount; ++l) {
+            bank.applyLoan(ids[i], Money::fromCents(pickAmount(rng)), pickRate(rng), pickTerm(rng));
+        }
+    }
+    double setupSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    size_t loanCount = accountCount * loansPerAccount;
+    cout << "End-of-day benchmark: " << accountCount << " accounts, " << loanCount << " loans" << endl;
+    cout << fixed << setprecision(2);
+    cout << "  Loan origination  " << setw(10) << setupSeconds * 1e3 << " ms" << endl;
+
+    // Schedules for a sample of loans
+    size_t sample = min<size_t>(accountCount, 100000);
+    size_t installments = 0;
+    Money expected;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < sample; ++i) {
+        Account* acc = bank.findAccount(ids[i]);
+        lock_guard<mutex> lock(acc->getMutex());
+        for (size_t l = 0; l < acc->getLoanCount(); ++l) {
+            installments += acc->getLoan(l).schedule().size();
+        }
+    }
+    double scheduleSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "  Schedules         " << setw(10) << scheduleSeconds * 1e3 << " ms  ("
+         << installments << " installments, " << scheduleSeconds * 1e9 / installments
+         << " ns/installment)" << endl;
+
+    for (uint64_t id : ids) {
+        Account* acc = bank.findAccount(id);
+        lock_guard<mutex> lock(acc->getMutex());
+        for (size_t l = 0; l < acc->getLoanCount(); ++l) {
+            expected += acc->getLoan(l).nextInstallment().payment;
+        }
+    }
+    int64_t asOf = DateTime::addMonths(DateTime::nowNanos(), 1);
+    start = chrono::steady_clock::now();
+    InstallmentRunSummary summary = bank.runEndOfDay(asOf);
+    double runSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "  Bank::runEndOfDay " << setw(10) << runSeconds * 1e3 << " ms  ("
+         << runSeconds * 1e9 / max<size_t>(summary.installmentsPaid, 1) << " ns/installment)" << endl;
+    cout << "  Installments paid: " << summary.installmentsPaid << ", missed: " << summary.installmentsMissed
+         << ", collected $" << summary.totalCollected << " (expected $" << expected << ")" << endl;
+}
+
+// Clock benchmark: the old per-record path (time, localtime_r, strftime
+// into a new string) against reading a raw timestamp, and against
+// formatting through the per-thread cache.
+// Usage: --bench-clock [iterations]
+void runClockBenchmark(int argc, char* argv[]) {
+    size_t iterations = argc > 0 ? stoul(argv[0]) : 5000000;
+    size_t sink = 0;
+
+    auto time = [&](const char* label, const function<void()>& body) {
+        auto start = chrono::steady_clock::now();
+        body();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "  " << left << setw(34) << label << right << fixed << setprecision(1)
+             << setw(8) << seconds * 1e9 / iterations << " ns/op" << endl;
+    };
+
+    cout << "Clock benchmark: " << iterations << " iterations" << endl;
+    time("time + localtime_r + strftime", [&] {
+        for (size_t i = 0; i < iterations; ++i) {
+            sink += DateTime::formatUncached(::time(0)).size();
+        }
+    });
+    time("nowNanos (raw timestamp)", [&] {
+        for (size_t i = 0; i < iterations; ++i) {
+            sink += DateTime::nowNanos() & 1;
+        }
+    });
+    time("nowNanos + cached format", [&] {
+        for (size_t i = 0; i < iterations; ++i) {
+            sink += DateTime::format(DateTime::nowNanos()).size();
+        }
+    });
+    if (sink == 0) cout << endl;
+}
+
+// History query benchmark. Builds one account with a long history (old
+// chunks spilled to disk), then times last-N, date-range and type-filtered
+// queries and checks each against a full scan.
+// Usage: --bench-history [transactions]
+void runHistoryBenchmark(int argc, char* argv[]) {
+    size_t count = argc > 0 ? stoul(argv[0]) : 1000000;
+    const char* spillPath = "bench-history.spill";
+
+    Bank bank("Benchmark Bank");
+    bank.enableHistorySpill(spillPath);
+    uint64_t a = bank.createCheckingAccount("Holder A", Money::fromCents(100000000));
+    uint64_t b = bank.createCheckingAccount("Holder B");
+    for (size_t i = 0; i < count; ++i) {
+        if (i % 4 == 3) {
+            bank.transfer(a, b, Money::fromCents(1));
+        } else {
+            bank.deposit(a, Money::fromCents(1 + i % 100));
+        }
+    }
+    const TransactionHistory& history = bank.findAccount(a)->getHistory();
+    vector<Transaction> all;
+    history.forEachChunk([&all](const Transaction* records, size_t n) {
+        all.insert(all.end(), records, records + n);
+    });
+    int64_t from = all[all.size() * 2 / 5].getTimestamp();
+    int64_t to = all[all.size() * 3 / 5].getTimestamp();
+    uint8_t outgoing = TransactionHistory::typeBit(TxnType::TRANSFER_OUT);
+
+    auto sameRecords = [](const vector<Transaction>& x, const vector<Transaction>& y) {
+        return x.size() == y.size() && equal(x.begin(), x.end(), y.begin(),
+            [](const Transaction& p, const Transaction& q) { return p.getId() == q.getId(); });
+    };
+    vector<Transaction> expectLast(all.end() - min<size_t>(50, all.size()), all.end());
+    vector<Transaction> expectRange, expectOut;
+    for (const auto& t : all) {
+        if (t.getTimestamp() >= from && t.getTimestamp() <= to) expectRange.push_back(t);
+        if (t.getType() == TxnType::TRANSFER_OUT) expectOut.push_back(t);
+    }
+    expectOut.erase(expectOut.begin(), expectOut.end() - min<size_t>(50, expectOut.size()));
+
+    cout << "History benchmark: " << history.size() << " transactions" << endl;
+    auto time = [](const char* label, size_t results, bool correct, const function<void()>& query) {
+        const int REPEAT = 20;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < REPEAT; ++i) query();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "  " << left << setw(26) << label << right << setw(9) << results << " results "
+             << fixed << setprecision(1) << setw(10) << seconds * 1e6 / REPEAT << " us"
+             << (correct ? "" : "  MISMATCH") << endl;
+    };
+    time("last 50", 50, sameRecords(history.last(50), expectLast), [&] { history.last(50); });
+    time("last 50 TRANSFER_OUT", 50, sameRecords(history.last(50, outgoing), expectOut),
+         [&] { history.last(50, outgoing); });
+    time("middle 20% by time", expectRange.size(), sameRecords(history.between(from, to), expectRange),
+         [&] { history.between(from, to); });
+    time("full scan", all.size(), true, [&] {
+        size_t n = 0;
+        history.forEachChunk([&n](const Transaction*, size_t c) { n += c; });
+    });
+    ::unlink(spillPath);
+}
+
+// Account lookup benchmark. Random lookups through Bank::findAccount (id
+// hash index, plain pointer) against the previous scheme: a string key
+// passed by value into a std::map and a shared_ptr copied out.
+// Usage: --bench-lookup [accounts] [lookups]
+void runLookupBenchmark(int argc, char* argv[]) {
+    size_t accountCount = argc > 0 ? stoul(argv[0]) : 10000000;
+    size_t lookups = argc > 1 ? stoul(argv[1]) : 10000000;
+
+    Bank bank("Benchmark Bank");
+    vector<uint64_t> ids(accountCount);
+    for (size_t i = 0; i < accountCount; ++i) {
+        ids[i] = bank.createCheckingAccount("Holder " + to_string(i));
+    }
+    vector<size_t> order(lookups);
+    mt19937_64 rng(7);
+    uniform_int_distribution<size_t> pick(0, accountCount - 1);
+    for (auto& i : order) {
+        i = pick(rng);
+    }
+
+    auto start = chrono::steady_clock::now();
+    size_t found = 0;
+    for (size_t i : order) {
+        found += bank.findAccount(ids[i]) != nullptr;
+    }
+    double indexSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    shared_ptr<int> owner = make_shared<int>(0);
+    map<string, shared_ptr<Account>> legacy;
+    vector<string> numbers(accountCount);
+    for (size_t i = 0; i < accountCount; ++i) {
+        numbers[i] = formatAccountNumber(ids[i]);
+        legacy.emplace(numbers[i], shared_ptr<Account>(owner, bank.findAccount(ids[i])));
+    }
+    auto legacyFind = [&legacy](string accNum) -> shared_ptr<Account> {
+        auto it = legacy.find(accNum);
+        return it != legacy.end() ? it->second : nullptr;
+    };
+    start = chrono::steady_clock::now();
+    for (size_t i : order) {
+        found += legacyFind(numbers[i]) != nullptr;
+    }
+    double mapSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Lookup benchmark: " << accountCount << " accounts, " << lookups << " random lookups" << endl;
+    cout << fixed << setprecision(1);
+    cout << "  id hash index       " << setw(8) << indexSeconds * 1e9 / lookups << " ns/lookup" << endl;
+    cout << "  map<string> lookup  " << setw(8) << mapSeconds * 1e9 / lookups << " ns/lookup" << endl;
+    if (found != 2 * lookups) cout << "  Missing accounts: " << 2 * lookups - found << endl;
+}
+
+// Holder name search benchmark. Opens accounts under "First Surname"
+// names (several accounts per person), then times searches through the
+// name index (exact, any case, and prefix searches returning up to 50
+// accounts) against scanning every account and comparing names.
+// Usage: --bench-names [accounts] [searches]
+void runNameBenchmark(int argc, char* argv[]) {
+    size_t accountCount = argc > 0 ? max(1ul, stoul(argv[0])) : 10000000;
+    size_t searches = argc > 1 ? stoul(argv[1]) : 1000000;
+    const char* FIRST[] = {"Anna", "Ben", "Chloe", "David", "Emma", "Farid", "Grace", "Hiro",
+                           "Ines", "James", "Kavya", "Liam", "Maria", "Noah", "Olga", "Priya"};
+    size_t people = max(1ul, accountCount / 3);
+    auto holder = [&](size_t person) {
+        return string(FIRST[person % 16]) + " Surname" + to_string(person / 16);
+    };
+
+    Bank bank("Benchmark Bank");
+    mt19937_64 rng(7);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < accountCount; ++i) {
+        bank.createCheckingAccount(holder(rng() % people));
+    }
+    double openSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<string> exact(searches), anyCase(searches), prefix(searches);
+    for (size_t i = 0; i < searches; ++i) {
+        exact[i] = holder(rng() % people);
+        anyCase[i] = NameIndex::fold(exact[i]);
+        prefix[i] = exact[i].substr(0, exact[i].size() - 1);
+    }
+    size_t found = 0;
+    auto time = [&](const vector<string>& texts, NameMatch match) {
+        auto start = chrono::steady_clock::now();
+        for (const string& text : texts) {
+            found += bank.findAccountsByHolder(text, match, 50).size();
+        }
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e9 / max(1ul, searches);
+    };
+    double exactNanos = time(exact, NameMatch::EXACT);
+    double anyCaseNanos = time(anyCase, NameMatch::IGNORE_CASE);
+    double prefixNanos = time(prefix, NameMatch::PREFIX);
+
+    // The previous way: every account's name compared
+    const size_t SCANS = 3;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < SCANS; ++i) {
+        for (const AccountRow& row : bank.listAccounts()) {
+            found += row.holder == exact[i % searches];
+        }
+    }
+    double scanNanos = chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e9 / SCANS;
+
+    cout << "Name search benchmark: " << accountCount << " accounts, " << searches << " searches of each kind"
+         << endl;
+    cout << fixed << setprecision(1);
+    cout << "  opening accounts    " << setw(10) << openSeconds * 1e9 / accountCount << " ns/account (index "
+         << bank.getNameIndexBytes() / accountCount << " bytes/account)" << endl;
+    cout << "  exact               " << setw(10) << exactNanos / 1000 << " us/search" << endl;
+    cout << "  any case            " << setw(10) << anyCaseNanos / 1000 << " us/search" << endl;
+    cout << "  prefix (first 50)   " << setw(10) << prefixNanos / 1000 << " us/search" << endl;
+    cout << "  scan all accounts   " << setw(10) << scanNanos / 1000 << " us/search" << endl;
+    cout << "  " << found << " accounts found" << endl;
+}
+
+// Account storage benchmark. Opening rate: accounts built as separate heap
+// objects, the previous scheme, against building them in SlabPools. Scan
+// rate: the same accounts, each given a first deposit and a loan so other
+// allocations fall in between, summed over balances and outstanding loans;
+// heap objects in shard order, as the full-bank scans used to walk them,
+// and the pools in memory order.
+// Usage: --bench-arena [accounts]
+void runArenaBenchmark(int argc, char* argv[]) {
+    size_t accountCount = argc > 0 ? stoul(argv[0]) : 2000000;
+    Money deposit = Money::fromCents(10000);
+    Money loan = Money::fromCents(500000);
+
+    vector<uint64_t> ids(accountCount);
+    for (auto& id : ids) {
+        id = IdGenerator::next();
+    }
+
+    // Accounts have no virtual destructor, so each type is owned separately
+    struct HeapAccounts {
+        vector<unique_ptr<SavingsAccount>> savings;
+        vector<unique_ptr<CheckingAccount>> checking;
+        vector<Account*> all;
+
+        Account* open(size_t i, uint64_t id) {
+            if (i % 2 == 0) {
+                savings.push_back(make_unique<SavingsAccount>(id, "Holder"));
+                all.push_back(savings.back().get());
+            } else {
+                checking.push_back(make_unique<CheckingAccount>(id, "Holder"));
+                all.push_back(checking.back().get());
+            }
+            return all.back();
+        }
+    };
+
+    double heapCreateSeconds, poolCreateSeconds;
+    {
+        HeapAccounts heap;
+        heap.all.reserve(accountCount);
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < accountCount; ++i) {
+            heap.open(i, ids[i]);
+        }
+        heapCreateSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    {
+        SlabPool<SavingsAccount> savingsPool;
+        SlabPool<CheckingAccount> checkingPool;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < accountCount; ++i) {
+            if (i % 2 == 0) {
+                savingsPool.create(ids[i], "Holder");
+            } else {
+                checkingPool.create(ids[i], "Holder");
+            }
+        }
+        poolCreateSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    HeapAccounts heap;
+    heap.all.reserve(accountCount);
+    SlabPool<SavingsAccount> savingsPool;
+    SlabPool<CheckingAccount> checkingPool;
+    for (size_t i = 0; i < accountCount; ++i) {
+        Account* acc;
+        if (i % 2 == 0) {
+            acc = savingsPool.create(ids[i], "Holder");
+        } else {
+            acc = checkingPool.create(ids[i], "Holder");
+        }
+        for (Account* opened : {heap.open(i, ids[i]), acc}) {
+            opened->deposit(deposit);
+            opened->applyLoan(loan, 50000, 60);
+        }
+    }
+
+    // Shard order: grouped by the top bits of the id hash
+    vector<Account*> shardOrder = heap.all;
+    auto shardOf = [](const Account* acc) { return (acc->getAccountId() * 0x9E3779B97F4A7C15ULL) >> 58; };
+    stable_sort(shardOrder.begin(), shardOrder.end(), [&](const Account* a, const Account* b) {
+        return shardOf(a) < shardOf(b);
+    });
+
+    const int PASSES = 5;
+    int64_t heapSum = 0, poolSum = 0;
+    auto start = chrono::steady_clock::now();
+    for (int pass = 0; pass < PASSES; ++pass) {
+        for (const Account* acc : shardOrder) {
+            heapSum += acc->getBalance().getCents() + acc->getOutstandingLoans().getCents();
+        }
+    }
+    double heapScanSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count() / PASSES;
+
+    auto sum = [&poolSum](const Account* acc) {
+        poolSum += acc->getBalance().getCents() + acc->getOutstandingLoans().getCents();
+    };
+    start = chrono::steady_clock::now();
+    for (int pass = 0; pass < PASSES; ++pass) {
+        savingsPool.forEach(sum);
+        checkingPool.forEach(sum);
+    }
+    double poolScanSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count() / PASSES;
+
+    cout << "Account storage benchmark: " << accountCount << " accounts" << endl;
+    cout << fixed << setprecision(1);
+    cout << "  Open, heap objects    " << setw(8) << heapCreateSeconds * 1e9 / accountCount << " ns/account" << endl;
+    cout << "  Open, slab pools      " << setw(8) << poolCreateSeconds * 1e9 / accountCount << " ns/account" << endl;
+    cout << "  Scan, heap objects    " << setw(8) << heapScanSeconds * 1e9 / accountCount << " ns/account" << endl;
+    cout << "  Scan, slab pools      " << setw(8) << poolScanSeconds * 1e9 / accountCount << " ns/account" << endl;
+    if (heapSum != poolSum) cout << "  Scan totals differ!" << endl;
+}
+
+// Withdraw benchmark. Rounds of withdrawals over a mix of savings and
+// checking accounts, three ways: through a virtual withdraw that checking
+// accounts override (the previous scheme, rebuilt here with the same
+// body), through Account::withdraw's dispatch on the kind tag in the same
+// mixed order, and as homogeneous runs over each slab pool calling the
+// concrete type directly.
+// Usage: --bench-withdraw [accounts] [rounds]
+void runWithdrawBenchmark(int argc, char* argv[]) {
+    size_t accountCount = argc > 0 ? stoul(argv[0]) : 100000;
+    size_t rounds = argc > 1 ? stoul(argv[1]) : 50;
+    Money opening = Money::fromCents(1000000);
+    Money amount = Money::fromCents(100);
+
+    struct VirtualAccount {
+        Money balance;
+        TransactionHistory history;
+
+        virtual ~VirtualAccount() {}
+
+        virtual TxnStatus withdraw(Money amt) {
+            if (amt <= Money()) {
+                return TxnStatus::INVALID_AMOUNT;
+            }
+            if (balance < amt) {
+                return TxnStatus::INSUFFICIENT_FUNDS;
+            }
+            balance -= amt;
+            history.append(Transaction(TxnType::WITHDRAW, amt));
+            return TxnStatus::OK;
+        }
+    };
+    struct VirtualChecking : VirtualAccount {
+        Money overdraftLimit = Money::fromCents(50000);
+
+        TxnStatus withdraw(Money amt) override {
+            if (amt <= Money()) {
+                return TxnStatus::INVALID_AMOUNT;
+            }
+            if (balance + overdraftLimit < amt) {
+                return TxnStatus::OVERDRAFT_EXCEEDED;
+            }
+            balance -= amt;
+            history.append(Transaction(TxnType::WITHDRAW, amt));
+            return TxnStatus::OK;
+        }
+    };
+
+    // Types are mixed at random, as accounts are opened in practice
+    mt19937_64 rng(3);
+    vector<bool> isChecking(accountCount);
+    for (size_t i = 0; i < accountCount; ++i) {
+        isChecking[i] = rng() & 1;
+    }
+
+    // A separate copy of the accounts for each variant, so every variant
+    // appends to histories of the same length
+    vector<unique_ptr<VirtualAccount>> virtualAccounts;
+    SlabPool<SavingsAccount> savingsPool, mixedSavings;
+    SlabPool<CheckingAccount> checkingPool, mixedChecking;
+    vector<Account*> mixed;
+    for (size_t i = 0; i < accountCount; ++i) {
+        uint64_t id = IdGenerator::next();
+        Account* acc;
+        if (isChecking[i]) {
+            virtualAccounts.emplace_back(new VirtualChecking());
+            mixed.push_back(mixedChecking.create(id, "Holder"));
+            acc = checkingPool.create(id, "Holder");
+        } else {
+            virtualAccounts.emplace_back(new VirtualAccount());
+            mixed.push_back(mixedSavings.create(id, "Holder"));
+            acc = savingsPool.create(id, "Holder");
+        }
+        virtualAccounts.back()->balance = opening;
+        mixed.back()->deposit(opening);
+        acc->deposit(opening);
+    }
+
+    // Each variant runs an accepted round ($1) and a declined one (more
+    // than any balance plus overdraft); declined withdrawals skip the
+    // history append and show the dispatch cost on its own
+    Money tooMuch = Money::fromCents(100000000);
+    size_t accepted = 0, declined = 0;
+    auto time = [&](const char* label, const function<void(Money)>& round) {
+        double seconds[2];
+        Money amounts[2] = {amount, tooMuch};
+        for (int k = 0; k < 2; ++k) {
+            auto start = chrono::steady_clock::now();
+            for (size_t r = 0; r < rounds; ++r) {
+                round(amounts[k]);
+            }
+            seconds[k] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        size_t total = accountCount * rounds;
+        cout << "  " << left << setw(28) << label << right << fixed << setprecision(1)
+             << setw(10) << seconds[0] * 1e9 / total << setw(10) << seconds[1] * 1e9 / total << endl;
+    };
+    auto count = [&](TxnStatus status) {
+        if (status == TxnStatus::OK) {
+            ++accepted;
+        } else {
+            ++declined;
+        }
+    };
+
+    cout << "Withdraw benchmark: " << accountCount << " accounts, " << rounds << " rounds" << endl;
+    cout << "  " << left << setw(28) << "ns/withdrawal" << right << setw(10) << "accepted"
+         << setw(10) << "declined" << endl;
+    time("virtual call", [&](Money amt) {
+        for (auto& acc : virtualAccounts) {
+            count(acc->withdraw(amt));
+        }
+    });
+    time("tag dispatch, mixed order", [&](Money amt) {
+        for (Account* acc : mixed) {
+            count(acc->withdraw(amt));
+        }
+    });
+    time("homogeneous runs", [&](Money amt) {
+        savingsPool.forEach([&](SavingsAccount* acc) { count(acc->withdraw(amt)); });
+        checkingPool.forEach([&](CheckingAccount* acc) { count(acc->withdraw(amt)); });
+    });
+    size_t expected = 3 * accountCount * rounds;
+    if (accepted != expected || declined != expected) {
+        cout << "  Unexpected results: " << accepted << " accepted, " << declined << " declined" << endl;
+    }
+}
+
+// Change feed and ledger export benchmark. Deposits are timed with and
+// without the change feed, then the whole ledger is exported at 1, 2, 4,
+// ... threads and read back.
+// Usage: --bench-export [accounts] [transactions per account] [max threads]
+void runExportBenchmark(int argc, char* argv[]) {
+    size_t accountCount = argc > 0 ? stoul(argv[0]) : 100000;
+    size_t perAccount = argc > 1 ? max(2ul, stoul(argv[1])) : 50;
+    unsigned maxThreads = argc > 2 ? stoul(argv[2]) : max(1u, thread::hardware_concurrency());
+    const string feedFile = "bench.cdc";
+    const string ledgerFile = "bench.ledger";
+
+    Bank bank("Export Bench");
+    vector<uint64_t> ids;
+    for (size_t i = 0; i < accountCount; ++i) {
+        ids.push_back(bank.createSavingsAccount("Holder"));
+    }
+    auto depositRounds = [&](size_t rounds) {
+        auto start = chrono::steady_clock::now();
+        for (size_t r = 0; r < rounds; ++r) {
+            for (uint64_t id : ids) bank.deposit(id, Money::fromCents(100));
+        }
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count() / (rounds * accountCount);
+    };
+    cout << "Ledger export: " << accountCount << " accounts, " << perAccount << " transactions each" << endl;
+    double plain = depositRounds(perAccount / 2);
+    ::unlink(feedFile.c_str());
+    if (!bank.startChangeFeed(feedFile)) {
+        cout << "  Cannot write " << feedFile << "!" << endl;
+        return;
+    }
+    double streamed = depositRounds(perAccount - perAccount / 2);
+    bool drained = bank.drainChangeFeed();
+    ChangeFeedStats feed = bank.getChangeFeedStats();
+    bank.stopChangeFeed();
+    struct stat st;
+    bool feedOk = drained && ::stat(feedFile.c_str(), &st) == 0 &&
+                  static_cast<uint64_t>(st.st_size) == feed.published * sizeof(ChangeRecord);
+    cout << fixed << setprecision(0) << "  deposit " << plain * 1e9 << " ns, with change feed "
+         << streamed * 1e9 << " ns (" << feed.published << " events, " << feed.stalls << " full-ring waits"
+         << (feedOk ? "" : ", FILE SIZE MISMATCH") << ")" << endl;
+    ::unlink(feedFile.c_str());
+
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        LedgerExportSummary summary;
+        auto start = chrono::steady_clock::now();
+        bool ok = bank.exportLedger(ledgerFile, threads, summary);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        LedgerFile check;
+        ok = ok && check.open(ledgerFile) && check.getRowCount() == accountCount * perAccount;
+        cout << "  " << setw(2) << threads << " threads: " << setprecision(0) << summary.rows / seconds
+             << " rows/sec, " << setprecision(1) << summary.bytes / 1e6 / seconds << " MB/sec"
+             << (ok ? "" : ", EXPORT MISMATCH") << endl;
+    }
+    ::unlink(ledgerFile.c_str());
+}
+
+// Id generator benchmark. Every thread draws the same number of ids; the
+// ids are then checked for duplicates.
+// Usage: --bench-ids [ids per thread] [threads]
+void runIdBenchmark(int argc, char* argv[]) {
+    size_t idsPerThread = argc > 0 ? stoul(argv[0]) : 10000000;
+    unsigned threads = argc > 1 ? stoul(argv[1]) : max(1u, thread::hardware_concurrency());
+
+    vector<uint64_t> ids(idsPerThread * threads);
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            uint64_t* out = ids.data() + t * idsPerThread;
+            for (size_t i = 0; i < idsPerThread; ++i) {
+                out[i] = IdGenerator::next();
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    sort(ids.begin(), ids.end());
+    size_t duplicates = ids.size() - (unique(ids.begin(), ids.end()) - ids.begin());
+    cout << "Id generator: " << threads << " threads, " << idsPerThread << " ids per thread" << endl;
+    cout << fixed << setprecision(0) << "  " << ids.size() / seconds << " ids/sec, "
+         << duplicates << " duplicates" << endl;
+}
+
+// Load generator for --serve. Opens the accounts, then each connection
+// sends `depth` requests at a time (deposits, withdrawals, transfers and
+// balance checks between random accounts) and waits for their replies,
+// until the time is up. Reports throughput, per-request latency (send to
+// reply) and the results.
+// Usage: --load [port] [connections] [depth] [seconds] [accounts] [host]
+int runLoadClient(int argc, char* argv[]) {
+    uint16_t port = argc > 0 ? stoul(argv[0]) : 7000;
+    unsigned connections = argc > 1 ? stoul(argv[1]) : 4;
+    size_t depth = argc > 2 ? max(1ul, stoul(argv[2])) : 64;
+    double duration = argc > 3 ? stod(argv[3]) : 5;
+    size_t accountCount = argc > 4 ? max(2ul, stoul(argv[4])) : 10000;
+    string host = argc > 5 ? argv[5] : "127.0.0.1";
+
+    BankClient setup;
+    if (!setup.connect(host, port)) {
+        cout << "Cannot connect to " << host << ':' << port << "!" << endl;
+        return 1;
+    }
+    vector<uint64_t> accounts;
+    accounts.reserve(accountCount);
+    for (size_t i = 0; i < accountCount; ++i) {
+        setup.createAccount(AccountKind::CHECKING, "Load " + to_string(i), Money::fromCents(1000000));
+    }
+    TxnStatus status;
+    BinaryReader body(nullptr, 0);
+    if (!setup.send()) {
+        cout << "Connection lost!" << endl;
+        return 1;
+    }
+    for (size_t i = 0; i < accountCount; ++i) {
+        if (!setup.receive(status, body) || status != TxnStatus::OK) {
+            cout << "Cannot open the load accounts!" << endl;
+            return 1;
+        }
+        accounts.push_back(body.u64());
+    }
+
+    vector<vector<int64_t>> latencies(connections);
+    vector<vector<size_t>> counts(connections, vector<size_t>(TXN_STATUS_COUNT));
+    atomic<unsigned> failed(0);
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(duration));
+    vector<thread> workers;
+    for (unsigned t = 0; t < connections; ++t) {
+        workers.emplace_back([&, t] {
+            BankClient client;
+            if (!client.connect(host, port)) {
+                ++failed;
+                return;
+            }
+            mt19937_64 rng(t + 1);
+            uniform_int_distribution<size_t> pick(0, accounts.size() - 1);
+            uniform_int_distribution<int64_t> cents(1, 5000);
+            TxnStatus status;
+            BinaryReader body(nullptr, 0);
+            while (chrono::steady_clock::now() < deadline) {
+                for (size_t i = 0; i < depth; ++i) {
+                    uint64_t a = accounts[pick(rng)];
+                    Money amt = Money::fromCents(cents(rng));
+                    switch (rng() % 10) {
+                        case 0: case 1: case 2: case 3:
+                            client.deposit(a, amt);
+                            break;
+                        case 4: case 5:
+                            client.withdraw(a, amt);
+                            break;
+                        case 6: case 7: case 8:
+                            client.transfer(a, accounts[pick(rng)], amt);
+                            break;
+                        default:
+                            client.balance(a);
+                    }
+                }
+                auto sent = chrono::steady_clock::now();
+                if (!client.send()) {
+                    ++failed;
+                    return;
+                }
+                for (size_t i = 0; i < depth; ++i) {
+                    if (!client.receive(status, body)) {
+                        ++failed;
+                        return;
+                    }
+                    latencies[t].push_back(chrono::duration_cast<chrono::nanoseconds>(
+                        chrono::steady_clock::now() - sent).count());
+                    ++counts[t][static_cast<int>(status)];
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<int64_t> all;
+    vector<size_t> totals(TXN_STATUS_COUNT);
+    for (unsigned t = 0; t < connections; ++t) {
+        all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+        for (size_t i = 0; i < TXN_STATUS_COUNT; ++i) totals[i] += counts[t][i];
+    }
+    sort(all.begin(), all.end());
+    auto percentile = [&all](double p) {
+        return all.empty() ? 0.0 : all[min(all.size() - 1, static_cast<size_t>(p * all.size()))] / 1000.0;
+    };
+    cout << "Load: " << connections << " connections, " << depth << " requests in flight each, "
+         << accountCount << " accounts" << endl;
+    cout << fixed << setprecision(0) << "  " << all.size() << " requests, "
+         << (seconds > 0 ? all.size() / seconds : 0) << " requests/sec" << endl;
+    cout << setprecision(1) << "  latency p50 " << percentile(0.5) << " us, p99 " << percentile(0.99)
+         << " us, p99.9 " << percentile(0.999) << " us" << endl;
+    for (size_t i = 0; i < TXN_STATUS_COUNT; ++i) {
+        if (totals[i] > 0) {
+            cout << setw(22) << statusName(static_cast<TxnStatus>(i)) << setw(12) << totals[i] << endl;
+        }
+    }
+    if (failed > 0) {
+        cout << failed << " connections failed!" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Writes a synthetic trace for --replay (see generateTrace).
+// Usage: --trace-gen <trace file> [operations] [accounts] [skew] [rate]
+int runTraceGen(int argc, char* argv[]) {
+    if (argc < 1) {
+        cout << "Usage: BankingSystem --trace-gen <trace file> [operations] [accounts] [skew] [rate]" << endl;
+        return 1;
+    }
+    TraceShape shape;
+    if (argc > 1) shape.operations = stoul(argv[1]);
+    if (argc > 2) shape.accounts = max(2ul, stoul(argv[2]));
+    if (argc > 3) shape.skew = stod(argv[3]);
+    if (argc > 4) shape.rate = max(1.0, stod(argv[4]));
+    if (!writeTraceFile(argv[0], generateTrace(shape))) {
+        cout << "Cannot write trace " << argv[0] << "!" << endl;
+        return 1;
+    }
+    cout << "Wrote " << shape.operations << " operations over " << shape.accounts << " accounts to "
+         << argv[0] << "!" << endl;
+    return 0;
+}
+
+// Replays a recorded or generated trace against a fresh bank and reports
+// throughput and per-operation latency. pace is "1x", "10x", ... for the
+// recorded gaps sped up, "5000/s" for a fixed rate, or "max" to issue
+// back to back. With accounts > 0 the trace's accounts are redrawn from
+// that many with Zipf skew. BANK_REPLAY_JOURNAL journals the replay bank
+// to that file, to include the commit path.
+// Usage: --replay <trace file> [pace] [threads] [accounts] [skew]
+int runReplay(int argc, char* argv[]) {
+    if (argc < 1) {
+        cout << "Usage: BankingSystem --replay <trace file> [1x|<n>x|<n>/s|max] [threads] [accounts] [skew]"
+             << endl;
+        return 1;
+    }
+    vector<TraceRecord> trace;
+    if (!readTraceFile(argv[0], trace)) {
+        cout << "Cannot read trace " << argv[0] << "!" << endl;
+        return 1;
+    }
+    ReplayOptions options;
+    string pace = argc > 1 ? argv[1] : "1x";
+    if (pace == "max") {
+        options.pace = ReplayPace::MAX;
+    } else if (pace.size() > 2 && pace.compare(pace.size() - 2, 2, "/s") == 0) {
+        options.pace = ReplayPace::RATE;
+        options.rate = stod(pace);
+    } else if (pace.size() > 1 && pace.back() == 'x') {
+        options.speed = stod(pace);
+    } else {
+        cout << "Unknown pace " << pace << "!" << endl;
+        return 1;
+    }
+    if (options.rate < 0 || options.speed <= 0 || (options.pace == ReplayPace::RATE && options.rate == 0)) {
+        cout << "Unknown pace " << pace << "!" << endl;
+        return 1;
+    }
+    options.threads = argc > 2 ? max(1ul, stoul(argv[2])) : 1;
+    options.accounts = argc > 3 ? stoul(argv[3]) : 0;
+    options.skew = argc > 4 ? stod(argv[4]) : 0;
+
+    Bank bank("Replay Bank");
+    if (const char* journal = getenv("BANK_REPLAY_JOURNAL")) {
+        string snapshot = string(journal) + ".snapshot";
+        remove(journal);
+        remove(snapshot.c_str());
+        RecoveryReport recovery = bank.recover(snapshot, journal);
+        if (!recovery.error.empty() || !recovery.journalOpen) {
+            cout << "Cannot write journal " << journal << "!" << endl;
+            return 1;
+        }
+    }
+    ReplayReport report = replayTrace(bank, trace, options);
+
+    cout << "Replay: " << report.total << " operations over " << report.accounts << " accounts, "
+         << options.threads << " threads, pace " << pace << endl;
+    if (report.skipped > 0) {
+        cout << "  " << report.skipped << " records skipped" << endl;
+    }
+    cout << fixed << setprecision(2) << "  " << report.seconds << " s (" << report.scheduledSeconds
+         << " s scheduled), " << setprecision(0) << (report.seconds > 0 ? report.total / report.seconds : 0)
+         << " ops/sec, max lag " << setprecision(1) << report.maxLagNanos / 1000.0 << " us" << endl;
+    cout << setw(16) << "operation" << setw(10) << "count" << setw(12) << "ops/sec" << setw(10) << "p50 us"
+         << setw(10) << "p99 us" << setw(10) << "p99.9 us" << setw(10) << "max us" << endl;
+    for (size_t op = 0; op < METRIC_OP_COUNT; ++op) {
+        const LatencySummary& latency = report.ops[op].latency;
+        if (latency.count == 0) continue;
+        cout << setw(16) << metricOpName(static_cast<MetricOp>(op)) << setw(10) << latency.count
+             << setprecision(0) << setw(12) << (report.seconds > 0 ? latency.count / report.seconds : 0)
+             << setprecision(1) << setw(10) << latency.quantile(0.5) / 1000.0 << setw(10)
+             << latency.quantile(0.99) / 1000.0 << setw(10) << latency.quantile(0.999) / 1000.0 << setw(10)
+             << latency.maxNanos / 1000.0 << endl;
+    }
+    for (size_t s = 0; s < TXN_STATUS_COUNT; ++s) {
+        uint64_t total = 0;
+        for (const ReplayOpStats& stats : report.ops) total += stats.statuses[s];
+        if (total > 0) {
+            cout << setw(22) << statusName(static_cast<TxnStatus>(s)) << setw(12) << total << endl;
+        }
+    }
+    return 0;
+}
+
+// Parses one settlement line into op. Lines look like
+//   D <account> <amount>            deposit
+//   W <account> <amount>            withdrawal
+//   T <from> <to> <amount>          transfer
+//   P <account> <loan #> <amount>   loan payment (loan numbers start at 1)
+// Blank lines and lines starting with '#' are skipped (returns false).
+bool parseSettlementLine(const char* p, const char* end, BatchOp& op, bool& valid) {
+    auto skipSpace = [&]() { while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p; };
+    // Malformed account numbers parse to id 0 and report ACCOUNT_NOT_FOUND
+    auto account = [&](uint64_t& out) {
+        skipSpace();
+        const char* start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r') ++p;
+        out = parseAccountNumber(string_view(start, p - start));
+        return p > start;
+    };
+    auto amount = [&](Money& out) {
+        return Money::parse(p, end, out) && (p == end || *p == ' ' || *p == '\t' || *p == '\r');
+    };
+    auto integer = [&](int& out) {
+        skipSpace();
+        char* stop;
+        out = static_cast<int>(strtol(p, &stop, 10));
+        bool ok = stop > p && stop <= end;
+        p = stop;
+        return ok;
+    };
+
+    skipSpace();
+    if (p == end || *p == '#') return false;
+    char code = *p++;
+    valid = true;
+    int loanNumber = 0;
+    switch (code) {
+        case 'D':
+            op.type = BatchOpType::DEPOSIT;
+            valid = account(op.account) && amount(op.amount);
+            break;
+        case 'W':
+            op.type = BatchOpType::WITHDRAW;
+            valid = account(op.account) && amount(op.amount);
+            break;
+        case 'T':
+            op.type = BatchOpType::TRANSFER;
+            valid = account(op.account) && account(op.toAccount) && amount(op.amount);
+            break;
+        case 'P':
+            op.type = BatchOpType::PAY_LOAN;
+            valid = account(op.account) && integer(loanNumber) && amount(op.amount);
+            op.loanIndex = loanNumber - 1;
+            break;
+        default:
+            valid = false;
+    }
+    return true;
+}
+
+// Applies a settlement file to the persisted bank in batches and prints a
+// summary. Usage: --batch <settlement file> [results file]
+int runBatchMode(int argc, char* argv[]) {
+    if (argc < 1) {
+        cout << "Usage: BankingSystem --batch <settlement file> [results file]" << endl;
+        return 1;
+    }
+    string input;
+    if (!readWholeFile(argv[0], input)) {
+        cout << "Cannot read settlement file " << argv[0] << "!" << endl;
+        return 1;
+    }
+    ofstream resultsFile;
+    // Result lines are written by a background writer while later batches run
+    unique_ptr<LogSink> resultsSink;
+    if (argc > 1) {
+        resultsFile.open(argv[1]);
+        if (!resultsFile) {
+            cout << "Cannot write results file " << argv[1] << "!" << endl;
+            return 1;
+        }
+        resultsSink = make_unique<LogSink>(resultsFile);
+    }
+
+    Bank bank("Swagat's Bank");
+    RecoveryReport recovery = bank.recover("bank.snapshot", "bank.journal");
+    if (!recovery.error.empty()) {
+        cout << "Cannot restore the bank: " << recovery.error << "!" << endl;
+        return 1;
+    }
+    if (const char* rules = getenv("BANK_RISK_RULES")) {
+        string error;
+        if (!bank.loadRiskRules(rules, error)) {
+            cout << "Risk rules not loaded (" << error << ")!" << endl;
+            return 1;
+        }
+    }
+    TraceRecorder recorder;
+    if (const char* trace = getenv("BANK_TRACE_FILE")) {
+        if (!recorder.open(trace)) {
+            cout << "Cannot write trace " << trace << "!" << endl;
+            return 1;
+        }
+        bank.setTraceRecorder(&recorder);
+    }
+
+    const size_t BATCH_SIZE = 4096;
+    vector<BatchOp> ops(BATCH_SIZE);
+    vector<size_t> lineNumbers(BATCH_SIZE);
+    vector<TxnStatus> results(BATCH_SIZE);
+    size_t counts[TXN_STATUS_COUNT] = {};
+    size_t malformed = 0, total = 0;
+    string resultBuf;
+
+    auto start = chrono::steady_clock::now();
+    auto flushBatch = [&](size_t n) {
+        bank.applyBatch(ops.data(), n, results.data());
+        for (size_t i = 0; i < n; ++i) {
+            ++counts[static_cast<int>(results[i])];
+            if (resultsSink) {
+                resultBuf += to_string(lineNumbers[i]);
+                resultBuf += ' ';
+                resultBuf += statusName(results[i]);
+                resultBuf += '\n';
+            }
+        }
+        if (resultsSink) {
+            resultsSink->write(move(resultBuf));
+            resultBuf.clear();
+        }
+        total += n;
+    };
+
+    const char* p = input.data();
+    const char* end = p + input.size();
+    size_t pending = 0, lineNo = 0;
+    while (p < end) {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!lineEnd) lineEnd = end;
+        ++lineNo;
+        bool valid;
+        if (parseSettlementLine(p, lineEnd, ops[pending], valid)) {
+            if (valid) {
+                lineNumbers[pending] = lineNo;
+                if (++pending == BATCH_SIZE) {
+                    flushBatch(pending);
+                    pending = 0;
+                }
+            } else {
+                ++malformed;
+                if (resultsSink) {
+                    // Keep the results file in input order
+                    if (pending > 0) {
+                        flushBatch(pending);
+                        pending = 0;
+                    }
+                    resultsSink->write(to_string(lineNo) + " MALFORMED\n");
+                }
+            }
+        }
+        p = lineEnd + 1;
+    }
+    if (pending > 0) flushBatch(pending);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    bank.checkpoint();
+
+    cout << "Processed " << total << " operations in " << fixed << setprecision(3) << seconds
+         << "s (" << setprecision(0) << (seconds > 0 ? total / seconds : 0) << " ops/sec)" << endl;
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        if (counts[i] > 0) {
+            cout << setw(22) << statusName(static_cast<TxnStatus>(i)) << setw(12) << counts[i] << endl;
+        }
+    }
+    if (malformed > 0) {
+        cout << setw(22) << "MALFORMED" << setw(12) << malformed << endl;
+    }
     return 0;
 }
+
+int main(int argc, char* argv[]) {
+    if (const char* node = getenv("BANK_NODE_ID")) {
+        IdGenerator::setNodeId(atoi(node));
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-clock") {
+        runClockBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-history") {
+        runHistoryBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-lookup") {
+        runLookupBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-names") {
+        runNameBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-arena") {
+        runArenaBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-withdraw") {
+        runWithdrawBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-export") {
+        runExportBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-ids") {
+        runIdBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-transfer") {
+        runTransferBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-eod") {
+        runEndOfDayBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-interest") {
+        runInterestBenchmark(argc - 2, argv + 2);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--batch") {
+        return runBatchMode(argc - 2, argv + 2);
+    }
+    if (argc > 1 && string(argv[1]) == "--export") {
+        // Usage: --export <ledger file> [threads]
+        if (argc < 3) {
+            cout << "Usage: BankingSystem --export <ledger file> [threads]" << endl;
+            return 1;
+        }
+        unsigned threads = argc > 3 ? stoul(argv[3]) : 0;
+        BankingSystem system("Swagat's Bank");
+        return system.exportLedger(argv[2], threads);
+    }
+    if (argc > 1 && string(argv[1]) == "--trace-gen") {
+        return runTraceGen(argc - 2, argv + 2);
+    }
+    if (argc > 1 && string(argv[1]) == "--replay") {
+        return runReplay(argc - 2, argv + 2);
+    }
+    if (argc > 1 && string(argv[1]) == "--load") {
+        return runLoadClient(argc - 2, argv + 2);
+    }
+    if (argc > 1 && string(argv[1]) == "--serve") {
+        // Usage: --serve [port] [reactor threads] [host]
+        uint16_t port = argc > 2 ? stoul(argv[2]) : 7000;
+        unsigned reactors = argc > 3 ? stoul(argv[3]) : max(1u, thread::hardware_concurrency());
+        string host = argc > 4 ? argv[4] : "127.0.0.1";
+        BankingSystem system("Swagat's Bank");
+        return system.serve(port, reactors, host);
+    }
+
+    BankingSystem system("Swagat's Bank");
+    return system.run();
+}
@@ -0,0 +1,581 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Bank.h"
+#include "BankClient.h"
+#include "BankServer.h"
+#include "LogSink.h"
+#include "Metrics.h"
+#include "Replay.h"
+#include "ShardLink.h"
+#include "Workload.h"
+
+using namespace std;
+
+// Benchmark suite for the banking core. Benchmarks taking (accounts, skew)
+// run against a bank of that many accounts with Zipf skew given in
+// hundredths (99 = 0.99). Every benchmark reports items per second.
+
+namespace {
+
+const Money OPENING = Money::fromCents(100000000);
+const size_t PICKS = 1 << 16;
+
+// Populated bank shared by the runs of one (accounts, skew) configuration
+struct Fixture {
+    Bank bank;
+    Workload workload;
+    size_t accounts;
+    int64_t skew;
+
+    Fixture(size_t accounts, int64_t skew)
+        : bank("Benchmark Bank"), workload(skew / 100.0), accounts(accounts), skew(skew) {
+        workload.populate(bank, accounts, OPENING);
+    }
+};
+
+// Only the most recent configuration is kept, so a run over several sizes
+// holds one bank at a time. Every thread of a threaded benchmark asks for
+// the same configuration and gets the same bank.
+Fixture& fixture(const benchmark::State& state) {
+    static mutex mtx;
+    static unique_ptr<Fixture> current;
+    size_t accounts = state.range(0);
+    int64_t skew = state.range(1);
+    lock_guard<mutex> lock(mtx);
+    if (!current || current->accounts != accounts || current->skew != skew) {
+        current.reset();
+        current = make_unique<Fixture>(accounts, skew);
+    }
+    return *current;
+}
+
+void bankArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"accounts", "skew"})->ArgsProduct({{10000, 100000}, {0, 99}});
+}
+
+string tempPath(const char* name) {
+    const char* dir = getenv("TMPDIR");
+    return string(dir && *dir ? dir : "/tmp") + "/" + name;
+}
+
+} // namespace
+
+static void BM_CreateAccount(benchmark::State& state) {
+    Bank bank("Benchmark Bank");
+    uint64_t n = 0;
+    for (auto _ : state) {
+        uint64_t id = (n++ % 2 == 0) ? bank.createSavingsAccount("Holder", OPENING)
+                                     : bank.createCheckingAccount("Holder", OPENING);
+        benchmark::DoNotOptimize(id);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CreateAccount);
+
+static void BM_Lookup(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<uint64_t> ids = f.workload.picks(PICKS);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.bank.findAccount(ids[i++ % PICKS]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Lookup)->Apply(bankArgs);
+
+// Holder name searches through the name index, returning at most 50
+// accounts, with match mode range(2): 0 exact, 1 any case, 2 prefix
+// (the name less its last digit, so about ten accounts)
+static void BM_FindByHolder(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    NameMatch match = static_cast<NameMatch>(state.range(2));
+    vector<string> texts;
+    for (uint64_t id : f.workload.picks(1024)) {
+        string text = f.bank.findAccount(id)->getAccountHolder();
+        if (match == NameMatch::IGNORE_CASE) text = NameIndex::fold(text);
+        if (match == NameMatch::PREFIX) text.pop_back();
+        texts.push_back(text);
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.bank.findAccountsByHolder(texts[i++ % texts.size()], match, 50));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FindByHolder)
+    ->ArgNames({"accounts", "skew", "match"})
+    ->ArgsProduct({{10000, 100000}, {0}, {0, 1, 2}});
+
+static void BM_Deposit(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<uint64_t> ids = f.workload.picks(PICKS);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.bank.deposit(ids[i++ % PICKS], Money::fromCents(100)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Deposit)->Apply(bankArgs);
+
+// Deposits with metrics switched off; the difference to BM_Deposit is
+// the cost of always-on counters and latency histograms
+static void BM_DepositNoMetrics(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<uint64_t> ids = f.workload.picks(PICKS);
+    Metrics::setEnabled(false);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.bank.deposit(ids[i++ % PICKS], Money::fromCents(100)));
+    }
+    Metrics::setEnabled(true);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DepositNoMetrics)->Apply(bankArgs);
+
+static void BM_LookupNoMetrics(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<uint64_t> ids = f.workload.picks(PICKS);
+    Metrics::setEnabled(false);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.bank.findAccount(ids[i++ % PICKS]));
+    }
+    Metrics::setEnabled(true);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LookupNoMetrics)->Apply(bankArgs);
+
+// Deposits with every operation reported to an audit sink writing to
+// /dev/null; the difference to BM_Deposit is the cost of notification
+static void BM_DepositNotified(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<uint64_t> ids = f.workload.picks(PICKS);
+    ofstream devNull("/dev/null");
+    {
+        LogSink sink(devNull);
+        f.bank.setNotificationSink(&sink);
+        size_t i = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(f.bank.deposit(ids[i++ % PICKS], Money::fromCents(100)));
+        }
+        f.bank.setNotificationSink(nullptr);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DepositNotified)->Apply(bankArgs);
+
+// Deposits each carrying a fresh request id; the difference to
+// BM_Deposit is the cost of the request dedup cache
+static void BM_DepositWithRequestId(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<uint64_t> ids = f.workload.picks(PICKS);
+    static uint64_t nextRequest = 1;
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.bank.deposit(ids[i++ % PICKS], Money::fromCents(100), nextRequest++));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DepositWithRequestId)->Apply(bankArgs);
+
+// Retries of one deposit: every call after the first is answered from
+// the request dedup cache
+static void BM_DepositRetry(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    uint64_t id = f.workload.accounts()[0];
+    f.bank.deposit(id, Money::fromCents(100), UINT64_MAX);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.bank.deposit(id, Money::fromCents(100), UINT64_MAX));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DepositRetry)->ArgNames({"accounts", "skew"})->Args({10000, 0});
+
+static void BM_Withdraw(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<uint64_t> ids = f.workload.picks(PICKS, 1);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.bank.withdraw(ids[i++ % PICKS], Money::fromCents(1)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Withdraw)->Apply(bankArgs);
+
+// Deposits published to the change feed; the difference to BM_Deposit is
+// the cost of publishing (and, on few cores, of the writer thread)
+static void BM_DepositChangeFeed(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<uint64_t> ids = f.workload.picks(PICKS, 1);
+    string path = tempPath("bank_benchmarks.cdc");
+    remove(path.c_str());
+    if (!f.bank.startChangeFeed(path)) {
+        state.SkipWithError("change feed could not be written");
+        return;
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.bank.deposit(ids[i++ % PICKS], Money::fromCents(1)));
+    }
+    f.bank.stopChangeFeed();
+    remove(path.c_str());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DepositChangeFeed)->Apply(bankArgs);
+
+// Withdrawals checked against four fraud and velocity rules (three
+// windows and an overdraft counter) that never trip; the difference to
+// BM_Withdraw is the cost of screening
+static void BM_WithdrawScreened(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<uint64_t> ids = f.workload.picks(PICKS, 1);
+    string error;
+    f.bank.setRiskRules("burst decline debit count/1m 1000000000\n"
+                        "hourly decline debit sum/1h 99999999999\n"
+                        "large flag withdraw amount 1000000\n"
+                        "cycling decline withdraw overdrafts/1d 3\n", error);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f.bank.withdraw(ids[i++ % PICKS], Money::fromCents(1)));
+    }
+    f.bank.setRiskRules("", error);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WithdrawScreened)->Apply(bankArgs);
+
+// Transfers from every thread against one bank; with skew the hot
+// accounts' locks become the bottleneck
+static void BM_Transfer(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<pair<uint64_t, uint64_t>> legs = f.workload.pairs(PICKS, state.thread_index());
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto& leg = legs[i++ % PICKS];
+        benchmark::DoNotOptimize(f.bank.transfer(leg.first, leg.second, Money::fromCents(1)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Transfer)
+    ->ArgNames({"accounts", "skew"})
+    ->ArgsProduct({{1000, 100000}, {0, 120}})
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// Transfers with a request id each, unique across threads
+static void BM_TransferWithRequestId(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<pair<uint64_t, uint64_t>> legs = f.workload.pairs(PICKS, state.thread_index());
+    static atomic<uint64_t> nextRequest(1);
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto& leg = legs[i++ % PICKS];
+        benchmark::DoNotOptimize(f.bank.transfer(leg.first, leg.second, Money::fromCents(1),
+                                                 nextRequest.fetch_add(1, memory_order_relaxed)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TransferWithRequestId)
+    ->ArgNames({"accounts", "skew"})
+    ->ArgsProduct({{1000, 100000}, {0, 120}})
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// Payroll runs: one debit fanned out to range(0) credits, all or nothing
+namespace {
+
+struct PayrollFixture {
+    Bank home;
+    Bank other;
+    uint64_t payer;
+    vector<TransferLeg> legs;
+
+    // Credits alternate between the payer's bank and the other one when
+    // split; otherwise they all stay with the payer
+    PayrollFixture(size_t staff, bool split) : home("Benchmark Bank"), other("Benchmark Bank") {
+        home.setNodeId(1);
+        other.setNodeId(2);
+        payer = home.createCheckingAccount("Payer", OPENING);
+        for (size_t i = 0; i < staff; ++i) {
+            Bank& bank = split && i % 2 == 1 ? other : home;
+            legs.push_back(TransferLeg{payer, bank.createSavingsAccount("Staff"), Money::fromCents(1)});
+        }
+    }
+};
+
+} // namespace
+
+// All accounts in one bank: the legs are applied in a single step
+static void BM_PayrollOneBank(benchmark::State& state) {
+    PayrollFixture f(state.range(0), false);
+    for (auto _ : state) {
+        if (f.home.transferLegs(f.legs) != TxnStatus::OK) {
+            state.SkipWithError("payroll refused");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * f.legs.size());
+}
+BENCHMARK(BM_PayrollOneBank)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+// Credits split over two banks in this process, through two-phase commit
+static void BM_PayrollTwoShards(benchmark::State& state) {
+    PayrollFixture f(state.range(0), true);
+    LocalShard home(f.home), other(f.other);
+    TransferCoordinator coordinator;
+    coordinator.addShard(1, &home);
+    coordinator.addShard(2, &other);
+    for (auto _ : state) {
+        if (coordinator.execute(f.legs) != TxnStatus::OK) {
+            state.SkipWithError("payroll refused");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * f.legs.size());
+}
+BENCHMARK(BM_PayrollTwoShards)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+// As BM_PayrollTwoShards, with the second bank behind a loopback socket
+static void BM_PayrollLoopback(benchmark::State& state) {
+    PayrollFixture f(state.range(0), true);
+    ShardServer server(f.other);
+    if (!server.start(0)) {
+        state.SkipWithError("shard server could not listen");
+        return;
+    }
+    LocalShard home(f.home);
+    RemoteShard other("127.0.0.1", server.port());
+    TransferCoordinator coordinator;
+    coordinator.addShard(1, &home);
+    coordinator.addShard(2, &other);
+    for (auto _ : state) {
+        if (coordinator.execute(f.legs) != TxnStatus::OK) {
+            state.SkipWithError("payroll refused");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * f.legs.size());
+}
+BENCHMARK(BM_PayrollLoopback)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+// Deposits through a BankServer on a loopback socket, `depth` requests
+// sent together per round trip. Timed in real time, since the work is
+// done on the server thread
+static void BM_ServiceDeposit(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    vector<uint64_t> ids = f.workload.picks(PICKS);
+    size_t depth = state.range(2);
+    BankServer server(f.bank);
+    BankClient client;
+    if (!server.start(0) || !client.connect("127.0.0.1", server.port())) {
+        state.SkipWithError("service not reachable");
+        return;
+    }
+    TxnStatus status;
+    BinaryReader body(nullptr, 0);
+    size_t i = 0;
+    for (auto _ : state) {
+        for (size_t n = 0; n < depth; ++n) {
+            client.deposit(ids[i++ % PICKS], Money::fromCents(100));
+        }
+        bool ok = client.send();
+        for (size_t n = 0; n < depth && ok; ++n) {
+            ok = client.receive(status, body);
+        }
+        if (!ok) {
+            state.SkipWithError("connection lost");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * depth);
+}
+BENCHMARK(BM_ServiceDeposit)
+    ->ArgNames({"accounts", "skew", "depth"})
+    ->Args({10000, 0, 1})
+    ->Args({10000, 0, 64})
+    ->UseRealTime();
+
+static void BM_AccrueInterest(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    size_t credited = 0;
+    for (auto _ : state) {
+        credited += f.bank.accrueInterestAll().accountsCredited;
+    }
+    state.SetItemsProcessed(credited);
+}
+BENCHMARK(BM_AccrueInterest)
+    ->ArgNames({"accounts", "skew"})
+    ->Args({10000, 0})
+    ->Args({100000, 0})
+    ->Unit(benchmark::kMillisecond);
+
+// One checking account with a long history: three deposits for every
+// outgoing transfer
+namespace {
+
+struct HistoryFixture {
+    Bank bank;
+    const TransactionHistory* history;
+    int64_t first;
+    int64_t last;
+
+    explicit HistoryFixture(size_t count) : bank("Benchmark Bank") {
+        uint64_t a = bank.createCheckingAccount("Holder A", OPENING);
+        uint64_t b = bank.createCheckingAccount("Holder B");
+        for (size_t i = 0; i < count; ++i) {
+            if (i % 4 == 3) {
+                bank.transfer(a, b, Money::fromCents(1));
+            } else {
+                bank.deposit(a, Money::fromCents(1 + i % 100));
+            }
+        }
+        history = &bank.findAccount(a)->getHistory();
+        vector<Transaction> ends = history->last(1);
+        last = ends.back().getTimestamp();
+        first = last;
+        history->forEachChunk([this](const Transaction* records, size_t n) {
+            if (n > 0) first = min(first, records[0].getTimestamp());
+        });
+    }
+};
+
+HistoryFixture& historyFixture() {
+    static HistoryFixture f(1000000);
+    return f;
+}
+
+} // namespace
+
+static void BM_HistoryLast(benchmark::State& state) {
+    HistoryFixture& f = historyFixture();
+    size_t n = state.range(0);
+    size_t found = 0;
+    for (auto _ : state) {
+        found += f.history->last(n).size();
+    }
+    state.SetItemsProcessed(found);
+}
+BENCHMARK(BM_HistoryLast)->Arg(10)->Arg(100)->Arg(10000);
+
+static void BM_HistoryLastTransfers(benchmark::State& state) {
+    HistoryFixture& f = historyFixture();
+    uint8_t outgoing = TransactionHistory::typeBit(TxnType::TRANSFER_OUT);
+    size_t found = 0;
+    for (auto _ : state) {
+        found += f.history->last(state.range(0), outgoing).size();
+    }
+    state.SetItemsProcessed(found);
+}
+BENCHMARK(BM_HistoryLastTransfers)->Arg(50);
+
+// A window of range/1000 of the whole history, starting at its middle
+static void BM_HistoryBetween(benchmark::State& state) {
+    HistoryFixture& f = historyFixture();
+    int64_t span = (f.last - f.first) / 1000 * state.range(0);
+    int64_t from = f.first + (f.last - f.first) / 2;
+    size_t found = 0;
+    for (auto _ : state) {
+        found += f.history->between(from, from + span).size();
+    }
+    state.SetItemsProcessed(found);
+}
+BENCHMARK(BM_HistoryBetween)->Arg(1)->Arg(10)->Arg(100);
+
+static void BM_SaveSnapshot(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    string path = tempPath("bank_benchmarks.snapshot");
+    for (auto _ : state) {
+        if (!f.bank.saveToFile(path)) {
+            state.SkipWithError("snapshot could not be written");
+            break;
+        }
+    }
+    remove(path.c_str());
+    state.SetItemsProcessed(state.iterations() * f.accounts);
+}
+BENCHMARK(BM_SaveSnapshot)
+    ->ArgNames({"accounts", "skew"})
+    ->Args({10000, 0})
+    ->Args({100000, 0})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_LoadSnapshot(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    string path = tempPath("bank_benchmarks.snapshot");
+    if (!f.bank.saveToFile(path)) {
+        state.SkipWithError("snapshot could not be written");
+        return;
+    }
+    Bank loaded("Benchmark Bank");
+    uint64_t journalSeq = 0;
+    string error;
+    for (auto _ : state) {
+        if (!loaded.loadFromFile(path, journalSeq, error)) {
+            state.SkipWithError(error.c_str());
+            break;
+        }
+    }
+    remove(path.c_str());
+    state.SetItemsProcessed(state.iterations() * f.accounts);
+}
+BENCHMARK(BM_LoadSnapshot)
+    ->ArgNames({"accounts", "skew"})
+    ->Args({10000, 0})
+    ->Args({100000, 0})
+    ->Unit(benchmark::kMillisecond);
+
+// Whole-ledger export with range(0) workers; items are exported rows
+static void BM_ExportLedger(benchmark::State& state) {
+    Fixture& f = fixture(state);
+    string path = tempPath("bank_benchmarks.ledger");
+    uint64_t rows = 0;
+    for (auto _ : state) {
+        LedgerExportSummary summary;
+        if (!f.bank.exportLedger(path, state.range(2), summary)) {
+            state.SkipWithError("ledger could not be written");
+            break;
+        }
+        rows += summary.rows;
+    }
+    remove(path.c_str());
+    state.SetItemsProcessed(rows);
+}
+BENCHMARK(BM_ExportLedger)
+    ->ArgNames({"accounts", "skew", "threads"})
+    ->Args({100000, 0, 1})
+    ->Args({100000, 0, 4})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// A generated trace of range(0) operations replayed back to back on a fresh
+// bank by range(2) workers; items are replayed operations
+static void BM_ReplayTrace(benchmark::State& state) {
+    TraceShape shape;
+    shape.operations = state.range(0);
+    shape.skew = state.range(1) / 100.0;
+    vector<TraceRecord> trace = generateTrace(shape);
+    ReplayOptions options;
+    options.pace = ReplayPace::MAX;
+    options.threads = state.range(2);
+    for (auto _ : state) {
+        state.PauseTiming();
+        Bank bank("Replay Bank");
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(replayTrace(bank, trace, options).total);
+    }
+    state.SetItemsProcessed(state.iterations() * trace.size());
+}
+BENCHMARK(BM_ReplayTrace)
+    ->ArgNames({"operations", "skew", "threads"})
+    ->Args({100000, 99, 1})
+    ->Args({100000, 99, 4})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,72 @@
+#ifndef BANKING_WORKLOAD_H
+#define BANKING_WORKLOAD_H
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "Bank.h"
+#include "Zipf.h"
+
+using namespace std;
+
+// Synthetic workload class
+// Opens a bank of a given size and draws accounts from it with Zipf
+// popularity: the account of rank k is picked with weight 1 / k^skew.
+// skew 0 is uniform; around 1 a handful of hot accounts take most of the
+// traffic. Ranks are shuffled over the ids so hot accounts land on
+// arbitrary shards rather than the oldest ones.
+class Workload {
+private:
+    vector<uint64_t> ids;
+    ZipfDistribution ranks;
+    double skew;
+    uint64_t seed;
+
+public:
+    Workload(double skew, uint64_t seed = 42) : skew(skew), seed(seed) {}
+
+    // Opens count accounts in bank, alternating savings and checking
+    void populate(Bank& bank, size_t count, Money opening) {
+        ids.clear();
+        ids.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            string holder = "Holder " + to_string(i);
+            ids.push_back(i % 2 == 0 ? bank.createSavingsAccount(holder, opening)
+                                     : bank.createCheckingAccount(holder, opening));
+        }
+        mt19937_64 rng(seed);
+        shuffle(ids.begin(), ids.end(), rng);
+        ranks = ZipfDistribution(count, skew);
+    }
+
+    const vector<uint64_t>& accounts() const { return ids; }
+
+    uint64_t pick(mt19937_64& rng) const {
+        return ids[ranks(rng)];
+    }
+
+    // n picks drawn up front, so timed loops do not pay for sampling
+    vector<uint64_t> picks(size_t n, uint64_t stream = 0) const {
+        mt19937_64 rng(seed + 1 + stream);
+        vector<uint64_t> out(n);
+        for (auto& id : out) id = pick(rng);
+        return out;
+    }
+
+    // n (from, to) pairs with from != to
+    vector<pair<uint64_t, uint64_t>> pairs(size_t n, uint64_t stream = 0) const {
+        mt19937_64 rng(seed + 1 + stream);
+        vector<pair<uint64_t, uint64_t>> out(n);
+        for (auto& p : out) {
+            p.first = pick(rng);
+            do {
+                p.second = pick(rng);
+            } while (p.second == p.first && ids.size() > 1);
+        }
+        return out;
+    }
+};
+
+#endif
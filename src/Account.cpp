@@ -0,0 +1,54 @@
+#include "Account.h"
+
+const char* accountKindName(AccountKind kind) {
+    return kind == AccountKind::SAVINGS ? "SAVINGS" : "CHECKING";
+}
+
+TxnStatus Account::withdraw(Money amt) {
+    return withdraw(amt, IdGenerator::next(), DateTime::nowNanos());
+}
+
+TxnStatus Account::withdraw(Money amt, uint64_t txnId, int64_t timestamp) {
+    return visit([=](auto& acc) { return acc.withdraw(amt, txnId, timestamp); });
+}
+
+int64_t Account::getTypeParameter() const {
+    return visit([](const auto& acc) { return acc.getTypeParameter(); });
+}
+
+SavingsAccount* asSavings(Account* acc) {
+    return acc->getKind() == AccountKind::SAVINGS ? static_cast<SavingsAccount*>(acc) : nullptr;
+}
+
+// Builds an account from its index record in the pool for its type.
+// Balance, loans and metadata are copied out; the transaction history
+// stays in the mapping.
+Account* Account::fromRecord(const AccountRecord& rec, const SnapshotHeader& header,
+                             const shared_ptr<MappedFile>& file,
+                             SlabPool<SavingsAccount>& savingsPool, SlabPool<CheckingAccount>& checkingPool) {
+    string name(file->data() + header.stringOffset + rec.nameOffset, rec.nameLength);
+    string_view type = fieldView(rec.accountType);
+    Account* acc;
+    if (rec.accountId == 0) {
+        return nullptr;
+    } else if (type == "SAVINGS") {
+        acc = savingsPool.create(rec.accountId, name, rec.typeParameter);
+    } else if (type == "CHECKING") {
+        acc = checkingPool.create(rec.accountId, name, Money::fromCents(rec.typeParameter));
+    } else {
+        return nullptr;
+    }
+    acc->balance = Money::fromCents(rec.balance);
+    acc->createdAt = rec.createdAt;
+    acc->isActive = rec.isActive != 0;
+
+    acc->history.attach(file, reinterpret_cast<const Transaction*>(file->data() + header.txnOffset) + rec.firstTxn,
+                        rec.txnCount);
+
+    const LoanRecord* loanRecs = reinterpret_cast<const LoanRecord*>(file->data() + header.loanOffset);
+    acc->loans.reserve(rec.loanCount);
+    for (uint64_t i = 0; i < rec.loanCount; ++i) {
+        acc->loans.push_back(Loan::fromRecord(loanRecs[rec.firstLoan + i]));
+    }
+    return acc;
+}
@@ -0,0 +1,573 @@
+#ifndef BANKING_ACCOUNT_H
+#define BANKING_ACCOUNT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ChangeFeed.h"
+#include "Transaction.h"
+
+using namespace std;
+
+// One monthly loan payment, split into interest and principal
+struct Installment {
+    int number;                 // 1-based
+    int64_t dueAt;              // nanoseconds since the epoch
+    Money payment;
+    Money interest;
+    Money principal;
+    Money remaining;            // principal still owed afterwards
+};
+
+// Loan class. Repaid in equal monthly installments, the first due one
+// month after the loan starts. Each installment first pays the month's
+// interest on the remaining principal (rounded like interest credits) and
+// the rest reduces the principal; the last one clears whatever is left.
+class Loan {
+private:
+    uint64_t loanId;
+    Money principal;
+    int64_t interestRate;       // annual, parts per million
+    int termMonths;
+    Money monthlyPayment;
+    Money remainingBalance;
+    int64_t startedAt;          // nanoseconds since the epoch
+    int paymentsMade;
+    bool isActive;
+
+    Loan() : loanId(0), interestRate(0), termMonths(0), startedAt(0), paymentsMade(0), isActive(false) {}
+
+    // One month's interest on the given principal
+    Money monthInterest(Money balance) const {
+        return balance.mulDiv(interestRate, RATE_SCALE * 12, INTEREST_ROUNDING);
+    }
+
+    // The installment that follows `paid` payments with `balance` still owed
+    Installment installmentAfter(int paid, Money balance) const {
+        Installment due;
+        due.number = paid + 1;
+        due.dueAt = DateTime::addMonths(startedAt, paid + 1);
+        due.interest = monthInterest(balance);
+        Money payoff = balance + due.interest;
+        due.payment = (due.number >= termMonths || payoff < monthlyPayment) ? payoff : monthlyPayment;
+        due.principal = due.payment - due.interest;
+        due.remaining = balance - due.principal;
+        return due;
+    }
+
+public:
+    // The id and start time are passed in, so a replayed loan gets the
+    // ones it was first given
+    Loan(Money amt, int64_t rate, int months, uint64_t id, int64_t started)
+        : loanId(id), principal(amt), interestRate(rate), termMonths(months),
+          remainingBalance(amt), startedAt(started), paymentsMade(0), isActive(true) {
+        calculateMonthlyPayment();
+    }
+
+    // Level annuity payment. The growth factor (1 + r)^n is computed once
+    // here; schedules and payments only use the stored result.
+    void calculateMonthlyPayment() {
+        if (interestRate == 0) {
+            monthlyPayment = principal.mulDiv(1, termMonths, PAYMENT_ROUNDING);
+            return;
+        }
+        long double monthlyRate = static_cast<long double>(interestRate) / RATE_SCALE / 12;
+        long double growth = powl(1 + monthlyRate, termMonths);
+        monthlyPayment = Money::roundCents(principal.getCents() * monthlyRate * growth / (growth - 1),
+                                           PAYMENT_ROUNDING);
+    }
+
+    // The next installment; only meaningful while the loan is active
+    Installment nextInstallment() const {
+        return installmentAfter(paymentsMade, remainingBalance);
+    }
+
+    // Remaining principal plus this month's interest
+    Money payoffAmount() const {
+        return remainingBalance + monthInterest(remainingBalance);
+    }
+
+    // Every installment still to come, assuming each is paid when due
+    vector<Installment> schedule() const {
+        vector<Installment> out;
+        if (!isActive) return out;
+        out.reserve(max(termMonths - paymentsMade, 1));
+        Money balance = remainingBalance;
+        for (int paid = paymentsMade; balance > Money(); ++paid) {
+            out.push_back(installmentAfter(paid, balance));
+            balance = out.back().remaining;
+        }
+        return out;
+    }
+
+    // Pays the next installment. Anything above the installment prepays
+    // principal; the amount must not exceed payoffAmount().
+    bool makePayment(Money amount) {
+        if (!isActive) return false;
+        Installment due = nextInstallment();
+        if (amount < due.payment || amount > remainingBalance + due.interest) return false;
+        
+        remainingBalance -= amount - due.interest;
+        ++paymentsMade;
+        if (remainingBalance <= Money()) {
+            remainingBalance = Money();
+            isActive = false;
+        }
+        return true;
+    }
+
+    void toRecord(LoanRecord& rec) const {
+        rec.loanId = loanId;
+        rec.principal = principal.getCents();
+        rec.interestRate = interestRate;
+        rec.monthlyPayment = monthlyPayment.getCents();
+        rec.remainingBalance = remainingBalance.getCents();
+        rec.termMonths = termMonths;
+        rec.isActive = isActive ? 1 : 0;
+        rec.startedAt = startedAt;
+        rec.paymentsMade = paymentsMade;
+    }
+
+    static Loan fromRecord(const LoanRecord& rec) {
+        Loan loan;
+        loan.loanId = rec.loanId;
+        loan.principal = Money::fromCents(rec.principal);
+        loan.interestRate = rec.interestRate;
+        loan.termMonths = rec.termMonths;
+        loan.monthlyPayment = Money::fromCents(rec.monthlyPayment);
+        loan.remainingBalance = Money::fromCents(rec.remainingBalance);
+        loan.startedAt = rec.startedAt;
+        loan.paymentsMade = rec.paymentsMade;
+        loan.isActive = rec.isActive != 0;
+        return loan;
+    }
+
+    uint64_t getLoanId() const { return loanId; }
+    Money getPrincipal() const { return principal; }
+    int64_t getInterestRate() const { return interestRate; }
+    int getTermMonths() const { return termMonths; }
+    int64_t getStartedAt() const { return startedAt; }
+    int getPaymentsMade() const { return paymentsMade; }
+    Money getRemainingBalance() const { return remainingBalance; }
+    bool getIsActive() const { return isActive; }
+    Money getMonthlyPayment() const { return monthlyPayment; }
+};
+
+enum class AccountKind : uint8_t {
+    SAVINGS,
+    CHECKING
+};
+
+const size_t ACCOUNT_KIND_COUNT = 2;
+
+const char* accountKindName(AccountKind kind);
+
+// Allocates objects of one type from large slabs. Objects are built in
+// place one after another and are never moved or freed one at a time, so
+// a scan over the pool walks memory in order and pointers stay valid until
+// the pool is cleared or swapped out.
+template <typename T>
+class SlabPool {
+private:
+    static const size_t SLAB_OBJECTS = 4096;
+
+    struct Slab {
+        alignas(T) unsigned char storage[SLAB_OBJECTS * sizeof(T)];
+
+        T* at(size_t i) { return reinterpret_cast<T*>(storage) + i; }
+    };
+
+    vector<unique_ptr<Slab>> slabs;
+    size_t count;
+    mutable mutex mtx;
+
+    void destroyAll() {
+        for (size_t i = 0; i < count; ++i) {
+            slabs[i / SLAB_OBJECTS]->at(i % SLAB_OBJECTS)->~T();
+        }
+        slabs.clear();
+        count = 0;
+    }
+
+public:
+    SlabPool() : count(0) {}
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+    ~SlabPool() { destroyAll(); }
+
+    template <typename... Args>
+    T* create(Args&&... args) {
+        lock_guard<mutex> lock(mtx);
+        if (count == slabs.size() * SLAB_OBJECTS) {
+            slabs.emplace_back(new Slab);
+        }
+        T* obj = new (slabs.back()->at(count % SLAB_OBJECTS)) T(forward<Args>(args)...);
+        ++count;
+        return obj;
+    }
+
+    // Calls fn(T*) for every object, in creation order. Creation waits
+    // until the scan is done.
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        lock_guard<mutex> lock(mtx);
+        for (size_t i = 0; i < count; ++i) {
+            fn(slabs[i / SLAB_OBJECTS]->at(i % SLAB_OBJECTS));
+        }
+    }
+
+    size_t size() const {
+        lock_guard<mutex> lock(mtx);
+        return count;
+    }
+
+    void clear() {
+        lock_guard<mutex> lock(mtx);
+        destroyAll();
+    }
+
+    void swap(SlabPool& other) {
+        scoped_lock lock(mtx, other.mtx);
+        slabs.swap(other.slabs);
+        std::swap(count, other.count);
+    }
+};
+
+class SavingsAccount;
+class CheckingAccount;
+struct RiskCounters;
+
+// Base Account class. Accounts are not internally synchronized: callers
+// hold getMutex() around every call (Bank does this for all operations).
+class Account {
+protected:
+    uint64_t accountId;
+    string accountHolderName;
+    Money balance;
+    Money held;                 // set aside for prepared multi-leg transfers
+    AccountKind kind;
+    TransactionHistory history;
+    vector<Loan> loans;         // stored inline; the index is the loan's handle
+    int64_t createdAt;          // nanoseconds since the epoch
+    bool isActive;
+    atomic<bool> inTopBalances;     // owned by Bank's TopBalances tracker
+    atomic<int64_t> rankedBalance;  // the balance as last given to it
+    RiskCounters* riskCounters;     // owned by Bank's RiskEngine
+    ChangeFeed* changeFeed;         // Bank's, if it streams ledger events
+    mutable mutex mtx;
+
+    Account(uint64_t id, string name, AccountKind kind) 
+        : accountId(id), accountHolderName(name), kind(kind), createdAt(DateTime::nowNanos()),
+          isActive(true), inTopBalances(false), rankedBalance(0), riskCounters(nullptr), changeFeed(nullptr) {}
+
+    // Adds a transaction to the history and publishes it to the change feed
+    void addTransaction(const Transaction& t) {
+        const Transaction& added = history.append(t);
+        if (changeFeed) changeFeed->publish(accountId, added);
+    }
+
+    // Withdrawal that may take the balance down to -overdraft
+    TxnStatus withdrawWithin(Money amt, Money overdraft, TxnStatus shortfall, uint64_t txnId, int64_t timestamp) {
+        if (amt <= Money()) {
+            return TxnStatus::INVALID_AMOUNT;
+        }
+        if (balance - held + overdraft < amt) {
+            return shortfall;
+        }
+        balance -= amt;
+        addTransaction(Transaction(txnId, timestamp, TxnType::WITHDRAW, amt));
+        return TxnStatus::OK;
+    }
+
+public:
+    // Calls fn with this account as its concrete type, chosen by the kind
+    // tag. Code working on one type can call the concrete class directly
+    // and skip even this branch.
+    template <typename Fn>
+    decltype(auto) visit(Fn&& fn);
+    template <typename Fn>
+    decltype(auto) visit(Fn&& fn) const;
+
+    // Type-specific operations, forwarded through visit()
+    TxnStatus withdraw(Money amt);
+    TxnStatus withdraw(Money amt, uint64_t txnId, int64_t timestamp);
+    // Interest rate (ppm) or overdraft limit (cents), depending on the type
+    int64_t getTypeParameter() const;
+
+    TxnStatus deposit(Money amt) {
+        return deposit(amt, IdGenerator::next(), DateTime::nowNanos());
+    }
+
+    // Operations given a transaction id and timestamp record their
+    // transactions under them: Bank journals both, so replaying an
+    // operation recreates its records exactly
+    TxnStatus deposit(Money amt, uint64_t txnId, int64_t timestamp) {
+        if (amt <= Money()) {
+            return TxnStatus::INVALID_AMOUNT;
+        }
+        balance += amt;
+        addTransaction(Transaction(txnId, timestamp, TxnType::DEPOSIT, amt));
+        return TxnStatus::OK;
+    }
+
+    // The caller must hold the locks of both accounts. The two sides'
+    // records are outId and inId.
+    TxnStatus transfer(Account& toAccount, Money amt, uint64_t outId, uint64_t inId, int64_t timestamp) {
+        if (amt <= Money()) {
+            return TxnStatus::INVALID_AMOUNT;
+        }
+        if (getAvailableBalance() < amt) {
+            return TxnStatus::INSUFFICIENT_FUNDS;
+        }
+        
+        balance -= amt;
+        toAccount.balance += amt;
+        
+        addTransaction(Transaction(outId, timestamp, TxnType::TRANSFER_OUT, amt, toAccount.accountId));
+        toAccount.addTransaction(Transaction(inId, timestamp, TxnType::TRANSFER_IN, amt, accountId));
+        return TxnStatus::OK;
+    }
+
+    TxnStatus applyLoan(Money amount, int64_t interestRate, int termMonths) {
+        int64_t now = DateTime::nowNanos();
+        return applyLoan(amount, interestRate, termMonths, IdGenerator::next(), now, IdGenerator::next(), now);
+    }
+
+    TxnStatus applyLoan(Money amount, int64_t interestRate, int termMonths, uint64_t txnId, int64_t timestamp,
+                        uint64_t loanId, int64_t startedAt) {
+        if (amount <= Money() || interestRate < 0 || termMonths <= 0) {
+            return TxnStatus::INVALID_AMOUNT;
+        }
+        loans.emplace_back(amount, interestRate, termMonths, loanId, startedAt);
+        balance += amount;
+        addTransaction(Transaction(txnId, timestamp, TxnType::LOAN, amount));
+        return TxnStatus::OK;
+    }
+
+    TxnStatus payLoan(int loanIndex, Money amount, uint64_t txnId, int64_t timestamp) {
+        if (loanIndex < 0 || loanIndex >= static_cast<int>(loans.size())) {
+            return TxnStatus::INVALID_LOAN_INDEX;
+        }
+        
+        Loan& loan = loans[loanIndex];
+        if (!loan.getIsActive()) {
+            return TxnStatus::LOAN_PAID_OFF;
+        }
+        
+        // Never take more than the loan still needs
+        Money payoff = loan.payoffAmount();
+        if (amount > payoff) {
+            amount = payoff;
+        }
+        if (getAvailableBalance() < amount) {
+            return TxnStatus::INSUFFICIENT_FUNDS;
+        }
+        
+        if (!loan.makePayment(amount)) {
+            return TxnStatus::PAYMENT_TOO_SMALL;
+        }
+        balance -= amount;
+        addTransaction(Transaction(txnId, timestamp, TxnType::LOAN_PAYMENT, amount));
+        return TxnStatus::OK;
+    }
+
+    // Multi-leg transfers. A prepared debit is held: it stays in the
+    // balance but nothing else can spend it until the transfer commits
+    // (payOut) or aborts (release). Like transfer, holds never draw on an
+    // overdraft. Records carry the caller's id and timestamp, so a whole
+    // transfer is stamped alike.
+    TxnStatus hold(Money amt) {
+        if (getAvailableBalance() < amt) {
+            return TxnStatus::INSUFFICIENT_FUNDS;
+        }
+        held += amt;
+        return TxnStatus::OK;
+    }
+
+    void release(Money amt) {
+        held -= amt;
+    }
+
+    void payOut(Money amt, uint64_t toAccount, uint64_t txnId, int64_t timestamp) {
+        held -= amt;
+        balance -= amt;
+        addTransaction(Transaction(txnId, timestamp, TxnType::TRANSFER_OUT, amt, toAccount));
+    }
+
+    void receive(Money amt, uint64_t fromAccount, uint64_t txnId, int64_t timestamp) {
+        balance += amt;
+        addTransaction(Transaction(txnId, timestamp, TxnType::TRANSFER_IN, amt, fromAccount));
+    }
+
+    // Pays the loan's next installment if it falls due by asOf. Used by the
+    // end-of-day run, which stamps all of its records with one timestamp.
+    TxnStatus payDueInstallment(size_t loanIndex, int64_t asOf, uint64_t txnId, int64_t timestamp,
+                                Installment& due) {
+        Loan& loan = loans[loanIndex];
+        if (!loan.getIsActive()) {
+            return TxnStatus::LOAN_PAID_OFF;
+        }
+        due = loan.nextInstallment();
+        if (due.dueAt > asOf) {
+            return TxnStatus::INSTALLMENT_NOT_DUE;
+        }
+        if (getAvailableBalance() < due.payment) {
+            return TxnStatus::INSUFFICIENT_FUNDS;
+        }
+        loan.makePayment(due.payment);
+        balance -= due.payment;
+        addTransaction(Transaction(txnId, timestamp, TxnType::LOAN_PAYMENT, due.payment));
+        return TxnStatus::OK;
+    }
+
+    // Fills the index record and appends this account's history and loans
+    // to their sections, starting at the given record positions. Fails only
+    // if spilled history cannot be read back.
+    bool toRecord(AccountRecord& rec, uint64_t firstTxn, uint64_t firstLoan,
+                  SnapshotSection& txnOut, SnapshotSection& loanOut,
+                  SnapshotSection& strings) const {
+        rec.accountId = accountId;
+        setField(rec.accountType, string(accountKindName(kind)));
+        rec.isActive = isActive ? 1 : 0;
+        rec.balance = balance.getCents();
+        rec.typeParameter = getTypeParameter();
+        rec.createdAt = createdAt;
+        rec.nameOffset = strings.append(accountHolderName.data(), accountHolderName.size());
+        rec.nameLength = accountHolderName.size();
+        rec.firstTxn = firstTxn;
+        rec.txnCount = getTransactionCount();
+        rec.firstLoan = firstLoan;
+        rec.loanCount = loans.size();
+
+        bool ok = history.forEachChunk([&txnOut](const Transaction* records, size_t count) {
+            txnOut.append(records, count * sizeof(Transaction));
+        });
+        for (const auto& loan : loans) {
+            LoanRecord out = {};
+            loan.toRecord(out);
+            loanOut.append(&out, sizeof(out));
+        }
+        return ok;
+    }
+
+    static Account* fromRecord(const AccountRecord& rec, const SnapshotHeader& header,
+                               const shared_ptr<MappedFile>& file,
+                               SlabPool<SavingsAccount>& savingsPool, SlabPool<CheckingAccount>& checkingPool);
+
+    size_t getTransactionCount() const { return history.size(); }
+    TransactionHistory& getHistory() { return history; }
+    const TransactionHistory& getHistory() const { return history; }
+    size_t getLoanCount() const { return loans.size(); }
+    const Loan& getLoan(size_t index) const { return loans[index]; }
+
+    string getAccountNumber() const { return formatAccountNumber(accountId); }
+    const string& getAccountHolder() const { return accountHolderName; }
+    string getAccountType() const { return accountKindName(kind); }
+    AccountKind getKind() const { return kind; }
+    int64_t getCreatedAt() const { return createdAt; }
+    // For an account recreated by journal replay
+    void setCreatedAt(int64_t at) { createdAt = at; }
+
+    Money getOutstandingLoans() const {
+        Money total;
+        for (const auto& loan : loans) {
+            total += loan.getRemainingBalance();
+        }
+        return total;
+    }
+
+    atomic<bool>& topBalancesFlag() { return inTopBalances; }
+    atomic<int64_t>& rankedBalanceSlot() { return rankedBalance; }
+    RiskCounters*& riskCountersSlot() { return riskCounters; }
+    void setChangeFeed(ChangeFeed* feed) { changeFeed = feed; }
+    Money getBalance() const { return balance; }
+    Money getHeld() const { return held; }
+    Money getAvailableBalance() const { return balance - held; }
+    bool getIsActive() const { return isActive; }
+    void deactivate() { isActive = false; }
+    mutex& getMutex() const { return mtx; }
+    // Accounts are always locked in ascending id order, which rules out
+    // deadlock between operations that lock several accounts
+    uint64_t getAccountId() const { return accountId; }
+};
+
+// Account types. Neither has virtual functions: Account forwards to them
+// by its kind tag, and bulk code holding one type calls them directly.
+
+// Savings Account with interest
+class SavingsAccount : public Account {
+private:
+    int64_t interestRate;       // parts per million
+
+public:
+    SavingsAccount(uint64_t id, string name, int64_t rate = 35000) 
+        : Account(id, name, AccountKind::SAVINGS), interestRate(rate) {}
+
+    TxnStatus withdraw(Money amt) {
+        return withdraw(amt, IdGenerator::next(), DateTime::nowNanos());
+    }
+
+    TxnStatus withdraw(Money amt, uint64_t txnId, int64_t timestamp) {
+        return withdrawWithin(amt, Money(), TxnStatus::INSUFFICIENT_FUNDS, txnId, timestamp);
+    }
+
+    Money applyInterest(uint64_t txnId, int64_t timestamp) {
+        Money interest = balance.mulDiv(interestRate, RATE_SCALE, INTEREST_ROUNDING);
+        balance += interest;
+        addTransaction(Transaction(txnId, timestamp, TxnType::INTEREST, interest));
+        return interest;
+    }
+
+    // Credits interest computed by a bulk accrual run
+    void creditInterest(Money interest, uint64_t txnId, int64_t timestamp) {
+        balance += interest;
+        addTransaction(Transaction(txnId, timestamp, TxnType::INTEREST, interest));
+    }
+
+    int64_t getInterestRate() const { return interestRate; }
+    int64_t getTypeParameter() const { return interestRate; }
+};
+
+// Checking Account with overdraft
+class CheckingAccount : public Account {
+private:
+    Money overdraftLimit;
+
+public:
+    CheckingAccount(uint64_t id, string name, Money overdraft = Money::fromCents(50000)) 
+        : Account(id, name, AccountKind::CHECKING), overdraftLimit(overdraft) {}
+
+    TxnStatus withdraw(Money amt) {
+        return withdraw(amt, IdGenerator::next(), DateTime::nowNanos());
+    }
+
+    TxnStatus withdraw(Money amt, uint64_t txnId, int64_t timestamp) {
+        return withdrawWithin(amt, overdraftLimit, TxnStatus::OVERDRAFT_EXCEEDED, txnId, timestamp);
+    }
+
+    Money getOverdraftLimit() const { return overdraftLimit; }
+    int64_t getTypeParameter() const { return overdraftLimit.getCents(); }
+};
+
+template <typename Fn>
+decltype(auto) Account::visit(Fn&& fn) {
+    if (kind == AccountKind::SAVINGS) {
+        return fn(static_cast<SavingsAccount&>(*this));
+    }
+    return fn(static_cast<CheckingAccount&>(*this));
+}
+
+template <typename Fn>
+decltype(auto) Account::visit(Fn&& fn) const {
+    if (kind == AccountKind::SAVINGS) {
+        return fn(static_cast<const SavingsAccount&>(*this));
+    }
+    return fn(static_cast<const CheckingAccount&>(*this));
+}
+
+// Tag-checked downcast; null for checking accounts
+SavingsAccount* asSavings(Account* acc);
+
+#endif
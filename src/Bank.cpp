@@ -0,0 +1,7 @@
+#include "Bank.h"
+
+size_t threadStripe() {
+    static atomic<size_t> nextThread(0);
+    thread_local size_t index = nextThread++;
+    return index;
+}
@@ -0,0 +1,2280 @@
+#ifndef BANKING_BANK_H
+#define BANKING_BANK_H
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Account.h"
+#include "InterestKernel.h"
+#include "Journal.h"
+#include "LedgerExport.h"
+#include "LogSink.h"
+#include "Metrics.h"
+#include "NameIndex.h"
+#include "RequestCache.h"
+#include "RiskEngine.h"
+#include "Trace.h"
+
+using namespace std;
+
+// Result of a bulk interest run
+struct InterestRunSummary {
+    size_t accountsCredited = 0;
+    Money totalInterest;
+    bool durable = true;            // false if the journal failed before the run was on disk
+};
+
+// Result of an end-of-day installment run
+struct InstallmentRunSummary {
+    size_t installmentsPaid = 0;
+    size_t installmentsMissed = 0;      // due but not covered by the balance
+    Money totalCollected;
+    Money interestCollected;
+    bool durable = true;            // false if the journal failed before the run was on disk
+};
+
+// Result of Bank::recover
+struct RecoveryReport {
+    bool snapshotLoaded = false;    // false if there was no snapshot to load
+    size_t replayed = 0;            // journal records applied after the snapshot
+    bool journalTrimmed = true;     // false if a torn journal tail could not be cut off
+    bool journalOpen = true;        // false if new changes will not be persisted
+    // Why the saved state could not be restored; empty on success. The
+    // bank is then left empty and refuses to checkpoint over the files.
+    string error;
+};
+
+// Result of Bank::exportLedger
+struct LedgerExportSummary {
+    size_t accounts = 0;
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+};
+
+// One row of Bank::listAccounts and Bank::findAccountsByHolder
+struct AccountRow {
+    uint64_t id;
+    string holder;
+    AccountKind kind;
+    Money balance;
+};
+
+// Operation kinds accepted by Bank::applyBatch
+enum class BatchOpType : uint8_t {
+    DEPOSIT,
+    WITHDRAW,
+    TRANSFER,
+    PAY_LOAN
+};
+
+struct BatchOp {
+    BatchOpType type;
+    uint64_t account;
+    uint64_t toAccount;     // TRANSFER only
+    Money amount;
+    int loanIndex;          // PAY_LOAN only, zero-based
+};
+
+// One movement of money in a multi-leg transfer
+struct TransferLeg {
+    uint64_t from;
+    uint64_t to;
+    Money amount;
+};
+
+// [u32 count] then per leg [u64 from][u64 to][i64 cents], as journaled
+// and as sent to remote shards
+inline void writeLegs(BinaryWriter& out, const vector<TransferLeg>& legs) {
+    out.u32(static_cast<uint32_t>(legs.size()));
+    for (const TransferLeg& leg : legs) {
+        out.u64(leg.from);
+        out.u64(leg.to);
+        out.money(leg.amount);
+    }
+}
+
+inline vector<TransferLeg> readLegs(BinaryReader& in) {
+    uint32_t count = in.u32();
+    vector<TransferLeg> legs;
+    legs.reserve(min<size_t>(count, in.remaining() / 24));
+    for (uint32_t i = 0; i < count && in.good(); ++i) {
+        TransferLeg leg;
+        leg.from = in.u64();
+        leg.to = in.u64();
+        leg.amount = in.money();
+        legs.push_back(leg);
+    }
+    return legs;
+}
+
+// Open-addressing hash table from account id to account, with linear
+// probing over one flat array of (id, pointer) slots. A lookup hashes the
+// id and usually finds it in the first cache line it touches; nothing is
+// allocated per entry. Id 0 marks an empty slot. Entries are never removed
+// one by one: accounts are deactivated, not deleted.
+class AccountIndex {
+private:
+    struct Entry {
+        uint64_t id;
+        Account* account;
+    };
+
+    vector<Entry> slots;
+    size_t count;
+    size_t mask;
+
+    static uint64_t mix(uint64_t id) {
+        id ^= id >> 31;
+        id *= 0x7FB5D329728EA185ULL;
+        id ^= id >> 27;
+        id *= 0x81DADEF4BC2DD44DULL;
+        return id ^ (id >> 33);
+    }
+
+    void grow() {
+        vector<Entry> old(slots.empty() ? 16 : slots.size() * 2, Entry{0, nullptr});
+        old.swap(slots);
+        mask = slots.size() - 1;
+        count = 0;
+        for (const Entry& e : old) {
+            if (e.id != 0) insert(e.id, e.account);
+        }
+    }
+
+public:
+    AccountIndex() : count(0), mask(0) {}
+
+    Account* find(uint64_t id) const {
+        if (slots.empty() || id == 0) return nullptr;
+        for (size_t i = mix(id) & mask;; i = (i + 1) & mask) {
+            const Entry& e = slots[i];
+            if (e.id == id) return e.account;
+            if (e.id == 0) return nullptr;
+        }
+    }
+
+    // Kept at most half full so probe sequences stay short. False, with
+    // the existing entry kept, if the id is already in the index.
+    bool insert(uint64_t id, Account* account) {
+        if ((count + 1) * 2 > slots.size()) grow();
+        for (size_t i = mix(id) & mask;; i = (i + 1) & mask) {
+            Entry& e = slots[i];
+            if (e.id == id) return false;
+            if (e.id == 0) {
+                e = Entry{id, account};
+                ++count;
+                return true;
+            }
+        }
+    }
+
+    void reserve(size_t n) {
+        while (n * 2 > slots.size()) grow();
+    }
+
+    size_t size() const { return count; }
+};
+
+// Small per-thread number used to spread threads over striped structures
+size_t threadStripe();
+
+// Reader/writer lock split into cache-line-sized stripes. Each thread
+// takes the shared side of its own stripe, so concurrent readers never
+// bounce a common counter between cores; the exclusive side locks all.
+class StripedSharedMutex {
+private:
+    static const size_t STRIPES = 64;
+
+    struct alignas(64) Stripe {
+        shared_mutex mtx;
+    };
+    Stripe stripes[STRIPES];
+
+public:
+    shared_mutex& local() { return stripes[threadStripe() % STRIPES].mtx; }
+
+    void lock() {
+        for (auto& stripe : stripes) stripe.mtx.lock();
+    }
+
+    void unlock() {
+        for (auto& stripe : stripes) stripe.mtx.unlock();
+    }
+};
+
+// Counter split into cache-line-sized cells. Each thread adds to its own
+// cell, so writers on different cores never contend; a read sums the
+// fixed number of cells.
+class StripedCounter {
+private:
+    static const size_t CELLS = 16;
+
+    struct alignas(64) Cell {
+        atomic<int64_t> value{0};
+    };
+    Cell cells[CELLS];
+
+public:
+    void add(int64_t delta) {
+        if (delta != 0) cells[threadStripe() % CELLS].value.fetch_add(delta, memory_order_relaxed);
+    }
+
+    int64_t read() const {
+        int64_t sum = 0;
+        for (const auto& cell : cells) sum += cell.value.load(memory_order_relaxed);
+        return sum;
+    }
+
+    void reset() {
+        for (auto& cell : cells) cell.value.store(0, memory_order_relaxed);
+    }
+};
+
+// Bank-wide figures at one moment
+struct BankTotals {
+    Money deposits[ACCOUNT_KIND_COUNT];     // sum of balances, per account kind
+    Money outstandingLoans;
+    size_t overdrawnChecking = 0;
+    size_t accounts = 0;
+};
+
+// The K largest balances, maintained as balances change. Accounts are
+// split by id over a few stripes, each with its own lock. A stripe tracks
+// a handful more than K of its accounts exactly and knows every untracked
+// one holds at most its `floor`; an update that leaves both the old and
+// new balance at or below the floor for an untracked account costs a few
+// atomic operations. A read merges the stripes' tracked sets. Once a
+// stripe's tracked accounts have fallen below its floor, the read rescans
+// that stripe alone from the balances each update leaves on its account,
+// without taking any account's lock; meanwhile only that stripe's tracked
+// updates wait.
+class TopBalances {
+public:
+    static const size_t K = 10;
+
+    struct Entry {
+        uint64_t id;
+        Money balance;
+    };
+
+private:
+    static const size_t STRIPES = 16;
+    static const size_t TRACKED = 32;
+
+    struct Tracked {
+        Account* account;
+        int64_t balance;
+    };
+
+    struct alignas(64) Stripe {
+        mutex mtx;
+        vector<Tracked> tracked;
+        vector<Account*> members;
+        atomic<int64_t> floor;
+        atomic<bool> rescanning;    // updates take the lock while set
+
+        Stripe() : floor(INT64_MIN), rescanning(false) {}
+    };
+
+    mutable Stripe stripes[STRIPES];
+
+    Stripe& stripeOf(const Account* acc) const {
+        return stripes[(acc->getAccountId() * 0x9E3779B97F4A7C15ull) >> 60];
+    }
+
+    static void track(Stripe& stripe, Account* acc, int64_t balance) {
+        for (auto& t : stripe.tracked) {
+            if (t.account == acc) {
+                t.balance = balance;
+                return;
+            }
+        }
+        if (balance <= stripe.floor.load(memory_order_relaxed)) return;
+        stripe.tracked.push_back(Tracked{acc, balance});
+        acc->topBalancesFlag() = true;
+        if (stripe.tracked.size() > TRACKED) {
+            auto lowest = min_element(stripe.tracked.begin(), stripe.tracked.end(),
+                [](const Tracked& a, const Tracked& b) { return a.balance < b.balance; });
+            stripe.floor = max(stripe.floor.load(), lowest->balance);
+            lowest->account->topBalancesFlag() = false;
+            *lowest = stripe.tracked.back();
+            stripe.tracked.pop_back();
+        }
+    }
+
+    static bool stale(const Stripe& stripe) {
+        int64_t cut = stripe.floor.load();
+        if (cut == INT64_MIN) return false;
+        if (stripe.tracked.size() < K) return true;
+        size_t above = 0;
+        for (const auto& t : stripe.tracked) above += t.balance >= cut;
+        return above < K;
+    }
+
+    // Restarts the stripe's tracking from its accounts' ranked balances.
+    // An update that skipped the lock stored its balance before seeing
+    // rescanning clear, so the scan reads it; the rest wait for the lock.
+    static void rescan(Stripe& stripe) {
+        stripe.rescanning = true;
+        for (auto& t : stripe.tracked) t.account->topBalancesFlag() = false;
+        vector<Tracked> all;
+        all.reserve(stripe.members.size());
+        for (Account* acc : stripe.members) all.push_back(Tracked{acc, acc->rankedBalanceSlot().load()});
+        auto byBalance = [](const Tracked& a, const Tracked& b) { return a.balance > b.balance; };
+        int64_t cut = INT64_MIN;
+        if (all.size() > TRACKED) {
+            // Everything after position TRACKED is at most the balance there
+            nth_element(all.begin(), all.begin() + TRACKED, all.end(), byBalance);
+            cut = all[TRACKED].balance;
+            all.resize(TRACKED);
+        }
+        for (auto& t : all) t.account->topBalancesFlag() = true;
+        stripe.tracked = move(all);
+        stripe.floor = cut;
+        stripe.rescanning = false;
+    }
+
+public:
+    // Starts ranking an account; before anyone can change its balance
+    void add(Account* acc) {
+        Stripe& stripe = stripeOf(acc);
+        int64_t balance = acc->getBalance().getCents();
+        acc->rankedBalanceSlot() = balance;
+        lock_guard<mutex> lock(stripe.mtx);
+        stripe.members.push_back(acc);
+        track(stripe, acc, balance);
+    }
+
+    // Called with the account's lock held after its balance changed
+    void update(Account* acc, int64_t balance) {
+        Stripe& stripe = stripeOf(acc);
+        acc->rankedBalanceSlot() = balance;
+        if (!stripe.rescanning.load() && balance <= stripe.floor.load(memory_order_relaxed) &&
+            !acc->topBalancesFlag().load()) {
+            return;
+        }
+        lock_guard<mutex> lock(stripe.mtx);
+        track(stripe, acc, balance);
+    }
+
+    // The top K, largest first
+    vector<Entry> read() const {
+        vector<Tracked> all;
+        for (Stripe& stripe : stripes) {
+            lock_guard<mutex> lock(stripe.mtx);
+            if (stale(stripe)) rescan(stripe);
+            all.insert(all.end(), stripe.tracked.begin(), stripe.tracked.end());
+        }
+        size_t n = min(K, all.size());
+        partial_sort(all.begin(), all.begin() + n, all.end(),
+                     [](const Tracked& a, const Tracked& b) { return a.balance > b.balance; });
+        vector<Entry> out;
+        for (size_t i = 0; i < n; ++i) {
+            out.push_back(Entry{all[i].account->getAccountId(), Money::fromCents(all[i].balance)});
+        }
+        return out;
+    }
+
+    // Forgets every account, e.g. before the accounts are replaced; no
+    // updates may run
+    void clear() {
+        for (Stripe& stripe : stripes) {
+            stripe.tracked.clear();
+            stripe.members.clear();
+            stripe.floor = INT64_MIN;
+        }
+    }
+};
+
+// The accounts a bulk run walks. Handed out in ascending id order, so a
+// run can lock them block by block in the same order transfers use.
+template <typename T>
+class AccountRegistry {
+private:
+    vector<T*> accounts;
+    bool sorted;
+    mutex mtx;
+
+public:
+    AccountRegistry() : sorted(true) {}
+
+    void add(T* acc) {
+        lock_guard<mutex> lock(mtx);
+        if (!accounts.empty() && accounts.back()->getAccountId() > acc->getAccountId()) {
+            sorted = false;
+        }
+        accounts.push_back(acc);
+    }
+
+    void clear() {
+        lock_guard<mutex> lock(mtx);
+        accounts.clear();
+        sorted = true;
+    }
+
+    vector<T*> snapshot() {
+        lock_guard<mutex> lock(mtx);
+        if (!sorted) {
+            sort(accounts.begin(), accounts.end(), [](const T* a, const T* b) {
+                return a->getAccountId() < b->getAccountId();
+            });
+            sorted = true;
+        }
+        return accounts;
+    }
+};
+
+// Bank class. Safe to use from many threads: the account index is split
+// into independently locked shards, each operation locks only the accounts
+// it touches, and transfers lock their two accounts in account-id order.
+// Accounts are addressed by integer id; findAccount returns a plain pointer
+// that stays valid until the accounts are replaced by loadFromFile.
+class Bank {
+private:
+    static const uint32_t SNAPSHOT_MAGIC = 0x4B4E4142;   // "BANK"
+    static const uint32_t SNAPSHOT_VERSION = 11;
+    static const size_t SHARD_COUNT = 64;
+
+    // One slice of the id index with its own lock
+    struct Shard {
+        mutable shared_mutex mtx;
+        AccountIndex index;
+    };
+
+    string bankName;
+    // Node id new accounts are issued under (see IdGenerator)
+    uint32_t nodeId;
+    // The accounts themselves, packed by type; shards only index them
+    SlabPool<SavingsAccount> savingsPool;
+    SlabPool<CheckingAccount> checkingPool;
+    Shard shards[SHARD_COUNT];
+    // Every savings account, for bulk interest runs
+    AccountRegistry<SavingsAccount> savingsRegistry;
+    // Every account that has ever taken a loan, for end-of-day installments
+    AccountRegistry<Account> borrowerRegistry;
+    // Holder name to account, for findAccountsByHolder
+    NameIndex names;
+    unique_ptr<Journal> journal;
+    // Where histories move their oldest chunks until the next checkpoint
+    unique_ptr<SpillFile> spill;
+    string snapshotPath;
+    // Journal position the bank is at when it has no journal open
+    uint64_t journalPosition = 0;
+    // Set when recover could not restore the saved state
+    bool recoveryFailed = false;
+    // Largest generated id met while replaying the journal
+    uint64_t replayedIds = 0;
+    // Receives a notification for every single-account operation, if set
+    LogSink* sink = nullptr;
+    // Receives every call to the single-account operations, if set
+    TraceRecorder* recorder = nullptr;
+    // Streams every transaction added to a history, if started
+    unique_ptr<ChangeFeed> changeFeed;
+    // Held shared by every mutation and exclusively while snapshotting, so
+    // a snapshot matches exactly one journal position
+    StripedSharedMutex stateLock;
+    // Running totals, updated by every balance or loan change
+    StripedCounter deposits[ACCOUNT_KIND_COUNT];
+    StripedCounter outstandingLoans;
+    StripedCounter overdrawnChecking;
+    TopBalances topBalances;
+    // Results of operations that carried a request id
+    RequestCache requests;
+    // Fraud and velocity rules, if any are loaded; replaced only while
+    // stateLock is held exclusively
+    unique_ptr<RiskEngine> risk;
+    // Multi-leg transfers prepared here and awaiting commit or abort
+    mutex preparedMtx;
+    unordered_map<uint64_t, vector<TransferLeg>> prepared;
+    // Transfers aborted before their prepare finished here, e.g. after the
+    // coordinator gave up waiting for the vote; kept until the prepare
+    // arrives and refuses
+    unordered_set<uint64_t> abortedEarly;
+
+    // The ids and time an operation's transactions are recorded under.
+    // Minted as the operation arrives and journaled with it, so replay
+    // recreates the very same records.
+    struct Stamp {
+        uint64_t txnId;
+        uint64_t creditId;          // the receiving side's record of a transfer
+        int64_t time;
+
+        static Stamp fresh(bool transfer = false) {
+            return Stamp{IdGenerator::next(), transfer ? IdGenerator::next() : 0, DateTime::nowNanos()};
+        }
+
+        void write(BinaryWriter& out, bool transfer) const {
+            out.u64(txnId);
+            if (transfer) out.u64(creditId);
+            out.i64(time);
+        }
+
+        static Stamp read(BinaryReader& in, bool transfer) {
+            Stamp stamp = {};
+            stamp.txnId = in.u64();
+            if (transfer) stamp.creditId = in.u64();
+            stamp.time = in.i64();
+            return stamp;
+        }
+    };
+
+    // Ids of a multi-leg transfer's records, a debit and a credit per leg,
+    // and their one timestamp
+    struct LegStamps {
+        vector<uint64_t> ids;
+        int64_t time;
+
+        static LegStamps fresh(size_t legs) {
+            LegStamps stamps;
+            stamps.ids.resize(legs * 2);
+            for (uint64_t& id : stamps.ids) id = IdGenerator::next();
+            stamps.time = DateTime::nowNanos();
+            return stamps;
+        }
+
+        void write(BinaryWriter& out) const {
+            out.i64(time);
+            for (uint64_t id : ids) out.u64(id);
+        }
+
+        static LegStamps read(BinaryReader& in, size_t legs) {
+            LegStamps stamps;
+            stamps.time = in.i64();
+            stamps.ids.resize(legs * 2);
+            for (uint64_t& id : stamps.ids) id = in.u64();
+            return stamps;
+        }
+    };
+
+    // An account's figures before an operation, for recordChange
+    struct Figures {
+        int64_t balance;
+        int64_t loans;
+    };
+
+    static Figures figuresOf(const Account& acc) {
+        return Figures{acc.getBalance().getCents(), acc.getOutstandingLoans().getCents()};
+    }
+
+    // Folds an account's change since `before` into the running totals.
+    // Called with the account's lock held.
+    void recordChange(Account& acc, const Figures& before) {
+        int64_t balance = acc.getBalance().getCents();
+        deposits[static_cast<size_t>(acc.getKind())].add(balance - before.balance);
+        outstandingLoans.add(acc.getOutstandingLoans().getCents() - before.loans);
+        if (acc.getKind() == AccountKind::CHECKING) {
+            overdrawnChecking.add(int(balance < 0) - int(before.balance < 0));
+        }
+        if (balance != before.balance) {
+            topBalances.update(&acc, balance);
+        }
+    }
+
+    // Recomputes every total from the accounts; no mutations may run
+    void rebuildTotals() {
+        for (auto& counter : deposits) counter.reset();
+        outstandingLoans.reset();
+        overdrawnChecking.reset();
+        topBalances.clear();
+        forEachAccount([&](Account* acc) {
+            topBalances.add(acc);
+            recordChange(*acc, Figures{0, 0});
+        });
+    }
+
+    // Visits every account, pool by pool in memory order
+    template <typename Fn>
+    void forEachAccount(Fn fn) const {
+        savingsPool.forEach(fn);
+        checkingPool.forEach(fn);
+    }
+
+    // Fibonacci hashing; the top bits pick the shard
+    static size_t shardIndex(uint64_t id) {
+        return (id * 0x9E3779B97F4A7C15ULL) >> 58;
+    }
+
+    Shard& shardFor(uint64_t id) {
+        return shards[shardIndex(id)];
+    }
+
+    // findAccount without metrics, for operations that time themselves
+    Account* lookup(uint64_t id) const {
+        const Shard& shard = shards[shardIndex(id)];
+        shared_lock<shared_mutex> lock(shard.mtx);
+        return shard.index.find(id);
+    }
+
+    // Journal appends happen under the account locks so the journal order
+    // matches the apply order; the durability wait happens after they are
+    // released so concurrent operations share one group commit.
+    uint64_t log(JournalOp op, const BinaryWriter& body) {
+        return journal ? journal->append(op, body) : 0;
+    }
+
+    // False if the journal failed before seq was durable. Inside a
+    // CommitBatch it defers the wait and the failure to the batch.
+    bool commit(uint64_t seq) {
+        if (!journal || !seq) return true;
+        if (openBatch && &openBatch->bank == this) {
+            openBatch->seq = max(openBatch->seq, seq);
+            return true;
+        }
+        return journal->waitDurable(seq);
+    }
+
+    // An applied operation's status once its records are committed
+    TxnStatus committed(uint64_t seq, TxnStatus status) {
+        return commit(seq) ? status : TxnStatus::NOT_DURABLE;
+    }
+
+    // Identifies what a request id was used for, so a retry can be told
+    // apart from a different operation reusing the id
+    static uint32_t requestFingerprint(JournalOp op, uint64_t id, uint64_t counterparty, Money amt) {
+        uint64_t h = static_cast<uint64_t>(op) + 0x9E3779B97F4A7C15ULL;
+        for (uint64_t v : {id, counterparty, static_cast<uint64_t>(amt.getCents())}) {
+            h = (h ^ v) * 0xBF58476D1CE4E5B9ULL;
+            h ^= h >> 31;
+        }
+        return static_cast<uint32_t>(h ^ (h >> 32));
+    }
+
+    // Claims requestId for a new run of an operation. False if the
+    // operation must not run; status is then its original result (already
+    // durable) or REQUEST_ID_CONFLICT. Request id 0 means no id.
+    bool claimRequest(uint64_t requestId, uint32_t fingerprint, TxnStatus& status) {
+        if (requestId == 0) return true;
+        uint64_t seq = 0;
+        switch (requests.claim(requestId, fingerprint, status, seq)) {
+            case RequestClaim::NEW:
+                return true;
+            case RequestClaim::REPLAY:
+                status = committed(seq, status);
+                return false;
+            case RequestClaim::CONFLICT:
+                status = TxnStatus::REQUEST_ID_CONFLICT;
+                return false;
+        }
+        return true;
+    }
+
+    // Publishes the result of a claimed request. Called inside the
+    // stateLock-shared section, so a snapshot holds exactly the results its
+    // journal position covers. A success is journaled by the operation's
+    // own record, which ends with the request id; a refusal gets a
+    // REQUEST_RESULT record so a retry after a restart is refused alike.
+    uint64_t settleRequest(uint64_t requestId, uint32_t fingerprint, TxnStatus status, uint64_t seq) {
+        if (requestId == 0) return seq;
+        if (status != TxnStatus::OK) {
+            BinaryWriter body;
+            body.u64(requestId);
+            body.u32(fingerprint);
+            body.u8(static_cast<uint8_t>(status));
+            seq = log(JournalOp::REQUEST_RESULT, body);
+        }
+        requests.complete(requestId, status, seq);
+        return seq;
+    }
+
+    // Runs apply, which performs op on acc, if the risk rules let it
+    // through, and counts it in the rules' windows if it succeeds. Called
+    // under acc's lock.
+    template <typename Apply>
+    TxnStatus screened(Account& acc, RiskOp op, Money amt, Apply apply) {
+        if (!risk) return apply();
+        int64_t now = DateTime::coarseNanos();
+        TxnStatus status = risk->screen(acc, op, amt, now);
+        if (status != TxnStatus::OK) return status;
+        Money before = acc.getBalance();
+        status = apply();
+        if (status == TxnStatus::OK) risk->record(acc, op, amt, before, now);
+        return status;
+    }
+
+    TxnStatus notify(JournalOp op, uint64_t id, uint64_t counterparty, Money amt, TxnStatus status) {
+        if (sink) {
+            sink->post(Notification{DateTime::nowNanos(), op, status, id, counterparty, amt});
+        }
+        return status;
+    }
+
+    // Reports a call to the trace recorder as it arrives
+    void trace(JournalOp op, uint64_t id, Money amt, uint64_t counterparty = 0, uint64_t requestId = 0,
+               int64_t rate = 0, int32_t count = 0) {
+        if (recorder) {
+            recorder->record(TraceRecord{DateTime::nowNanos(), id, counterparty, amt.getCents(), rate,
+                                         requestId, count, op, {}});
+        }
+    }
+
+    void registerSavings(Account* acc) {
+        SavingsAccount* savings = asSavings(acc);
+        if (savings) {
+            savingsRegistry.add(savings);
+        }
+    }
+
+    // Null, with nothing added, if an account already has the id
+    Account* addAccount(JournalOp kind, uint64_t id, const string& name, int64_t createdAt) {
+        Account* handle;
+        Shard& shard = shardFor(id);
+        {
+            unique_lock<shared_mutex> lock(shard.mtx);
+            if (shard.index.find(id)) return nullptr;
+            if (kind == JournalOp::CREATE_SAVINGS) {
+                handle = savingsPool.create(id, name);
+            } else {
+                handle = checkingPool.create(id, name);
+            }
+            handle->setCreatedAt(createdAt);
+            handle->getHistory().setSpill(spill.get());
+            handle->setChangeFeed(changeFeed.get());
+            topBalances.add(handle);
+            shard.index.insert(id, handle);
+        }
+        registerSavings(handle);
+        names.insert(handle);
+        return handle;
+    }
+
+    // status is OK once the account is open and funded. A negative opening
+    // deposit opens nothing and returns 0; any other refusal of the deposit
+    // is its status, with the account left open and empty.
+    uint64_t createAccount(JournalOp kind, const string& name, Money initialDeposit, TxnStatus& status) {
+        if (initialDeposit < Money()) {
+            status = TxnStatus::INVALID_AMOUNT;
+            return 0;
+        }
+        OpTimer timer(MetricOp::CREATE_ACCOUNT);
+        uint64_t id;
+        int64_t createdAt = DateTime::nowNanos();
+        uint64_t seq;
+        {
+            shared_lock<shared_mutex> state(stateLock.local());
+            // Ids are unique once recovery has advanced the generator past
+            // the recovered ones; an id in use is never taken over
+            do {
+                id = IdGenerator::next(nodeId);
+            } while (!addAccount(kind, id, name, createdAt));
+            BinaryWriter body;
+            body.u64(id);
+            body.str(name);
+            body.i64(createdAt);
+            seq = log(kind, body);
+        }
+        status = committed(seq, TxnStatus::OK);
+        notify(kind, id, 0, Money(), timer.done(status));
+        trace(kind, id, Money());
+        if (status == TxnStatus::OK && initialDeposit > Money()) {
+            status = deposit(id, initialDeposit);
+        }
+        return id;
+    }
+
+    // Runs op on one account under its lock and journals it on success.
+    // A claimed requestId is settled with the result.
+    template <typename Op>
+    TxnStatus mutate(uint64_t id, JournalOp kind, const BinaryWriter& body, Op op,
+                     uint64_t requestId = 0, uint32_t fingerprint = 0) {
+        TxnStatus status;
+        uint64_t seq = 0;
+        {
+            shared_lock<shared_mutex> state(stateLock.local());
+            Account* acc = lookup(id);
+            status = TxnStatus::ACCOUNT_NOT_FOUND;
+            if (acc) {
+                lock_guard<mutex> lock(acc->getMutex());
+                Figures before = figuresOf(*acc);
+                status = op(*acc);
+                if (status == TxnStatus::OK) {
+                    recordChange(*acc, before);
+                    seq = log(kind, body);
+                }
+            }
+            seq = settleRequest(requestId, fingerprint, status, seq);
+        }
+        return committed(seq, status);
+    }
+
+    // The accounts of a multi-leg transfer that are in this bank, locked in
+    // account-id order
+    struct LegAccounts {
+        vector<Account*> accounts;                  // distinct, ascending id
+        vector<pair<Account*, Account*>> sides;     // per leg; null for a side in another bank
+        vector<unique_lock<mutex>> locks;
+
+        size_t position(const Account* acc) const {
+            return lower_bound(accounts.begin(), accounts.end(), acc, [](const Account* a, const Account* b) {
+                return a->getAccountId() < b->getAccountId();
+            }) - accounts.begin();
+        }
+    };
+
+    // Looks up and locks every leg's accounts. With allHere, every account
+    // must be in this bank; otherwise a side may be on another node, but
+    // each leg needs one side here. Fails on a non-positive amount or a
+    // missing account.
+    TxnStatus lockLegs(const vector<TransferLeg>& legs, bool allHere, LegAccounts& out) {
+        out.sides.resize(legs.size());
+        out.accounts.reserve(legs.size() * 2);
+        for (size_t i = 0; i < legs.size(); ++i) {
+            const TransferLeg& leg = legs[i];
+            if (leg.amount <= Money()) return TxnStatus::INVALID_AMOUNT;
+            Account* from = lookup(leg.from);
+            Account* to = lookup(leg.to);
+            bool fromMissing = !from && (allHere || IdGenerator::nodeOf(leg.from) == nodeId);
+            bool toMissing = !to && (allHere || IdGenerator::nodeOf(leg.to) == nodeId);
+            if (fromMissing || toMissing || (!from && !to)) return TxnStatus::ACCOUNT_NOT_FOUND;
+            out.sides[i] = make_pair(from, to);
+            if (from) out.accounts.push_back(from);
+            if (to) out.accounts.push_back(to);
+        }
+        sort(out.accounts.begin(), out.accounts.end(), [](const Account* a, const Account* b) {
+            return a->getAccountId() < b->getAccountId();
+        });
+        out.accounts.erase(unique(out.accounts.begin(), out.accounts.end()), out.accounts.end());
+        out.locks.reserve(out.accounts.size());
+        for (Account* acc : out.accounts) {
+            out.locks.emplace_back(acc->getMutex());
+        }
+        return TxnStatus::OK;
+    }
+
+    // Each account's total debit here in cents, by its position in la.accounts
+    static vector<int64_t> debitsOf(const vector<TransferLeg>& legs, const LegAccounts& la) {
+        vector<int64_t> debits(la.accounts.size());
+        for (size_t i = 0; i < legs.size(); ++i) {
+            if (la.sides[i].first) debits[la.position(la.sides[i].first)] += legs[i].amount.getCents();
+        }
+        return debits;
+    }
+
+    // Puts each account's total debit to the risk rules as one transfer;
+    // a decline for any account refuses the whole transfer
+    TxnStatus screenDebits(const LegAccounts& la, const vector<int64_t>& debits, int64_t now) {
+        for (size_t k = 0; risk && k < la.accounts.size(); ++k) {
+            if (debits[k] == 0) continue;
+            TxnStatus status = risk->screen(*la.accounts[k], RiskOp::TRANSFER, Money::fromCents(debits[k]), now);
+            if (status != TxnStatus::OK) return status;
+        }
+        return TxnStatus::OK;
+    }
+
+    // Counts the debits in the rules' windows, just before they are paid out
+    void recordDebits(const LegAccounts& la, const vector<int64_t>& debits, int64_t now) {
+        for (size_t k = 0; risk && k < la.accounts.size(); ++k) {
+            if (debits[k] == 0) continue;
+            Account& acc = *la.accounts[k];
+            risk->record(acc, RiskOp::TRANSFER, Money::fromCents(debits[k]), acc.getBalance(), now);
+        }
+    }
+
+    // Holds every debit made here. An account's debits must be covered by
+    // its available balance before the transfer; credits within the same
+    // transfer do not count, so the outcome never depends on leg order.
+    static TxnStatus holdDebits(const vector<TransferLeg>& legs, LegAccounts& la, const vector<int64_t>& debits) {
+        for (size_t k = 0; k < la.accounts.size(); ++k) {
+            if (la.accounts[k]->getAvailableBalance().getCents() < debits[k]) return TxnStatus::INSUFFICIENT_FUNDS;
+        }
+        for (size_t i = 0; i < legs.size(); ++i) {
+            if (la.sides[i].first) la.sides[i].first->hold(legs[i].amount);
+        }
+        return TxnStatus::OK;
+    }
+
+    // Pays out the held debits and credits the legs' accounts here
+    void settleLegs(const vector<TransferLeg>& legs, LegAccounts& la, const LegStamps& stamps) {
+        vector<Figures> before;
+        before.reserve(la.accounts.size());
+        for (Account* acc : la.accounts) before.push_back(figuresOf(*acc));
+        for (size_t i = 0; i < legs.size(); ++i) {
+            const TransferLeg& leg = legs[i];
+            if (Account* from = la.sides[i].first) from->payOut(leg.amount, leg.to, stamps.ids[2 * i], stamps.time);
+            if (Account* to = la.sides[i].second) to->receive(leg.amount, leg.from, stamps.ids[2 * i + 1], stamps.time);
+        }
+        for (size_t k = 0; k < la.accounts.size(); ++k) {
+            recordChange(*la.accounts[k], before[k]);
+        }
+    }
+
+    // Removes a fully prepared transfer from the table and hands over its
+    // legs. When aborting one not prepared yet, marks it for its prepare.
+    bool takePrepared(uint64_t transferId, vector<TransferLeg>& legs, bool aborting = false) {
+        lock_guard<mutex> lock(preparedMtx);
+        auto it = prepared.find(transferId);
+        if (it == prepared.end() || it->second.empty()) {
+            if (aborting) abortedEarly.insert(transferId);
+            return false;
+        }
+        legs = move(it->second);
+        prepared.erase(it);
+        return true;
+    }
+
+    // Each leg is reported once, by the bank its money leaves
+    void notifyLegs(JournalOp op, const vector<TransferLeg>& legs, TxnStatus status) {
+        if (!sink) return;
+        for (const TransferLeg& leg : legs) {
+            if (lookup(leg.from)) notify(op, leg.from, leg.to, leg.amount, status);
+        }
+    }
+
+    // False if the record cannot apply to the state replayed so far
+    bool applyJournalRecord(JournalOp op, BinaryReader& r) {
+        switch (op) {
+            case JournalOp::CREATE_SAVINGS:
+            case JournalOp::CREATE_CHECKING: {
+                uint64_t id = r.u64();
+                string name = r.str();
+                int64_t createdAt = r.i64();
+                replayedId(id);
+                return addAccount(op, id, name, createdAt) != nullptr;
+            }
+            case JournalOp::DEPOSIT: {
+                uint64_t id = r.u64();
+                Money amt = r.money();
+                Stamp stamp = replayedStamp(r, false);
+                restoreRequest(r, JournalOp::DEPOSIT, id, 0, amt, deposit(id, amt, 0, stamp));
+                break;
+            }
+            case JournalOp::WITHDRAW: {
+                uint64_t id = r.u64();
+                Money amt = r.money();
+                Stamp stamp = replayedStamp(r, false);
+                restoreRequest(r, JournalOp::WITHDRAW, id, 0, amt, withdraw(id, amt, 0, stamp));
+                break;
+            }
+            case JournalOp::TRANSFER: {
+                uint64_t from = r.u64();
+                uint64_t to = r.u64();
+                Money amt = r.money();
+                Stamp stamp = replayedStamp(r, true);
+                restoreRequest(r, JournalOp::TRANSFER, from, to, amt, transfer(from, to, amt, 0, stamp));
+                break;
+            }
+            case JournalOp::APPLY_LOAN: {
+                uint64_t id = r.u64();
+                Money amt = r.money();
+                int64_t rate = r.i64();
+                int months = r.i32();
+                Stamp stamp = replayedStamp(r, false);
+                uint64_t loanId = replayedId(r.u64());
+                int64_t startedAt = r.i64();
+                applyLoan(id, amt, rate, months, stamp, loanId, startedAt);
+                break;
+            }
+            case JournalOp::PAY_LOAN: {
+                uint64_t id = r.u64();
+                int index = r.i32();
+                Money amt = r.money();
+                payLoan(id, index, amt, replayedStamp(r, false));
+                break;
+            }
+            case JournalOp::APPLY_INTEREST: {
+                uint64_t id = r.u64();
+                Money interest;
+                applyInterest(id, interest, replayedStamp(r, false));
+                break;
+            }
+            case JournalOp::REQUEST_RESULT: {
+                uint64_t requestId = r.u64();
+                uint32_t fingerprint = r.u32();
+                TxnStatus status = static_cast<TxnStatus>(r.u8());
+                requests.restore(requestId, fingerprint, status, DateTime::nowNanos());
+                break;
+            }
+            case JournalOp::MULTI_TRANSFER: {
+                vector<TransferLeg> legs = readLegs(r);
+                transferLegs(legs, replayedLegStamps(r, legs.size()));
+                break;
+            }
+            case JournalOp::TRANSFER_PREPARE: {
+                uint64_t transferId = r.u64();
+                prepareTransfer(transferId, readLegs(r));
+                break;
+            }
+            case JournalOp::TRANSFER_COMMIT:
+                commitTransfer(r.u64(), &r);
+                break;
+            case JournalOp::TRANSFER_ABORT:
+                abortTransfer(r.u64());
+                break;
+        }
+        return true;
+    }
+
+    // Reads a replayed record's generated ids, keeping the largest in
+    // replayedIds
+    uint64_t replayedId(uint64_t id) {
+        replayedIds = max(replayedIds, id);
+        return id;
+    }
+
+    Stamp replayedStamp(BinaryReader& r, bool transfer) {
+        Stamp stamp = Stamp::read(r, transfer);
+        replayedId(stamp.txnId);
+        replayedId(stamp.creditId);
+        return stamp;
+    }
+
+    LegStamps replayedLegStamps(BinaryReader& r, size_t legs) {
+        LegStamps stamps = LegStamps::read(r, legs);
+        for (uint64_t id : stamps.ids) replayedId(id);
+        return stamps;
+    }
+
+    // Rebuilds the cached result of a replayed operation whose record ends
+    // with a request id. The journal keeps no request times, so the
+    // retention window of a replayed result restarts at recovery.
+    void restoreRequest(BinaryReader& r, JournalOp op, uint64_t id, uint64_t counterparty,
+                        Money amt, TxnStatus status) {
+        if (r.remaining() < sizeof(uint64_t)) return;
+        uint64_t requestId = r.u64();
+        requests.restore(requestId, requestFingerprint(op, id, counterparty, amt), status,
+                         DateTime::nowNanos());
+    }
+
+    // The operations behind the public ones of the same name, recording
+    // their transactions under the given stamps
+    TxnStatus deposit(uint64_t id, Money amt, uint64_t requestId, const Stamp& stamp) {
+        OpTimer timer(MetricOp::DEPOSIT);
+        trace(JournalOp::DEPOSIT, id, amt, 0, requestId);
+        uint32_t fingerprint = requestId ? requestFingerprint(JournalOp::DEPOSIT, id, 0, amt) : 0;
+        TxnStatus status;
+        if (!claimRequest(requestId, fingerprint, status)) return timer.done(status);
+        BinaryWriter body;
+        body.u64(id);
+        body.money(amt);
+        stamp.write(body, false);
+        if (requestId) body.u64(requestId);
+        status = mutate(id, JournalOp::DEPOSIT, body,
+                        [&](Account& acc) {
+                            return screened(acc, RiskOp::DEPOSIT, amt,
+                                            [&] { return acc.deposit(amt, stamp.txnId, stamp.time); });
+                        }, requestId, fingerprint);
+        return notify(JournalOp::DEPOSIT, id, 0, amt, timer.done(status));
+    }
+
+    TxnStatus withdraw(uint64_t id, Money amt, uint64_t requestId, const Stamp& stamp) {
+        OpTimer timer(MetricOp::WITHDRAW);
+        trace(JournalOp::WITHDRAW, id, amt, 0, requestId);
+        uint32_t fingerprint = requestId ? requestFingerprint(JournalOp::WITHDRAW, id, 0, amt) : 0;
+        TxnStatus status;
+        if (!claimRequest(requestId, fingerprint, status)) return timer.done(status);
+        BinaryWriter body;
+        body.u64(id);
+        body.money(amt);
+        stamp.write(body, false);
+        if (requestId) body.u64(requestId);
+        status = mutate(id, JournalOp::WITHDRAW, body,
+                        [&](Account& acc) {
+                            return screened(acc, RiskOp::WITHDRAW, amt,
+                                            [&] { return acc.withdraw(amt, stamp.txnId, stamp.time); });
+                        }, requestId, fingerprint);
+        return notify(JournalOp::WITHDRAW, id, 0, amt, timer.done(status));
+    }
+
+    TxnStatus transfer(uint64_t fromId, uint64_t toId, Money amt, uint64_t requestId, const Stamp& stamp) {
+        OpTimer timer(MetricOp::TRANSFER);
+        trace(JournalOp::TRANSFER, fromId, amt, toId, requestId);
+        uint32_t fingerprint = requestId ? requestFingerprint(JournalOp::TRANSFER, fromId, toId, amt) : 0;
+        TxnStatus status;
+        if (!claimRequest(requestId, fingerprint, status)) return timer.done(status);
+        BinaryWriter body;
+        body.u64(fromId);
+        body.u64(toId);
+        body.money(amt);
+        stamp.write(body, true);
+        if (requestId) body.u64(requestId);
+
+        uint64_t seq = 0;
+        {
+            shared_lock<shared_mutex> state(stateLock.local());
+            Account* from = lookup(fromId);
+            Account* to = lookup(toId);
+            status = TxnStatus::ACCOUNT_NOT_FOUND;
+            if (from && to) {
+                // Every thread locks the lower account id first, so two opposing
+                // transfers can never each hold the lock the other needs
+                Account* first = from;
+                Account* second = to;
+                if (second->getAccountId() < first->getAccountId()) swap(first, second);
+
+                unique_lock<mutex> firstLock(first->getMutex());
+                unique_lock<mutex> secondLock;
+                if (second != first) {
+                    secondLock = unique_lock<mutex>(second->getMutex());
+                }
+                Figures fromBefore = figuresOf(*from);
+                Figures toBefore = figuresOf(*to);
+                status = screened(*from, RiskOp::TRANSFER, amt, [&] {
+                    return from->transfer(*to, amt, stamp.txnId, stamp.creditId, stamp.time);
+                });
+                if (status == TxnStatus::OK) {
+                    recordChange(*from, fromBefore);
+                    if (to != from) recordChange(*to, toBefore);
+                    seq = log(JournalOp::TRANSFER, body);
+                }
+            }
+            seq = settleRequest(requestId, fingerprint, status, seq);
+        }
+        status = committed(seq, status);
+        return notify(JournalOp::TRANSFER, fromId, toId, amt, timer.done(status));
+    }
+
+    TxnStatus applyLoan(uint64_t id, Money amt, int64_t rate, int months, const Stamp& stamp, uint64_t loanId,
+                        int64_t startedAt) {
+        OpTimer timer(MetricOp::APPLY_LOAN);
+        trace(JournalOp::APPLY_LOAN, id, amt, 0, 0, rate, months);
+        BinaryWriter body;
+        body.u64(id);
+        body.money(amt);
+        body.i64(rate);
+        body.i32(months);
+        stamp.write(body, false);
+        body.u64(loanId);
+        body.i64(startedAt);
+        TxnStatus status = mutate(id, JournalOp::APPLY_LOAN, body, [&](Account& acc) {
+            TxnStatus status = acc.applyLoan(amt, rate, months, stamp.txnId, stamp.time, loanId, startedAt);
+            if (status == TxnStatus::OK && acc.getLoanCount() == 1) {
+                borrowerRegistry.add(&acc);
+            }
+            return status;
+        });
+        return notify(JournalOp::APPLY_LOAN, id, 0, amt, timer.done(status));
+    }
+
+    TxnStatus payLoan(uint64_t id, int loanIndex, Money amt, const Stamp& stamp) {
+        OpTimer timer(MetricOp::PAY_LOAN);
+        trace(JournalOp::PAY_LOAN, id, amt, 0, 0, 0, loanIndex);
+        BinaryWriter body;
+        body.u64(id);
+        body.i32(loanIndex);
+        body.money(amt);
+        stamp.write(body, false);
+        TxnStatus status = mutate(id, JournalOp::PAY_LOAN, body, [&](Account& acc) {
+            return acc.payLoan(loanIndex, amt, stamp.txnId, stamp.time);
+        });
+        return notify(JournalOp::PAY_LOAN, id, 0, amt, timer.done(status));
+    }
+
+    TxnStatus applyInterest(uint64_t id, Money& interest, const Stamp& stamp) {
+        OpTimer timer(MetricOp::APPLY_INTEREST);
+        trace(JournalOp::APPLY_INTEREST, id, Money());
+        BinaryWriter body;
+        body.u64(id);
+        stamp.write(body, false);
+        TxnStatus status = mutate(id, JournalOp::APPLY_INTEREST, body, [&](Account& acc) {
+            SavingsAccount* savings = asSavings(&acc);
+            if (!savings) return TxnStatus::NOT_SAVINGS_ACCOUNT;
+            interest = savings->applyInterest(stamp.txnId, stamp.time);
+            return TxnStatus::OK;
+        });
+        return notify(JournalOp::APPLY_INTEREST, id, 0, interest, timer.done(status));
+    }
+
+    TxnStatus transferLegs(const vector<TransferLeg>& legs, const LegStamps& stamps) {
+        OpTimer timer(MetricOp::MULTI_TRANSFER);
+        if (legs.empty()) return timer.done(TxnStatus::INVALID_AMOUNT);
+        TxnStatus status;
+        uint64_t seq = 0;
+        {
+            shared_lock<shared_mutex> state(stateLock.local());
+            LegAccounts la;
+            status = lockLegs(legs, true, la);
+            vector<int64_t> debits;
+            int64_t now = DateTime::coarseNanos();
+            if (status == TxnStatus::OK) {
+                debits = debitsOf(legs, la);
+                status = screenDebits(la, debits, now);
+            }
+            if (status == TxnStatus::OK) status = holdDebits(legs, la, debits);
+            if (status == TxnStatus::OK) {
+                recordDebits(la, debits, now);
+                settleLegs(legs, la, stamps);
+                if (journal) {
+                    BinaryWriter body;
+                    writeLegs(body, legs);
+                    stamps.write(body);
+                    seq = log(JournalOp::MULTI_TRANSFER, body);
+                }
+            }
+        }
+        status = committed(seq, status);
+        notifyLegs(JournalOp::MULTI_TRANSFER, legs, status);
+        return timer.done(status);
+    }
+
+    // recorded is a replayed TRANSFER_COMMIT record, positioned at the
+    // stamps of the legs' records; null mints new ones
+    TxnStatus commitTransfer(uint64_t transferId, BinaryReader* recorded) {
+        OpTimer timer(MetricOp::COMMIT_TRANSFER);
+        vector<TransferLeg> legs;
+        uint64_t seq = 0;
+        {
+            shared_lock<shared_mutex> state(stateLock.local());
+            if (!takePrepared(transferId, legs)) return timer.done(TxnStatus::TRANSFER_NOT_PREPARED);
+            // Cannot fail: the legs were checked when prepared and accounts
+            // are never removed
+            LegAccounts la;
+            lockLegs(legs, false, la);
+            LegStamps stamps = recorded ? replayedLegStamps(*recorded, legs.size()) : LegStamps::fresh(legs.size());
+            // Screened when prepared; the windows count it once it happens
+            recordDebits(la, debitsOf(legs, la), DateTime::coarseNanos());
+            settleLegs(legs, la, stamps);
+            if (journal) {
+                BinaryWriter body;
+                body.u64(transferId);
+                stamps.write(body);
+                seq = log(JournalOp::TRANSFER_COMMIT, body);
+            }
+        }
+        TxnStatus status = committed(seq, TxnStatus::OK);
+        notifyLegs(JournalOp::TRANSFER_COMMIT, legs, status);
+        return timer.done(status);
+    }
+
+public:
+    // Lets a thread that answers many operations together wait for their
+    // durability once. While a batch is open, the thread's operations on
+    // this bank return as soon as they are applied and journaled, without
+    // waiting for the fsync; wait() (also run by the destructor) returns
+    // once all of them are durable. Their results must not be reported
+    // before then, nor at all if wait() fails.
+    class CommitBatch {
+    private:
+        friend class Bank;
+        Bank& bank;
+        uint64_t seq;
+        CommitBatch* outer;
+
+    public:
+        explicit CommitBatch(Bank& bank) : bank(bank), seq(0), outer(openBatch) { openBatch = this; }
+        ~CommitBatch() {
+            wait();
+            openBatch = outer;
+        }
+        CommitBatch(const CommitBatch&) = delete;
+        CommitBatch& operator=(const CommitBatch&) = delete;
+
+        // False if the journal failed first: the batch's operations are
+        // then NOT_DURABLE, whatever they returned
+        bool wait() {
+            bool ok = !seq || !bank.journal || bank.journal->waitDurable(seq);
+            seq = 0;
+            return ok;
+        }
+    };
+
+private:
+    // This thread's open CommitBatch, if any
+    static inline thread_local CommitBatch* openBatch = nullptr;
+
+public:
+    Bank(string name) : bankName(name), nodeId(IdGenerator::getNodeId()) {}
+
+    uint64_t createSavingsAccount(string name, Money initialDeposit = Money()) {
+        TxnStatus status;
+        return createAccount(JournalOp::CREATE_SAVINGS, name, initialDeposit, status);
+    }
+
+    uint64_t createCheckingAccount(string name, Money initialDeposit = Money()) {
+        TxnStatus status;
+        return createAccount(JournalOp::CREATE_CHECKING, name, initialDeposit, status);
+    }
+
+    // These report whether the account was opened and funded: a negative
+    // opening deposit opens nothing (id 0, INVALID_AMOUNT), and a refused
+    // one leaves the account open and empty under the deposit's status
+    uint64_t createSavingsAccount(string name, Money initialDeposit, TxnStatus& status) {
+        return createAccount(JournalOp::CREATE_SAVINGS, name, initialDeposit, status);
+    }
+
+    uint64_t createCheckingAccount(string name, Money initialDeposit, TxnStatus& status) {
+        return createAccount(JournalOp::CREATE_CHECKING, name, initialDeposit, status);
+    }
+
+    Account* findAccount(uint64_t id) const {
+        OpTimer timer(MetricOp::FIND_ACCOUNT, Metrics::LOOKUP_SAMPLE);
+        Account* acc = lookup(id);
+        timer.done(acc ? TxnStatus::OK : TxnStatus::ACCOUNT_NOT_FOUND);
+        return acc;
+    }
+
+    Account* findAccount(string_view accNum) const {
+        return findAccount(parseAccountNumber(accNum));
+    }
+
+    // Deposits, withdrawals and transfers take an optional request id
+    // (nonzero, chosen by the client). Repeating a call with the same id
+    // and arguments returns the first call's result without running it
+    // again, also across restarts, for as long as RequestCache keeps it.
+    // Repeats are counted in metrics but not reported to the sink.
+    TxnStatus deposit(uint64_t id, Money amt, uint64_t requestId = 0) {
+        return deposit(id, amt, requestId, Stamp::fresh());
+    }
+
+    TxnStatus withdraw(uint64_t id, Money amt, uint64_t requestId = 0) {
+        return withdraw(id, amt, requestId, Stamp::fresh());
+    }
+
+    TxnStatus transfer(uint64_t fromId, uint64_t toId, Money amt, uint64_t requestId = 0) {
+        return transfer(fromId, toId, amt, requestId, Stamp::fresh(true));
+    }
+
+    // rate is the annual interest rate in parts per million
+    TxnStatus applyLoan(uint64_t id, Money amt, int64_t rate, int months) {
+        Stamp stamp = Stamp::fresh();
+        return applyLoan(id, amt, rate, months, stamp, IdGenerator::next(), stamp.time);
+    }
+
+    TxnStatus payLoan(uint64_t id, int loanIndex, Money amt) {
+        return payLoan(id, loanIndex, amt, Stamp::fresh());
+    }
+
+    TxnStatus applyInterest(uint64_t id, Money& interest) {
+        return applyInterest(id, interest, Stamp::fresh());
+    }
+
+    // Applies ops in order and stores one status per op in results, without
+    // any console output. Each distinct account is looked up once, every
+    // account the batch touches is locked once for the whole batch (in
+    // account-id order, like transfer), and the batch's journal records
+    // are appended together and committed with a single wait.
+    void applyBatch(const BatchOp* ops, size_t count, TxnStatus* results) {
+        // Recorded as the single operations they stand for
+        if (recorder) {
+            static const JournalOp BATCH_TRACE[] = {
+                JournalOp::DEPOSIT, JournalOp::WITHDRAW, JournalOp::TRANSFER, JournalOp::PAY_LOAN
+            };
+            for (size_t i = 0; i < count; ++i) {
+                const BatchOp& op = ops[i];
+                trace(BATCH_TRACE[static_cast<int>(op.type)], op.account, op.amount,
+                      op.type == BatchOpType::TRANSFER ? op.toAccount : 0, 0, 0,
+                      op.type == BatchOpType::PAY_LOAN ? op.loanIndex : 0);
+            }
+        }
+        vector<pair<JournalOp, BinaryWriter>> records;
+        uint64_t seq = 0;
+        {
+            shared_lock<shared_mutex> state(stateLock.local());
+            vector<pair<Account*, Account*>> targets(count);
+            vector<Account*> touched;
+            touched.reserve(count * 2);
+            for (size_t i = 0; i < count; ++i) {
+                Account* acc = lookup(ops[i].account);
+                Account* to = ops[i].type == BatchOpType::TRANSFER ? lookup(ops[i].toAccount) : acc;
+                targets[i] = make_pair(acc, to);
+                if (acc) touched.push_back(acc);
+                if (to && to != acc) touched.push_back(to);
+            }
+            sort(touched.begin(), touched.end(), [](const Account* a, const Account* b) {
+                return a->getAccountId() < b->getAccountId();
+            });
+            touched.erase(unique(touched.begin(), touched.end()), touched.end());
+
+            vector<unique_lock<mutex>> locks;
+            locks.reserve(touched.size());
+            for (Account* acc : touched) {
+                locks.emplace_back(acc->getMutex());
+            }
+
+            for (size_t i = 0; i < count; ++i) {
+                const BatchOp& op = ops[i];
+                Account* acc = targets[i].first;
+                Account* to = targets[i].second;
+                if (!acc || !to) {
+                    results[i] = TxnStatus::ACCOUNT_NOT_FOUND;
+                    continue;
+                }
+
+                BinaryWriter body;
+                body.u64(op.account);
+                Stamp stamp = Stamp::fresh(op.type == BatchOpType::TRANSFER);
+                Figures accBefore = figuresOf(*acc);
+                Figures toBefore = figuresOf(*to);
+                JournalOp kind;
+                switch (op.type) {
+                    case BatchOpType::DEPOSIT:
+                        results[i] = screened(*acc, RiskOp::DEPOSIT, op.amount,
+                                              [&] { return acc->deposit(op.amount, stamp.txnId, stamp.time); });
+                        kind = JournalOp::DEPOSIT;
+                        break;
+                    case BatchOpType::WITHDRAW:
+                        results[i] = screened(*acc, RiskOp::WITHDRAW, op.amount,
+                                              [&] { return acc->withdraw(op.amount, stamp.txnId, stamp.time); });
+                        kind = JournalOp::WITHDRAW;
+                        break;
+                    case BatchOpType::TRANSFER:
+                        results[i] = screened(*acc, RiskOp::TRANSFER, op.amount,
+                                              [&] {
+                                                  return acc->transfer(*to, op.amount, stamp.txnId, stamp.creditId,
+                                                                       stamp.time);
+                                              });
+                        kind = JournalOp::TRANSFER;
+                        body.u64(op.toAccount);
+                        break;
+                    case BatchOpType::PAY_LOAN:
+                    default:
+                        results[i] = acc->payLoan(op.loanIndex, op.amount, stamp.txnId, stamp.time);
+                        kind = JournalOp::PAY_LOAN;
+                        body.i32(op.loanIndex);
+                        break;
+                }
+                if (results[i] != TxnStatus::OK) continue;
+                recordChange(*acc, accBefore);
+                if (to != acc) recordChange(*to, toBefore);
+                if (journal) {
+                    body.money(op.amount);
+                    stamp.write(body, op.type == BatchOpType::TRANSFER);
+                    records.emplace_back(kind, move(body));
+                }
+            }
+            if (journal) {
+                seq = journal->appendBatch(records);
+            }
+        }
+        if (!commit(seq)) {
+            for (size_t i = 0; i < count; ++i) {
+                if (results[i] == TxnStatus::OK) results[i] = TxnStatus::NOT_DURABLE;
+            }
+        }
+        // Batched operations are counted by result but not timed one by one
+        if (Metrics::isEnabled()) {
+            static const MetricOp BATCH_METRIC[] = {
+                MetricOp::DEPOSIT, MetricOp::WITHDRAW, MetricOp::TRANSFER, MetricOp::PAY_LOAN
+            };
+            for (size_t i = 0; i < count; ++i) {
+                Metrics::record(BATCH_METRIC[static_cast<int>(ops[i].type)], results[i], -1);
+            }
+        }
+    }
+
+    vector<TxnStatus> applyBatch(const vector<BatchOp>& ops) {
+        vector<TxnStatus> results(ops.size());
+        applyBatch(ops.data(), ops.size(), results.data());
+        return results;
+    }
+
+    // Moves money along every leg or along none, when all the accounts are
+    // in this bank: payroll, for one, is a single debit fanned out to many
+    // credits. The accounts are locked together in id order, and the
+    // transfer is journaled as one record. The risk rules see each paying
+    // account's total debit as one transfer.
+    TxnStatus transferLegs(const vector<TransferLeg>& legs) {
+        return transferLegs(legs, LegStamps::fresh(legs.size()));
+    }
+
+    // Participant side of a two-phase multi-leg transfer whose accounts are
+    // spread over several banks (see TransferCoordinator). Only the legs'
+    // sides in this bank are acted on. Preparing validates them and holds
+    // the debits, so the vote (OK or the reason for refusing) is binding;
+    // the prepared transfer is journaled and snapshotted, so it survives a
+    // restart until the coordinator commits or aborts it. The risk rules
+    // screen the debits when preparing and count them when committing.
+    // TRANSFER_NOT_PREPARED if the transfer was aborted here first.
+    TxnStatus prepareTransfer(uint64_t transferId, const vector<TransferLeg>& legs) {
+        OpTimer timer(MetricOp::PREPARE_TRANSFER);
+        if (legs.empty()) return timer.done(TxnStatus::INVALID_AMOUNT);
+        {
+            lock_guard<mutex> lock(preparedMtx);
+            if (abortedEarly.erase(transferId)) return timer.done(TxnStatus::TRANSFER_NOT_PREPARED);
+            if (!prepared.emplace(transferId, vector<TransferLeg>()).second) {
+                return timer.done(TxnStatus::REQUEST_ID_CONFLICT);
+            }
+        }
+        TxnStatus status;
+        uint64_t seq = 0;
+        {
+            shared_lock<shared_mutex> state(stateLock.local());
+            LegAccounts la;
+            status = lockLegs(legs, false, la);
+            vector<int64_t> debits;
+            if (status == TxnStatus::OK) {
+                debits = debitsOf(legs, la);
+                status = screenDebits(la, debits, DateTime::coarseNanos());
+            }
+            if (status == TxnStatus::OK) status = holdDebits(legs, la, debits);
+            // Aborting waits for this lock, so it either finds the transfer
+            // prepared or marks it before the vote is journaled
+            lock_guard<mutex> lock(preparedMtx);
+            if (status == TxnStatus::OK && abortedEarly.erase(transferId)) {
+                for (size_t i = 0; i < legs.size(); ++i) {
+                    if (la.sides[i].first) la.sides[i].first->release(legs[i].amount);
+                }
+                status = TxnStatus::TRANSFER_NOT_PREPARED;
+            }
+            if (status == TxnStatus::OK && journal) {
+                BinaryWriter body;
+                body.u64(transferId);
+                writeLegs(body, legs);
+                seq = log(JournalOp::TRANSFER_PREPARE, body);
+            }
+            if (status == TxnStatus::OK) {
+                prepared[transferId] = legs;
+            } else {
+                prepared.erase(transferId);
+            }
+        }
+        return timer.done(committed(seq, status));
+    }
+
+    // Carries out a prepared transfer's legs here. TRANSFER_NOT_PREPARED if
+    // there is no such prepared transfer (it may already have committed).
+    TxnStatus commitTransfer(uint64_t transferId) {
+        return commitTransfer(transferId, nullptr);
+    }
+
+    // Releases a prepared transfer's held debits. TRANSFER_NOT_PREPARED if
+    // it is not prepared here; a prepare of it still on its way then
+    // refuses and holds nothing.
+    TxnStatus abortTransfer(uint64_t transferId) {
+        OpTimer timer(MetricOp::ABORT_TRANSFER);
+        vector<TransferLeg> legs;
+        uint64_t seq = 0;
+        {
+            shared_lock<shared_mutex> state(stateLock.local());
+            if (!takePrepared(transferId, legs, true)) return timer.done(TxnStatus::TRANSFER_NOT_PREPARED);
+            LegAccounts la;
+            lockLegs(legs, false, la);
+            for (size_t i = 0; i < legs.size(); ++i) {
+                if (la.sides[i].first) la.sides[i].first->release(legs[i].amount);
+            }
+            if (journal) {
+                BinaryWriter body;
+                body.u64(transferId);
+                seq = log(JournalOp::TRANSFER_ABORT, body);
+            }
+        }
+        return timer.done(committed(seq, TxnStatus::OK));
+    }
+
+    // Transfers prepared here and still waiting for the coordinator's
+    // decision, e.g. after the coordinator failed
+    vector<uint64_t> getPreparedTransfers() {
+        vector<uint64_t> ids;
+        lock_guard<mutex> lock(preparedMtx);
+        for (const auto& entry : prepared) {
+            if (!entry.second.empty()) ids.push_back(entry.first);
+        }
+        sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    // Month-end interest for every savings account. Accounts are taken in
+    // blocks spread over all cores; a block locks its accounts in id order,
+    // gathers balances and rates into arrays, runs InterestKernel over them,
+    // writes the interest back and journals the whole block in one append.
+    InterestRunSummary accrueInterestAll() {
+        const size_t BLOCK = 4096;
+        InterestRunSummary summary;
+        shared_lock<shared_mutex> state(stateLock.local());
+
+        vector<SavingsAccount*> registry = savingsRegistry.snapshot();
+
+        // One timestamp for the whole run
+        int64_t timestamp = DateTime::nowNanos();
+        size_t blockCount = (registry.size() + BLOCK - 1) / BLOCK;
+        atomic<size_t> nextBlock(0);
+        atomic<size_t> credited(0);
+        atomic<int64_t> totalCents(0);
+        atomic<uint64_t> lastSeq(0);
+
+        auto worker = [&]() {
+            vector<int64_t> balances(BLOCK), rates(BLOCK), interest(BLOCK);
+            vector<unique_lock<mutex>> locks;
+            vector<pair<JournalOp, BinaryWriter>> records;
+            size_t block;
+            while ((block = nextBlock++) < blockCount) {
+                size_t begin = block * BLOCK;
+                size_t n = min(BLOCK, registry.size() - begin);
+                SavingsAccount* const* accounts = registry.data() + begin;
+
+                for (size_t i = 0; i < n; ++i) {
+                    locks.emplace_back(accounts[i]->getMutex());
+                    balances[i] = accounts[i]->getBalance().getCents();
+                    rates[i] = accounts[i]->getInterestRate();
+                }
+                InterestKernel::run(balances.data(), rates.data(), interest.data(), n);
+
+                size_t blockCredited = 0;
+                int64_t blockCents = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    if (interest[i] == 0) continue;
+                    uint64_t txnId = IdGenerator::next();
+                    accounts[i]->creditInterest(Money::fromCents(interest[i]), txnId, timestamp);
+                    topBalances.update(accounts[i], balances[i] + interest[i]);
+                    ++blockCredited;
+                    blockCents += interest[i];
+                    if (journal) {
+                        BinaryWriter body;
+                        body.u64(accounts[i]->getAccountId());
+                        body.u64(txnId);
+                        body.i64(timestamp);
+                        records.emplace_back(JournalOp::APPLY_INTEREST, move(body));
+                    }
+                }
+                if (journal && !records.empty()) {
+                    uint64_t seq = journal->appendBatch(records);
+                    uint64_t prev = lastSeq.load();
+                    while (prev < seq && !lastSeq.compare_exchange_weak(prev, seq)) {}
+                    records.clear();
+                }
+                deposits[static_cast<size_t>(AccountKind::SAVINGS)].add(blockCents);
+                locks.clear();
+                credited += blockCredited;
+                totalCents += blockCents;
+            }
+        };
+
+        unsigned threadCount = min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(blockCount, 1));
+        vector<thread> workers;
+        for (unsigned t = 1; t < threadCount; ++t) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& w : workers) {
+            w.join();
+        }
+        summary.durable = commit(lastSeq.load());
+        summary.accountsCredited = credited.load();
+        summary.totalInterest = Money::fromCents(totalCents.load());
+        return summary;
+    }
+
+    // Collects every loan installment that has fallen due by asOf, catching
+    // up on any missed earlier ones first. Borrowers are taken in blocks
+    // spread over all cores; a block locks its accounts in id order, pays
+    // what each balance covers and journals the payments in one append as
+    // ordinary PAY_LOAN records, so replay needs no special handling.
+    // Installments the balance cannot cover stay due for the next run.
+    InstallmentRunSummary runEndOfDay(int64_t asOf) {
+        const size_t BLOCK = 1024;
+        InstallmentRunSummary summary;
+        shared_lock<shared_mutex> state(stateLock.local());
+
+        vector<Account*> registry = borrowerRegistry.snapshot();
+        // One timestamp for the whole run
+        int64_t timestamp = DateTime::nowNanos();
+        size_t blockCount = (registry.size() + BLOCK - 1) / BLOCK;
+        atomic<size_t> nextBlock(0);
+        atomic<size_t> paid(0), missed(0);
+        atomic<int64_t> collectedCents(0), interestCents(0);
+        atomic<uint64_t> lastSeq(0);
+
+        auto worker = [&]() {
+            vector<unique_lock<mutex>> locks;
+            vector<pair<JournalOp, BinaryWriter>> records;
+            size_t block;
+            while ((block = nextBlock++) < blockCount) {
+                size_t begin = block * BLOCK;
+                size_t n = min(BLOCK, registry.size() - begin);
+                Account* const* accounts = registry.data() + begin;
+
+                for (size_t i = 0; i < n; ++i) {
+                    locks.emplace_back(accounts[i]->getMutex());
+                }
+                size_t blockPaid = 0, blockMissed = 0;
+                int64_t blockCollected = 0, blockInterest = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    Account* acc = accounts[i];
+                    Figures before = figuresOf(*acc);
+                    bool changed = false;
+                    for (size_t loan = 0; loan < acc->getLoanCount(); ++loan) {
+                        Installment due;
+                        TxnStatus status;
+                        uint64_t txnId;
+                        while ((status = acc->payDueInstallment(loan, asOf, txnId = IdGenerator::next(), timestamp,
+                                                                due)) == TxnStatus::OK) {
+                            changed = true;
+                            ++blockPaid;
+                            blockCollected += due.payment.getCents();
+                            blockInterest += due.interest.getCents();
+                            if (journal) {
+                                BinaryWriter body;
+                                body.u64(acc->getAccountId());
+                                body.i32(static_cast<int32_t>(loan));
+                                body.money(due.payment);
+                                body.u64(txnId);
+                                body.i64(timestamp);
+                                records.emplace_back(JournalOp::PAY_LOAN, move(body));
+                            }
+                        }
+                        if (status == TxnStatus::INSUFFICIENT_FUNDS) ++blockMissed;
+                    }
+                    if (changed) recordChange(*acc, before);
+                }
+                if (journal && !records.empty()) {
+                    uint64_t seq = journal->appendBatch(records);
+                    uint64_t prev = lastSeq.load();
+                    while (prev < seq && !lastSeq.compare_exchange_weak(prev, seq)) {}
+                    records.clear();
+                }
+                locks.clear();
+                paid += blockPaid;
+                missed += blockMissed;
+                collectedCents += blockCollected;
+                interestCents += blockInterest;
+            }
+        };
+
+        unsigned threadCount = min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(blockCount, 1));
+        vector<thread> workers;
+        for (unsigned t = 1; t < threadCount; ++t) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& w : workers) {
+            w.join();
+        }
+        summary.durable = commit(lastSeq.load());
+        summary.installmentsPaid = paid.load();
+        summary.installmentsMissed = missed.load();
+        summary.totalCollected = Money::fromCents(collectedCents.load());
+        summary.interestCollected = Money::fromCents(interestCents.load());
+        return summary;
+    }
+
+    // Current bank-wide totals, read without scanning any account
+    BankTotals getTotals() const {
+        BankTotals totals;
+        for (size_t i = 0; i < ACCOUNT_KIND_COUNT; ++i) {
+            totals.deposits[i] = Money::fromCents(deposits[i].read());
+        }
+        totals.outstandingLoans = Money::fromCents(outstandingLoans.read());
+        totals.overdrawnChecking = overdrawnChecking.read();
+        totals.accounts = getAccountCount();
+        return totals;
+    }
+
+    // The largest balances, largest first, read without scanning any
+    // account or pausing mutations
+    vector<TopBalances::Entry> getTopBalances() const {
+        return topBalances.read();
+    }
+
+    // Accounts created from now on get ids issued under this node, which is
+    // how a TransferCoordinator finds the bank holding an account. Defaults
+    // to the process's node id.
+    void setNodeId(uint32_t node) { nodeId = node % IdGenerator::NODE_COUNT; }
+    uint32_t getNodeId() const { return nodeId; }
+
+    // Every active account, in account-id order
+    vector<AccountRow> listAccounts() const {
+        vector<Account*> all;
+        forEachAccount([&all](Account* acc) { all.push_back(acc); });
+        sort(all.begin(), all.end(), [](const Account* a, const Account* b) {
+            return a->getAccountId() < b->getAccountId();
+        });
+
+        vector<AccountRow> rows;
+        rows.reserve(all.size());
+        for (Account* acc : all) {
+            lock_guard<mutex> lock(acc->getMutex());
+            if (acc->getIsActive()) {
+                rows.push_back({acc->getAccountId(), acc->getAccountHolder(), acc->getKind(), acc->getBalance()});
+            }
+        }
+        return rows;
+    }
+
+    // Active accounts whose holder name matches text, at most limit of
+    // them, in case-folded name order. A lookup in the name index: a
+    // binary search and a walk over the matching names, whatever the
+    // number of accounts.
+    vector<AccountRow> findAccountsByHolder(const string& text, NameMatch match, size_t limit) const {
+        vector<AccountRow> rows;
+        if (limit == 0) return rows;
+        names.find(text, match, [&rows, limit](Account* acc) {
+            lock_guard<mutex> lock(acc->getMutex());
+            if (acc->getIsActive()) {
+                rows.push_back({acc->getAccountId(), acc->getAccountHolder(), acc->getKind(), acc->getBalance()});
+            }
+            return rows.size() < limit;
+        });
+        return rows;
+    }
+
+    size_t getNameIndexBytes() const { return names.memoryBytes(); }
+
+    // Operations finished from now on are reported to sink (nullptr stops
+    // reporting). Set it while no operations are running; attaching it
+    // after recover keeps journal replay out of the notifications.
+    void setNotificationSink(LogSink* notificationSink) {
+        sink = notificationSink;
+    }
+
+    // Every call to the single-account operations (opening accounts,
+    // deposits, withdrawals, transfers, loans, interest, and applyBatch's
+    // operations one by one) is reported to recorder as it arrives, for
+    // replay (nullptr stops recording). Set it while no operations are
+    // running.
+    void setTraceRecorder(TraceRecorder* traceRecorder) {
+        recorder = traceRecorder;
+    }
+
+    // Streams every transaction added to any history from now on to the
+    // given file (see ChangeFeed). Starting it after recover keeps journal
+    // replay out of the stream. False if the file cannot be opened or the
+    // feed is already running.
+    bool startChangeFeed(const string& path) {
+        if (changeFeed) return false;
+        unique_ptr<ChangeFeed> feed(new ChangeFeed());
+        if (!feed->open(path)) return false;
+        lock_guard<StripedSharedMutex> quiesce(stateLock);
+        changeFeed = move(feed);
+        forEachAccount([this](Account* acc) { acc->setChangeFeed(changeFeed.get()); });
+        return true;
+    }
+
+    // Stops streaming; events already published are still written out
+    void stopChangeFeed() {
+        unique_ptr<ChangeFeed> feed;
+        {
+            lock_guard<StripedSharedMutex> quiesce(stateLock);
+            feed = move(changeFeed);
+            forEachAccount([](Account* acc) { acc->setChangeFeed(nullptr); });
+        }
+    }
+
+    bool hasChangeFeed() const { return changeFeed != nullptr; }
+
+    ChangeFeedStats getChangeFeedStats() const {
+        return changeFeed ? changeFeed->stats() : ChangeFeedStats{0, 0, 0, 0, 0};
+    }
+
+    // Waits until every event published so far is in the stream file.
+    // False if writing the file is failing.
+    bool drainChangeFeed() const {
+        return !changeFeed || changeFeed->drain();
+    }
+
+    // Writes every account's history to a columnar ledger file (see
+    // LedgerExport.h) with up to `threads` workers (0: one per core).
+    // Nothing is paused: each account's records are copied out under that
+    // account's lock alone and turned into columns after it is released,
+    // so writers wait at most for one copy. Each account's history is
+    // exported as of the moment it is reached, and accounts created after
+    // the export starts are left out. Workers fill row groups of about
+    // ROW_GROUP_ROWS rows and write them to disjoint parts of the file at
+    // once. Like listAccounts, it must not overlap loadFromFile.
+    bool exportLedger(const string& filename, unsigned threads, LedgerExportSummary& summary) {
+        const size_t BLOCK = 1024;
+        const size_t ROW_GROUP_ROWS = 1 << 20;
+        LedgerFileWriter out;
+        if (!out.open(filename)) return false;
+
+        vector<Account*> all;
+        forEachAccount([&all](Account* acc) { all.push_back(acc); });
+        sort(all.begin(), all.end(), [](const Account* a, const Account* b) {
+            return a->getAccountId() < b->getAccountId();
+        });
+
+        size_t blockCount = (all.size() + BLOCK - 1) / BLOCK;
+        atomic<size_t> nextBlock(0);
+        atomic<bool> historyOk(true);
+        auto worker = [&]() {
+            LedgerRowGroupBuilder group;
+            vector<Transaction> copy;
+            size_t block;
+            while ((block = nextBlock++) < blockCount) {
+                size_t end = min(all.size(), (block + 1) * BLOCK);
+                for (size_t i = block * BLOCK; i < end; ++i) {
+                    copy.clear();
+                    {
+                        lock_guard<mutex> lock(all[i]->getMutex());
+                        bool ok = all[i]->getHistory().forEachChunk([&copy](const Transaction* records, size_t count) {
+                            copy.insert(copy.end(), records, records + count);
+                        });
+                        if (!ok) historyOk = false;
+                    }
+                    group.add(all[i]->getAccountId(), copy.data(), copy.size());
+                    if (group.rows() >= ROW_GROUP_ROWS) out.write(group);
+                }
+            }
+            out.write(group);
+        };
+
+        if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+        unsigned threadCount = min<size_t>(threads, max<size_t>(blockCount, 1));
+        vector<thread> workers;
+        for (unsigned t = 1; t < threadCount; ++t) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& w : workers) {
+            w.join();
+        }
+
+        summary.accounts = all.size();
+        return historyOk && out.finish(summary.rows, summary.bytes);
+    }
+
+private:
+    // Writes a snapshot of every account, tagged with the journal sequence
+    // it covers. The file is written aside and renamed into place, so any
+    // mapping of the previous snapshot stays valid. Callers hold stateLock
+    // exclusively.
+    bool writeSnapshot(const string& filename, uint64_t journalSeq) {
+        string tmpName = filename + ".tmp";
+        int fd = ::open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+
+        SnapshotHeader header = {};
+        header.magic = SNAPSHOT_MAGIC;
+        header.version = SNAPSHOT_VERSION;
+        header.journalSeq = journalSeq;
+        header.idHighWater = IdGenerator::highWater();
+        forEachAccount([&header](const Account* acc) {
+            ++header.accountCount;
+            header.txnCount += acc->getTransactionCount();
+            header.loanCount += acc->getLoanCount();
+        });
+        header.indexOffset = sizeof(SnapshotHeader);
+        header.txnOffset = header.indexOffset + header.accountCount * sizeof(AccountRecord);
+        header.loanOffset = header.txnOffset + header.txnCount * sizeof(Transaction);
+        vector<RequestRecord> requestRecords;
+        requests.forEach([&requestRecords](const RequestRecord& rec) { requestRecords.push_back(rec); });
+        header.requestCount = requestRecords.size();
+        header.requestOffset = header.loanOffset + header.loanCount * sizeof(LoanRecord);
+        vector<PreparedLegRecord> preparedLegs;
+        {
+            lock_guard<mutex> lock(preparedMtx);
+            for (const auto& entry : prepared) {
+                for (const TransferLeg& leg : entry.second) {
+                    preparedLegs.push_back(PreparedLegRecord{entry.first, leg.from, leg.to, leg.amount.getCents()});
+                }
+            }
+        }
+        header.preparedCount = preparedLegs.size();
+        header.preparedOffset = header.requestOffset + header.requestCount * sizeof(RequestRecord);
+        header.stringOffset = header.preparedOffset + header.preparedCount * sizeof(PreparedLegRecord);
+
+        SnapshotSection index(fd, header.indexOffset);
+        SnapshotSection txns(fd, header.txnOffset);
+        SnapshotSection loanOut(fd, header.loanOffset);
+        SnapshotSection strings(fd, header.stringOffset);
+        uint32_t indexSum = checksum(nullptr, 0);
+        uint64_t nextTxn = 0, nextLoan = 0;
+        bool historyOk = true;
+        forEachAccount([&](const Account* acc) {
+            AccountRecord rec = {};
+            historyOk = acc->toRecord(rec, nextTxn, nextLoan, txns, loanOut, strings) && historyOk;
+            nextTxn += rec.txnCount;
+            nextLoan += rec.loanCount;
+            indexSum = checksum(reinterpret_cast<const char*>(&rec), sizeof(rec), indexSum);
+            index.append(&rec, sizeof(rec));
+        });
+        if (!historyOk) {
+            ::close(fd);
+            ::unlink(tmpName.c_str());
+            return false;
+        }
+        SnapshotSection requestOut(fd, header.requestOffset);
+        if (!requestRecords.empty()) {
+            requestOut.append(requestRecords.data(), requestRecords.size() * sizeof(RequestRecord));
+        }
+        SnapshotSection preparedOut(fd, header.preparedOffset);
+        if (!preparedLegs.empty()) {
+            preparedOut.append(preparedLegs.data(), preparedLegs.size() * sizeof(PreparedLegRecord));
+        }
+        index.flush();
+        txns.flush();
+        loanOut.flush();
+        requestOut.flush();
+        preparedOut.flush();
+        strings.flush();
+        header.indexChecksum = indexSum;
+
+        bool ok = index.good() && txns.good() && loanOut.good() && requestOut.good() &&
+                  preparedOut.good() && strings.good() &&
+                  pwriteAll(fd, reinterpret_cast<const char*>(&header), sizeof(header), 0) &&
+                  ::fsync(fd) == 0;
+        ::close(fd);
+        if (!ok || ::rename(tmpName.c_str(), filename.c_str()) != 0) {
+            ::unlink(tmpName.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Points every account's history at the snapshot just written. Callers
+    // hold stateLock exclusively, so the accounts are in the order written.
+    bool attachSnapshotHistory(const string& filename) {
+        auto file = MappedFile::open(filename);
+        if (!file) return false;
+        SnapshotHeader header;
+        memcpy(&header, file->data(), sizeof(header));
+        const AccountRecord* index = reinterpret_cast<const AccountRecord*>(file->data() + header.indexOffset);
+        const Transaction* txns = reinterpret_cast<const Transaction*>(file->data() + header.txnOffset);
+        file->advise(header.txnOffset, header.loanOffset - header.txnOffset, MADV_RANDOM);
+        size_t i = 0;
+        bool ok = true;
+        forEachAccount([&](Account* acc) {
+            const AccountRecord& rec = index[i++];
+            if (!ok || rec.accountId != acc->getAccountId()) {
+                ok = false;
+                return;
+            }
+            lock_guard<mutex> lock(acc->getMutex());
+            acc->getHistory().attach(file, txns + rec.firstTxn, rec.txnCount);
+        });
+        return ok;
+    }
+
+public:
+    bool saveToFile(const string& filename) {
+        lock_guard<StripedSharedMutex> quiesce(stateLock);
+        return writeSnapshot(filename, journal ? journal->lastSeq() : journalPosition);
+    }
+
+    // Maps a snapshot and rebuilds the accounts from its index. Only the
+    // index is read here; transaction history is paged in when displayed.
+    // Snapshots of other format versions are refused, not converted.
+    // False, with error set and the accounts untouched, if the file cannot
+    // be loaded.
+    bool loadFromFile(const string& filename, uint64_t& snapshotSeq, string& error) {
+        auto file = MappedFile::open(filename);
+        if (!file || file->size() < sizeof(SnapshotHeader)) {
+            error = "cannot read " + filename;
+            return false;
+        }
+        SnapshotHeader header;
+        memcpy(&header, file->data(), sizeof(header));
+        if (header.magic != SNAPSHOT_MAGIC) {
+            error = filename + " is not a bank snapshot";
+            return false;
+        }
+        if (header.version != SNAPSHOT_VERSION) {
+            error = filename + " is snapshot format version " + to_string(header.version) +
+                    "; this build reads only version " + to_string(SNAPSHOT_VERSION);
+            return false;
+        }
+        error = filename + " is corrupt";
+
+        uint64_t size = file->size();
+        if (header.accountCount > size / sizeof(AccountRecord) ||
+            header.txnCount > size / sizeof(Transaction) ||
+            header.loanCount > size / sizeof(LoanRecord) ||
+            header.requestCount > size / sizeof(RequestRecord) ||
+            header.preparedCount > size / sizeof(PreparedLegRecord) ||
+            header.indexOffset + header.accountCount * sizeof(AccountRecord) > header.txnOffset ||
+            header.txnOffset + header.txnCount * sizeof(Transaction) > header.loanOffset ||
+            header.loanOffset + header.loanCount * sizeof(LoanRecord) > header.requestOffset ||
+            header.requestOffset + header.requestCount * sizeof(RequestRecord) > header.preparedOffset ||
+            header.preparedOffset + header.preparedCount * sizeof(PreparedLegRecord) > header.stringOffset ||
+            header.stringOffset > size) {
+            return false;
+        }
+        const AccountRecord* index = reinterpret_cast<const AccountRecord*>(file->data() + header.indexOffset);
+        if (checksum(reinterpret_cast<const char*>(index),
+                     header.accountCount * sizeof(AccountRecord)) != header.indexChecksum) {
+            return false;
+        }
+        file->advise(header.txnOffset, header.loanOffset - header.txnOffset, MADV_RANDOM);
+
+        uint64_t stringBytes = size - header.stringOffset;
+        SlabPool<SavingsAccount> loadedSavings;
+        SlabPool<CheckingAccount> loadedChecking;
+        vector<vector<Account*>> loaded(SHARD_COUNT);
+        for (uint64_t i = 0; i < header.accountCount; ++i) {
+            const AccountRecord& rec = index[i];
+            if (rec.firstTxn + rec.txnCount > header.txnCount ||
+                rec.firstLoan + rec.loanCount > header.loanCount ||
+                rec.nameOffset + rec.nameLength > stringBytes) {
+                return false;
+            }
+            Account* acc = Account::fromRecord(rec, header, file, loadedSavings, loadedChecking);
+            if (!acc) return false;
+            acc->getHistory().setSpill(spill.get());
+            acc->setChangeFeed(changeFeed.get());
+            loaded[shardIndex(acc->getAccountId())].push_back(acc);
+        }
+        vector<AccountIndex> indexes(SHARD_COUNT);
+        vector<Account*> all;
+        all.reserve(header.accountCount);
+        for (size_t i = 0; i < SHARD_COUNT; ++i) {
+            indexes[i].reserve(loaded[i].size());
+            for (Account* acc : loaded[i]) {
+                if (!indexes[i].insert(acc->getAccountId(), acc)) return false;
+            }
+            all.insert(all.end(), loaded[i].begin(), loaded[i].end());
+        }
+        NameIndex loadedNames;
+        loadedNames.assign(all);
+        lock_guard<StripedSharedMutex> quiesce(stateLock);
+        names.swap(loadedNames);
+        savingsRegistry.clear();
+        borrowerRegistry.clear();
+        for (size_t i = 0; i < SHARD_COUNT; ++i) {
+            unique_lock<shared_mutex> lock(shards[i].mtx);
+            swap(shards[i].index, indexes[i]);
+            for (Account* acc : loaded[i]) {
+                registerSavings(acc);
+                if (acc->getLoanCount() > 0) {
+                    borrowerRegistry.add(acc);
+                }
+            }
+        }
+        // The accounts being replaced are destroyed with the local pools
+        savingsPool.swap(loadedSavings);
+        checkingPool.swap(loadedChecking);
+        rebuildTotals();
+        requests.clear();
+        for (uint64_t i = 0; i < header.requestCount; ++i) {
+            RequestRecord rec;
+            memcpy(&rec, file->data() + header.requestOffset + i * sizeof(RequestRecord), sizeof(rec));
+            requests.restore(rec.requestId, rec.fingerprint, static_cast<TxnStatus>(rec.status), rec.at);
+        }
+        // Holds are not stored with the accounts; placing the prepared
+        // transfers' holds again restores them
+        lock_guard<mutex> lock(preparedMtx);
+        prepared.clear();
+        abortedEarly.clear();
+        for (uint64_t i = 0; i < header.preparedCount; ++i) {
+            PreparedLegRecord rec;
+            memcpy(&rec, file->data() + header.preparedOffset + i * sizeof(PreparedLegRecord), sizeof(rec));
+            Money amount = Money::fromCents(rec.amount);
+            prepared[rec.transferId].push_back(TransferLeg{rec.from, rec.to, amount});
+            if (Account* from = lookup(rec.from)) from->hold(amount);
+        }
+        snapshotSeq = header.journalSeq;
+        // Ids the snapshot holds, or its writer had issued, are never issued again
+        IdGenerator::advancePast(header.idHighWater);
+        error.clear();
+        return true;
+    }
+
+    // Lets accounts created or loaded from now on move old history chunks
+    // to the given file
+    bool enableHistorySpill(const string& path) {
+        spill.reset(new SpillFile());
+        if (!spill->open(path)) {
+            spill.reset();
+            return false;
+        }
+        return true;
+    }
+
+    // Loads the latest snapshot, replays the journal tail past it, and
+    // reopens the journal for appends. A missing snapshot means a new bank,
+    // but one that exists and cannot be loaded, or a journal that cannot be
+    // replayed, fails recovery: report.error says why, nothing is replayed,
+    // no journal is opened and checkpoint refuses to overwrite the files.
+    RecoveryReport recover(const string& snapshotFile, const string& journalFile) {
+        RecoveryReport report;
+        snapshotPath = snapshotFile;
+        recoveryFailed = true;
+        journal.reset();
+        enableHistorySpill(snapshotFile + ".spill");
+        uint64_t snapshotSeq = 0;
+        struct stat st;
+        if (::stat(snapshotFile.c_str(), &st) == 0) {
+            if (!loadFromFile(snapshotFile, snapshotSeq, report.error)) return report;
+            report.snapshotLoaded = true;
+        }
+
+        uint64_t lastSeq;
+        size_t validBytes;
+        // Replayed operations were screened when they first ran
+        unique_ptr<RiskEngine> rules = move(risk);
+        string conflict;
+        replayedIds = 0;
+        bool replayed = Journal::replay(journalFile, snapshotSeq, lastSeq, validBytes,
+            [this, &report, &conflict, &journalFile](JournalOp op, BinaryReader& r) {
+                if (!applyJournalRecord(op, r) && conflict.empty()) {
+                    conflict = journalFile + " opens an account under an id already in use";
+                }
+                ++report.replayed;
+            }, report.error);
+        risk = move(rules);
+        if (replayed && !conflict.empty()) {
+            report.error = conflict;
+            replayed = false;
+        }
+        if (!replayed) return report;
+        // A restarted generator could otherwise issue the replayed ids again
+        IdGenerator::advancePast(replayedIds);
+        recoveryFailed = false;
+        journalPosition = lastSeq;
+
+        // Cut off a torn tail so new records follow the last intact one
+        if (::truncate(journalFile.c_str(), validBytes) != 0 && validBytes > 0) {
+            report.journalTrimmed = false;
+        }
+        journal.reset(new Journal());
+        if (!journal->open(journalFile, lastSeq)) {
+            report.journalOpen = false;
+            journal.reset();
+        }
+        return report;
+    }
+
+    // Folds the journal into a fresh snapshot and starts a new journal.
+    // Histories are then served from the new snapshot, which frees their
+    // in-memory chunks and empties the spill file.
+    bool checkpoint() {
+        if (snapshotPath.empty() || recoveryFailed) return false;
+        lock_guard<StripedSharedMutex> quiesce(stateLock);
+        if (!writeSnapshot(snapshotPath, journal ? journal->lastSeq() : journalPosition)) return false;
+        if (attachSnapshotHistory(snapshotPath) && spill) {
+            spill->reset();
+        }
+        return !journal || journal->truncate();
+    }
+
+    // How many request results are kept for deduplication, and for how
+    // long. Set it before operations start.
+    void setRequestRetention(size_t capacity, int64_t retentionNanos) {
+        requests.configure(capacity, retentionNanos);
+    }
+
+    size_t getRequestCount() {
+        return requests.size();
+    }
+
+    // Replaces the fraud and velocity rules (see RiskEngine for the
+    // format) and empties their windows; empty text removes them. False,
+    // with error set, if the rules are invalid; the old ones then stay.
+    bool setRiskRules(const string& text, string& error) {
+        unique_ptr<RiskEngine> rules;
+        if (text.find_first_not_of(" \t\r\n") != string::npos) {
+            rules = RiskEngine::compile(text, error);
+            if (!rules) return false;
+            if (rules->ruleCount() == 0) rules.reset();
+        }
+        lock_guard<StripedSharedMutex> quiesce(stateLock);
+        forEachAccount([](Account* acc) { acc->riskCountersSlot() = nullptr; });
+        risk = move(rules);
+        return true;
+    }
+
+    bool loadRiskRules(const string& filename, string& error) {
+        string text;
+        if (!readWholeFile(filename, text)) {
+            error = "cannot read " + filename;
+            return false;
+        }
+        return setRiskRules(text, error);
+    }
+
+    // Every rule with how often it has tripped
+    vector<RiskRuleStats> getRiskRuleStats() {
+        shared_lock<shared_mutex> state(stateLock.local());
+        return risk ? risk->stats() : vector<RiskRuleStats>();
+    }
+
+    size_t getAccountCount() const {
+        return savingsPool.size() + checkingPool.size();
+    }
+    string getBankName() const { return bankName; }
+};
+
+#endif
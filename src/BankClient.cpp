@@ -0,0 +1,178 @@
+#include "BankClient.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+bool BankClient::connect(const string& host, uint16_t port) {
+    disconnect();
+    fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+        ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        disconnect();
+        return false;
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return true;
+}
+
+void BankClient::disconnect() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    outgoing.clear();
+    incoming.clear();
+    incomingStart = 0;
+}
+
+void BankClient::end() {
+    uint32_t len = static_cast<uint32_t>(request.size());
+    outgoing.append(reinterpret_cast<const char*>(&len), sizeof(len));
+    outgoing += request.data();
+}
+
+void BankClient::createAccount(AccountKind kind, const string& name, Money opening) {
+    begin(kind == AccountKind::SAVINGS ? ServiceOp::CREATE_SAVINGS : ServiceOp::CREATE_CHECKING);
+    request.str(name);
+    request.money(opening);
+    end();
+}
+
+void BankClient::deposit(uint64_t id, Money amt, uint64_t requestId) {
+    begin(ServiceOp::DEPOSIT);
+    request.u64(id);
+    request.money(amt);
+    request.u64(requestId);
+    end();
+}
+
+void BankClient::withdraw(uint64_t id, Money amt, uint64_t requestId) {
+    begin(ServiceOp::WITHDRAW);
+    request.u64(id);
+    request.money(amt);
+    request.u64(requestId);
+    end();
+}
+
+void BankClient::transfer(uint64_t from, uint64_t to, Money amt, uint64_t requestId) {
+    begin(ServiceOp::TRANSFER);
+    request.u64(from);
+    request.u64(to);
+    request.money(amt);
+    request.u64(requestId);
+    end();
+}
+
+void BankClient::balance(uint64_t id) {
+    begin(ServiceOp::BALANCE);
+    request.u64(id);
+    end();
+}
+
+void BankClient::history(uint64_t id, uint8_t types, uint32_t limit, int64_t from, int64_t to) {
+    begin(ServiceOp::HISTORY);
+    request.u64(id);
+    request.u8(types);
+    request.u32(limit);
+    request.i64(from);
+    request.i64(to);
+    end();
+}
+
+void BankClient::applyLoan(uint64_t id, Money amt, int64_t rate, int months) {
+    begin(ServiceOp::APPLY_LOAN);
+    request.u64(id);
+    request.money(amt);
+    request.i64(rate);
+    request.i32(months);
+    end();
+}
+
+void BankClient::payLoan(uint64_t id, int loanIndex, Money amt) {
+    begin(ServiceOp::PAY_LOAN);
+    request.u64(id);
+    request.i32(loanIndex);
+    request.money(amt);
+    end();
+}
+
+void BankClient::loans(uint64_t id) {
+    begin(ServiceOp::LOANS);
+    request.u64(id);
+    end();
+}
+
+void BankClient::applyInterest(uint64_t id) {
+    begin(ServiceOp::APPLY_INTEREST);
+    request.u64(id);
+    end();
+}
+
+void BankClient::accrueInterest() {
+    begin(ServiceOp::ACCRUE_INTEREST);
+    end();
+}
+
+bool BankClient::send() {
+    const char* data = outgoing.data();
+    size_t len = outgoing.size();
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    outgoing.clear();
+    return true;
+}
+
+// Reads until at least `bytes` unread bytes are buffered
+bool BankClient::fill(size_t bytes) {
+    if (incomingStart > 0 && incoming.size() - incomingStart < bytes) {
+        incoming.erase(0, incomingStart);
+        incomingStart = 0;
+    }
+    while (incoming.size() - incomingStart < bytes) {
+        size_t have = incoming.size();
+        incoming.resize(have + max<size_t>(bytes, 64 << 10));
+        ssize_t n = ::recv(fd, &incoming[have], incoming.size() - have, 0);
+        incoming.resize(have + max<ssize_t>(n, 0));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BankClient::receive(TxnStatus& status, BinaryReader& body) {
+    if (fd < 0) return false;
+    uint32_t len;
+    if (!fill(sizeof(len))) return false;
+    memcpy(&len, incoming.data() + incomingStart, sizeof(len));
+    if (len == 0 || !fill(sizeof(len) + len)) return false;
+    const char* reply = incoming.data() + incomingStart + sizeof(len);
+    status = static_cast<TxnStatus>(static_cast<uint8_t>(reply[0]));
+    body = BinaryReader(reply + 1, len - 1);
+    incomingStart += sizeof(len) + len;
+    if (incomingStart == incoming.size()) {
+        // body still points into the buffer; it is reused on the next call
+        incomingStart = 0;
+        incoming.resize(0);
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef BANKING_BANK_CLIENT_H
+#define BANKING_BANK_CLIENT_H
+
+#include <string>
+
+#include "Account.h"
+#include "BankProtocol.h"
+#include "Storage.h"
+
+using namespace std;
+
+// Blocking client for a BankServer. Request calls only queue the request;
+// send() writes everything queued in one go, and receive() reads replies
+// one at a time in request order, so any number of requests can be in
+// flight on the connection.
+class BankClient {
+private:
+    int fd;
+    BinaryWriter request;       // the request being queued
+    string outgoing;
+    string incoming;
+    size_t incomingStart;       // first byte of the next reply
+
+    void begin(ServiceOp op) {
+        request.clear();
+        request.u8(static_cast<uint8_t>(op));
+    }
+    void end();
+    bool fill(size_t bytes);
+
+public:
+    BankClient() : fd(-1), incomingStart(0) {}
+    ~BankClient() { disconnect(); }
+    BankClient(const BankClient&) = delete;
+    BankClient& operator=(const BankClient&) = delete;
+
+    bool connect(const string& host, uint16_t port);
+    void disconnect();
+
+    void createAccount(AccountKind kind, const string& name, Money opening);
+    void deposit(uint64_t id, Money amt, uint64_t requestId = 0);
+    void withdraw(uint64_t id, Money amt, uint64_t requestId = 0);
+    void transfer(uint64_t from, uint64_t to, Money amt, uint64_t requestId = 0);
+    void balance(uint64_t id);
+    // The newest `limit` (0 for all) records of the given types in [from, to]
+    void history(uint64_t id, uint8_t types, uint32_t limit, int64_t from = INT64_MIN,
+                 int64_t to = INT64_MAX);
+    void applyLoan(uint64_t id, Money amt, int64_t rate, int months);
+    void payLoan(uint64_t id, int loanIndex, Money amt);
+    void loans(uint64_t id);
+    void applyInterest(uint64_t id);
+    void accrueInterest();
+
+    bool send();
+    // Reads the next reply. body holds its result (see BankProtocol.h)
+    // until the next call; false if the connection failed.
+    bool receive(TxnStatus& status, BinaryReader& body);
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef BANKING_BANK_PROTOCOL_H
+#define BANKING_BANK_PROTOCOL_H
+
+#include <cstdint>
+
+using namespace std;
+
+// Wire format of the bank's network service (BankServer, BankClient).
+// Every message is [u32 length][payload], little-endian like the journal.
+// A request payload is [u8 op][fields]; the reply payload is [u8 status]
+// followed, only when the status is OK, by the op's result. Replies come
+// back on the connection in request order, so a client may send many
+// requests before reading any reply.
+//
+//   op                fields                                  result
+//   CREATE_SAVINGS    str name, i64 opening cents             u64 account id
+//   CREATE_CHECKING   str name, i64 opening cents             u64 account id
+//   DEPOSIT           u64 account, i64 cents, u64 request id  -
+//   WITHDRAW          u64 account, i64 cents, u64 request id  -
+//   TRANSFER          u64 from, u64 to, i64 cents,            -
+//                     u64 request id
+//   BALANCE           u64 account                             str holder, u8 kind,
+//                                                             i64 balance, i64 available,
+//                                                             i64 loans outstanding
+//   HISTORY           u64 account, u8 type mask,              u32 count, then per record
+//                     u32 limit (0 = all), i64 from, i64 to   u64 id, i64 time, u8 type,
+//                                                             i64 cents, u64 counterparty
+//   APPLY_LOAN        u64 account, i64 cents, i64 rate ppm,   -
+//                     i32 months
+//   PAY_LOAN          u64 account, i32 loan index, i64 cents  -
+//   LOANS             u64 account                             u32 count, then per loan
+//                                                             u64 id, i64 principal, i64 rate,
+//                                                             i32 term, i32 paid,
+//                                                             i64 installment, i64 remaining,
+//                                                             u8 active
+//   APPLY_INTEREST    u64 account                             i64 interest cents
+//   ACCRUE_INTEREST   -                                       u64 accounts, i64 total cents
+//
+// A str is [u32 length][bytes]. Request id 0 means none (see Bank::deposit).
+// CREATE_* replies OK only once the opening deposit is made too; a
+// negative one is INVALID_AMOUNT and opens nothing, and any other refusal
+// is the deposit's status (the account then stays open and empty).
+// HISTORY returns the newest `limit` matching records with from <= time
+// <= to, oldest first. A request the server cannot parse closes the
+// connection.
+enum class ServiceOp : uint8_t {
+    CREATE_SAVINGS = 1,
+    CREATE_CHECKING = 2,
+    DEPOSIT = 3,
+    WITHDRAW = 4,
+    TRANSFER = 5,
+    BALANCE = 6,
+    HISTORY = 7,
+    APPLY_LOAN = 8,
+    PAY_LOAN = 9,
+    LOANS = 10,
+    APPLY_INTEREST = 11,
+    ACCRUE_INTEREST = 12
+};
+
+// Largest request the server accepts; replies are not limited
+const uint32_t MAX_SERVICE_REQUEST = 1u << 20;
+
+#endif
@@ -0,0 +1,371 @@
+#include "BankServer.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+// Bytes asked of the socket per read
+const size_t READ_SIZE = 64 << 10;
+// Unsent reply bytes at which a connection stops being read
+const size_t MAX_QUEUED = 4 << 20;
+
+} // namespace
+
+bool BankServer::start(uint16_t port, unsigned reactorCount, const string& host) {
+    if (!reactors.empty()) return false;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) return false;
+    stopping = false;
+
+    for (unsigned i = 0; i < max(1u, reactorCount); ++i) {
+        reactors.push_back(make_unique<Reactor>());
+        Reactor& r = *reactors.back();
+        int one = 1;
+        socklen_t addrLen = sizeof(addr);
+        // The first listener picks the port when asked for any; the rest
+        // share it
+        addr.sin_port = htons(i == 0 ? port : boundPort);
+        r.listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        r.epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        r.wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event listenEvent{};
+        listenEvent.events = EPOLLIN;
+        listenEvent.data.fd = r.listenFd;
+        epoll_event wakeEvent{};
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.fd = r.wakeFd;
+        if (r.listenFd < 0 || r.epollFd < 0 || r.wakeFd < 0 ||
+            ::setsockopt(r.listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+            ::setsockopt(r.listenFd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+            ::bind(r.listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(r.listenFd, SOMAXCONN) != 0 ||
+            ::getsockname(r.listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0 ||
+            ::epoll_ctl(r.epollFd, EPOLL_CTL_ADD, r.listenFd, &listenEvent) != 0 ||
+            ::epoll_ctl(r.epollFd, EPOLL_CTL_ADD, r.wakeFd, &wakeEvent) != 0) {
+            stop();
+            return false;
+        }
+        boundPort = ntohs(addr.sin_port);
+    }
+    for (auto& r : reactors) {
+        r->worker = thread(&BankServer::run, this, ref(*r));
+    }
+    return true;
+}
+
+void BankServer::stop() {
+    if (reactors.empty()) return;
+    stopping = true;
+    for (auto& r : reactors) {
+        uint64_t one = 1;
+        if (r->wakeFd >= 0) {
+            ssize_t n = ::write(r->wakeFd, &one, sizeof(one));
+            (void)n;
+        }
+    }
+    for (auto& r : reactors) {
+        if (r->worker.joinable()) r->worker.join();
+        for (auto& c : r->connections) {
+            if (c) ::close(c->fd);
+        }
+        for (int fd : {r->listenFd, r->wakeFd, r->epollFd}) {
+            if (fd >= 0) ::close(fd);
+        }
+    }
+    reactors.clear();
+}
+
+void BankServer::run(Reactor& r) {
+    epoll_event events[64];
+    while (!stopping) {
+        int n = ::epoll_wait(r.epollFd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < n && !stopping; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == r.wakeFd) continue;
+            if (fd == r.listenFd) {
+                acceptAll(r);
+                continue;
+            }
+            Connection* c = static_cast<size_t>(fd) < r.connections.size() ? r.connections[fd].get() : nullptr;
+            if (!c) continue;
+            if ((events[i].events & EPOLLOUT) && !flush(r, *c)) continue;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) onReadable(r, *c);
+        }
+    }
+}
+
+void BankServer::acceptAll(Reactor& r) {
+    while (true) {
+        int fd = ::accept4(r.listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (::epoll_ctl(r.epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            ::close(fd);
+            continue;
+        }
+        if (static_cast<size_t>(fd) >= r.connections.size()) r.connections.resize(fd + 1);
+        r.connections[fd] = make_unique<Connection>();
+        r.connections[fd]->fd = fd;
+        r.connections[fd]->events = EPOLLIN;
+    }
+}
+
+// Reads once, runs every complete request received so far and sends their
+// replies together
+void BankServer::onReadable(Reactor& r, Connection& c) {
+    if (c.in.size() - c.inEnd < READ_SIZE) c.in.resize(c.inEnd + READ_SIZE);
+    ssize_t n = ::recv(c.fd, c.in.data() + c.inEnd, c.in.size() - c.inEnd, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (n <= 0) {
+        drop(r, c);
+        return;
+    }
+    c.inEnd += n;
+
+    bool valid = true;
+    size_t durableOut = c.out.size();
+    {
+        // Replies are sent only once the batch is durable
+        Bank::CommitBatch batch(bank);
+        while (c.inEnd - c.inStart >= sizeof(uint32_t)) {
+            uint32_t len;
+            memcpy(&len, c.in.data() + c.inStart, sizeof(len));
+            if (len == 0 || len > MAX_SERVICE_REQUEST) {
+                valid = false;
+                break;
+            }
+            if (c.inEnd - c.inStart - sizeof(len) < len) break;
+            if (!handle(c.in.data() + c.inStart + sizeof(len), len, c.out)) {
+                valid = false;
+                break;
+            }
+            c.inStart += sizeof(len) + len;
+        }
+        // If the journal failed, the batch's replies would claim changes
+        // that may not survive a restart: they are not sent, and dropping
+        // the connection leaves their outcome unknown to the client
+        if (!batch.wait()) {
+            c.out.resize(durableOut);
+            valid = false;
+        }
+    }
+    // Keeps a partial request at the front of the buffer
+    if (c.inStart == c.inEnd) {
+        c.inStart = c.inEnd = 0;
+    } else if (c.inStart > 0) {
+        memmove(c.in.data(), c.in.data() + c.inStart, c.inEnd - c.inStart);
+        c.inEnd -= c.inStart;
+        c.inStart = 0;
+    }
+
+    // The replies to requests before a malformed one are still sent
+    if (flush(r, c) && !valid) drop(r, c);
+}
+
+// Sends queued replies and registers for what the connection waits on
+// next; false if the connection was dropped
+bool BankServer::flush(Reactor& r, Connection& c) {
+    while (c.outSent < c.out.size()) {
+        ssize_t n = ::send(c.fd, c.out.data() + c.outSent, c.out.size() - c.outSent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            drop(r, c);
+            return false;
+        }
+        c.outSent += n;
+    }
+    uint32_t events = EPOLLIN;
+    if (c.outSent == c.out.size()) {
+        c.out.clear();
+        c.outSent = 0;
+    } else {
+        c.out.erase(0, c.outSent);
+        c.outSent = 0;
+        events = c.out.size() > MAX_QUEUED ? EPOLLOUT : EPOLLIN | EPOLLOUT;
+    }
+    if (events != c.events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = c.fd;
+        ::epoll_ctl(r.epollFd, EPOLL_CTL_MOD, c.fd, &event);
+        c.events = events;
+    }
+    return true;
+}
+
+void BankServer::drop(Reactor& r, Connection& c) {
+    int fd = c.fd;
+    ::close(fd);
+    r.connections[fd].reset();
+}
+
+bool BankServer::handle(const char* data, size_t len, string& out) {
+    BinaryReader in(data, len);
+    ServiceOp op = static_cast<ServiceOp>(in.u8());
+    BinaryWriter result;
+    TxnStatus status = TxnStatus::OK;
+    switch (op) {
+        case ServiceOp::CREATE_SAVINGS:
+        case ServiceOp::CREATE_CHECKING: {
+            string name = in.str();
+            Money opening = Money::fromCents(in.i64());
+            if (!in.good()) return false;
+            result.u64(op == ServiceOp::CREATE_SAVINGS ? bank.createSavingsAccount(name, opening, status)
+                                                       : bank.createCheckingAccount(name, opening, status));
+            break;
+        }
+        case ServiceOp::DEPOSIT:
+        case ServiceOp::WITHDRAW: {
+            uint64_t id = in.u64();
+            Money amt = Money::fromCents(in.i64());
+            uint64_t requestId = in.u64();
+            if (!in.good()) return false;
+            status = op == ServiceOp::DEPOSIT ? bank.deposit(id, amt, requestId)
+                                              : bank.withdraw(id, amt, requestId);
+            break;
+        }
+        case ServiceOp::TRANSFER: {
+            uint64_t from = in.u64();
+            uint64_t to = in.u64();
+            Money amt = Money::fromCents(in.i64());
+            uint64_t requestId = in.u64();
+            if (!in.good()) return false;
+            status = bank.transfer(from, to, amt, requestId);
+            break;
+        }
+        case ServiceOp::BALANCE: {
+            uint64_t id = in.u64();
+            if (!in.good()) return false;
+            Account* acc = bank.findAccount(id);
+            if (!acc) {
+                status = TxnStatus::ACCOUNT_NOT_FOUND;
+                break;
+            }
+            lock_guard<mutex> lock(acc->getMutex());
+            result.str(acc->getAccountHolder());
+            result.u8(static_cast<uint8_t>(acc->getKind()));
+            result.money(acc->getBalance());
+            result.money(acc->getAvailableBalance());
+            result.money(acc->getOutstandingLoans());
+            break;
+        }
+        case ServiceOp::HISTORY: {
+            uint64_t id = in.u64();
+            uint8_t types = in.u8();
+            uint32_t limit = in.u32();
+            int64_t from = in.i64();
+            int64_t to = in.i64();
+            if (!in.good()) return false;
+            Account* acc = bank.findAccount(id);
+            if (!acc) {
+                status = TxnStatus::ACCOUNT_NOT_FOUND;
+                break;
+            }
+            vector<Transaction> records;
+            {
+                lock_guard<mutex> lock(acc->getMutex());
+                const TransactionHistory& history = acc->getHistory();
+                if (from == INT64_MIN && to == INT64_MAX) {
+                    records = history.last(limit ? limit : SIZE_MAX, types);
+                } else {
+                    records = history.between(from, to, types);
+                }
+            }
+            if (limit && records.size() > limit) records.erase(records.begin(), records.end() - limit);
+            result.u32(static_cast<uint32_t>(records.size()));
+            for (const Transaction& t : records) {
+                result.u64(t.getId());
+                result.i64(t.getTimestamp());
+                result.u8(static_cast<uint8_t>(t.getType()));
+                result.money(t.getAmount());
+                result.u64(t.getCounterparty());
+            }
+            break;
+        }
+        case ServiceOp::APPLY_LOAN: {
+            uint64_t id = in.u64();
+            Money amt = Money::fromCents(in.i64());
+            int64_t rate = in.i64();
+            int32_t months = in.i32();
+            if (!in.good()) return false;
+            status = bank.applyLoan(id, amt, rate, months);
+            break;
+        }
+        case ServiceOp::PAY_LOAN: {
+            uint64_t id = in.u64();
+            int32_t loanIndex = in.i32();
+            Money amt = Money::fromCents(in.i64());
+            if (!in.good()) return false;
+            status = bank.payLoan(id, loanIndex, amt);
+            break;
+        }
+        case ServiceOp::LOANS: {
+            uint64_t id = in.u64();
+            if (!in.good()) return false;
+            Account* acc = bank.findAccount(id);
+            if (!acc) {
+                status = TxnStatus::ACCOUNT_NOT_FOUND;
+                break;
+            }
+            lock_guard<mutex> lock(acc->getMutex());
+            result.u32(static_cast<uint32_t>(acc->getLoanCount()));
+            for (size_t i = 0; i < acc->getLoanCount(); ++i) {
+                const Loan& loan = acc->getLoan(i);
+                result.u64(loan.getLoanId());
+                result.money(loan.getPrincipal());
+                result.i64(loan.getInterestRate());
+                result.i32(loan.getTermMonths());
+                result.i32(loan.getPaymentsMade());
+                result.money(loan.getMonthlyPayment());
+                result.money(loan.getRemainingBalance());
+                result.u8(loan.getIsActive() ? 1 : 0);
+            }
+            break;
+        }
+        case ServiceOp::APPLY_INTEREST: {
+            uint64_t id = in.u64();
+            if (!in.good()) return false;
+            Money interest;
+            status = bank.applyInterest(id, interest);
+            result.money(interest);
+            break;
+        }
+        case ServiceOp::ACCRUE_INTEREST: {
+            InterestRunSummary summary = bank.accrueInterestAll();
+            result.u64(summary.accountsCredited);
+            result.money(summary.totalInterest);
+            break;
+        }
+        default:
+            return false;
+    }
+
+    uint32_t replyLen = 1 + (status == TxnStatus::OK ? static_cast<uint32_t>(result.size()) : 0);
+    out.append(reinterpret_cast<const char*>(&replyLen), sizeof(replyLen));
+    out.push_back(static_cast<char>(status));
+    if (status == TxnStatus::OK) out += result.data();
+    return true;
+}
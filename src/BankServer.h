@@ -0,0 +1,69 @@
+#ifndef BANKING_BANK_SERVER_H
+#define BANKING_BANK_SERVER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Bank.h"
+#include "BankProtocol.h"
+
+using namespace std;
+
+// Serves a Bank over TCP with the protocol in BankProtocol.h. Runs a fixed
+// number of reactor threads, each with its own epoll set and its own
+// listening socket on the shared port (SO_REUSEPORT), so the kernel
+// spreads connections over them and a connection stays on one thread.
+// Sockets are non-blocking. A reactor reads what a connection has sent,
+// runs every complete request in it in order, and writes all their
+// replies with one send, after one wait for the journal to make the
+// batch durable (Bank::CommitBatch). A connection whose replies are not
+// being read stops being read once enough of them are queued.
+class BankServer {
+private:
+    struct Connection {
+        int fd;
+        vector<char> in;
+        size_t inStart = 0;         // first unparsed byte
+        size_t inEnd = 0;           // end of received data
+        string out;
+        size_t outSent = 0;
+        uint32_t events = 0;        // registered with epoll
+    };
+
+    struct Reactor {
+        int epollFd = -1;
+        int listenFd = -1;
+        int wakeFd = -1;            // eventfd that stop() signals
+        thread worker;
+        // Indexed by fd
+        vector<unique_ptr<Connection>> connections;
+    };
+
+    Bank& bank;
+    uint16_t boundPort;
+    atomic<bool> stopping;
+    vector<unique_ptr<Reactor>> reactors;
+
+    void run(Reactor& r);
+    void acceptAll(Reactor& r);
+    void onReadable(Reactor& r, Connection& c);
+    bool flush(Reactor& r, Connection& c);
+    void drop(Reactor& r, Connection& c);
+    // Runs one request and appends its framed reply; false if malformed
+    bool handle(const char* data, size_t len, string& out);
+
+public:
+    explicit BankServer(Bank& bank) : bank(bank), boundPort(0), stopping(false) {}
+    ~BankServer() { stop(); }
+
+    // Listens on host:port (port 0 picks a free port) with the given
+    // number of reactor threads; false if it cannot bind
+    bool start(uint16_t port, unsigned reactorCount = 1, const string& host = "127.0.0.1");
+    void stop();
+    uint16_t port() const { return boundPort; }
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "ChangeFeed.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+// Records written per write call at most
+const size_t WRITE_BATCH = 4096;
+
+// Wait before retrying a failed write, doubling up to the maximum
+const chrono::milliseconds FIRST_RETRY(10);
+const chrono::milliseconds MAX_RETRY(1000);
+
+} // namespace
+
+ChangeFeed::ChangeFeed(size_t capacity)
+    : fd(-1), fileSize(0), firstSequence(1), tail(0), head(0), taken(0), written(0), stalls(0), writeErrors(0),
+      skipped(0), discarded(0), failing(false), stopping(false) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    slots.reset(new Slot[size]);
+    mask = size - 1;
+    for (size_t i = 0; i < size; ++i) slots[i].ready.store(i, memory_order_relaxed);
+}
+
+bool ChangeFeed::open(const string& path) {
+    if (fd >= 0) return false;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    // A torn last record is dropped; numbering carries on after the last whole one
+    uint64_t whole = st.st_size - st.st_size % sizeof(ChangeRecord);
+    ChangeRecord last;
+    if ((whole != static_cast<uint64_t>(st.st_size) && ::ftruncate(fd, whole) != 0) ||
+        (whole > 0 && ::pread(fd, &last, sizeof(last), whole - sizeof(last)) != sizeof(last))) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    fileSize = whole;
+    firstSequence = whole > 0 ? last.sequence + 1 : 1;
+    writer = thread(&ChangeFeed::writeLoop, this);
+    return true;
+}
+
+void ChangeFeed::writeLoop() {
+    vector<ChangeRecord> batch;
+    batch.reserve(WRITE_BATCH);
+    uint64_t pos = head.load();
+    chrono::milliseconds retry = FIRST_RETRY;
+    chrono::steady_clock::time_point retryAt;
+    while (true) {
+        bool stop = stopping.load(memory_order_acquire);
+        bool failed = failing.load(memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & mask];
+            if (slot.ready.load(memory_order_acquire) != pos + 1) break;
+            if (batch.size() < WRITE_BATCH) {
+                batch.push_back(slot.record);
+            } else if (failed && tail.load(memory_order_relaxed) - pos > mask) {
+                // The batch is waiting on a failed write and publishers on
+                // the ring: let the oldest queued event go
+                discarded.fetch_add(1, memory_order_relaxed);
+            } else {
+                break;
+            }
+            slot.ready.store(pos + mask + 1, memory_order_release);
+            ++pos;
+            taken.store(pos, memory_order_release);
+        }
+        if (!batch.empty() && (!failed || stop || chrono::steady_clock::now() >= retryAt)) {
+            size_t bytes = batch.size() * sizeof(ChangeRecord);
+            // A retry first drops whatever part of the failed write got in,
+            // so it appends whole records after the last written one
+            if ((failed && ::ftruncate(fd, fileSize) != 0) ||
+                !writeAll(fd, reinterpret_cast<const char*>(batch.data()), bytes)) {
+                writeErrors.fetch_add(1, memory_order_relaxed);
+                failing.store(true, memory_order_release);
+                if (stop) break;
+                retryAt = chrono::steady_clock::now() + retry;
+                retry = min(retry * 2, MAX_RETRY);
+            } else {
+                fileSize += bytes;
+                retry = FIRST_RETRY;
+                failing.store(false, memory_order_release);
+                written.fetch_add(batch.size(), memory_order_relaxed);
+                batch.clear();
+                head.store(pos, memory_order_release);
+                continue;
+            }
+        }
+        if (stop && batch.empty() && pos == tail.load()) break;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+bool ChangeFeed::drain() const {
+    uint64_t target = tail.load();
+    while (writer.joinable() && head.load(memory_order_acquire) < target) {
+        if (failing.load(memory_order_acquire)) return false;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    return head.load(memory_order_acquire) >= target;
+}
+
+void ChangeFeed::stop() {
+    if (writer.joinable()) {
+        stopping.store(true, memory_order_release);
+        writer.join();
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef BANKING_CHANGE_FEED_H
+#define BANKING_CHANGE_FEED_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "Transaction.h"
+
+using namespace std;
+
+// One ledger event: a transaction as it was added to an account's history
+struct ChangeRecord {
+    uint64_t sequence;          // position in the stream, from 1, never reused
+    uint64_t account;
+    Transaction txn;
+};
+
+static_assert(sizeof(ChangeRecord) == 56, "change record layout changed");
+
+struct ChangeFeedStats {
+    uint64_t published;
+    uint64_t written;
+    uint64_t stalls;            // publishes that found the ring full and waited
+    uint64_t writeErrors;       // failed writes to the stream file, each retried
+    uint64_t dropped;           // events let go while writes were failing
+};
+
+// Change-data-capture stream of the ledger. Every transaction added to a
+// history is published here while its account's lock is held, so each
+// account's events are in history order, and a background writer appends
+// them to a file of raw ChangeRecords. The file has no header, so readers
+// can tail it and resume from any whole record; sequence numbers continue
+// from its last record when it is reopened.
+//
+// Publishing claims a slot of a bounded ring with one fetch_add and hands
+// the record over through the slot's own sequence word: no lock, and
+// producers only contend on the tail counter. A full ring makes publishers
+// wait for the writer rather than lose events. The writer works behind the
+// journal, so a crash can lose events still in the ring; the transactions
+// themselves are recovered from the journal but not published again.
+// A failed write is cut back off the file and retried with backoff, the
+// batch kept. Events that find the ring full meanwhile are dropped and
+// counted instead of waited for, so a failing file never holds up the
+// operations publishing to it (those already queued leave a gap in the
+// sequence numbers). Once stopping, a failed write gives up and leaves
+// the rest unwritten, which stats show as published but not written.
+class ChangeFeed {
+private:
+    struct alignas(64) Slot {
+        // pos + 1 once the record for ring position pos is in the slot,
+        // pos + capacity once the writer has taken it
+        atomic<uint64_t> ready;
+        ChangeRecord record;
+    };
+
+    unique_ptr<Slot[]> slots;
+    size_t mask;
+    int fd;
+    uint64_t fileSize;                      // bytes of whole records written; writer only
+    uint64_t firstSequence;
+    alignas(64) atomic<uint64_t> tail;
+    alignas(64) atomic<uint64_t> head;      // positions before it are written or dropped
+    atomic<uint64_t> taken;                 // next position the writer takes from the ring
+    atomic<uint64_t> written;
+    atomic<uint64_t> stalls;
+    atomic<uint64_t> writeErrors;
+    atomic<uint64_t> skipped;               // dropped before taking a position
+    atomic<uint64_t> discarded;             // dropped by the writer from the ring
+    atomic<bool> failing;                   // the last write failed
+    atomic<bool> stopping;
+    thread writer;
+
+    void writeLoop();
+
+public:
+    // capacity is rounded up to a power of two
+    explicit ChangeFeed(size_t capacity = 1 << 16);
+    ~ChangeFeed() { stop(); }
+
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    // Opens (or continues) the stream file and starts the writer
+    bool open(const string& path);
+
+    void publish(uint64_t account, const Transaction& txn) {
+        if (failing.load(memory_order_relaxed) &&
+            tail.load(memory_order_relaxed) - taken.load(memory_order_acquire) > mask) {
+            skipped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        uint64_t pos = tail.fetch_add(1, memory_order_relaxed);
+        Slot& slot = slots[pos & mask];
+        if (slot.ready.load(memory_order_acquire) != pos) {
+            // Not for long: a failing writer drops from the ring to free it
+            stalls.fetch_add(1, memory_order_relaxed);
+            while (slot.ready.load(memory_order_acquire) != pos) this_thread::yield();
+        }
+        slot.record = ChangeRecord{firstSequence + pos, account, txn};
+        slot.ready.store(pos + 1, memory_order_release);
+    }
+
+    // Waits until everything published so far is written. False, without
+    // waiting further, if writes are failing.
+    bool drain() const;
+    // Writes what is queued and stops the writer
+    void stop();
+
+    ChangeFeedStats stats() const {
+        uint64_t skips = skipped.load();
+        return ChangeFeedStats{tail.load() + skips, written.load(), stalls.load(), writeErrors.load(),
+                               skips + discarded.load()};
+    }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef BANKING_DATE_TIME_H
+#define BANKING_DATE_TIME_H
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Utility class for date/time operations. Records store raw nanosecond
+// timestamps; text is produced only for display. Formatting goes through a
+// per-thread cache of the last second formatted, so showing a history in
+// which many entries share a second calls localtime_r (which takes glibc's
+// timezone lock) once per distinct second rather than once per entry.
+class DateTime {
+private:
+    struct FormatCache {
+        time_t second = -1;
+        char text[32];
+    };
+
+    // Proleptic Gregorian calendar <-> days since 1970-01-01
+    static int64_t daysFromCivil(int64_t y, int m, int d) {
+        y -= m <= 2;
+        int64_t era = (y >= 0 ? y : y - 399) / 400;
+        int64_t yoe = y - era * 400;
+        int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
+
+    static void civilFromDays(int64_t z, int64_t& y, int& m, int& d) {
+        z += 719468;
+        int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        int64_t doe = z - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int64_t mp = (5 * doy + 2) / 153;
+        d = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+        m = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+        y = yoe + era * 400 + (m <= 2);
+    }
+
+    static int daysInMonth(int64_t y, int m) {
+        static const int DAYS[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+        return m == 2 && leap ? 29 : DAYS[m - 1];
+    }
+
+public:
+    // Wall-clock time in nanoseconds since the epoch
+    static int64_t nowNanos() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    // As nowNanos, but only as fine as the kernel tick (a few ms) and
+    // cheaper to read; for windows and expiry, not for timestamps
+    static int64_t coarseNanos() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    // "YYYY-MM-DD HH:MM:SS" in local time. The view stays valid until the
+    // calling thread formats a timestamp from a different second.
+    static string_view format(int64_t nanos) {
+        static thread_local FormatCache cache;
+        time_t seconds = nanos / 1000000000;
+        if (seconds != cache.second) {
+            struct tm local;
+            localtime_r(&seconds, &local);
+            strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S", &local);
+            cache.second = seconds;
+        }
+        return cache.text;
+    }
+
+    // Parses "YYYY-MM-DD" as local midnight
+    static bool parseDate(const string& text, int64_t& nanos) {
+        struct tm local = {};
+        const char* end = strptime(text.c_str(), "%Y-%m-%d", &local);
+        if (!end || *end != '\0') return false;
+        local.tm_isdst = -1;
+        time_t seconds = mktime(&local);
+        if (seconds == -1) return false;
+        nanos = static_cast<int64_t>(seconds) * 1000000000;
+        return true;
+    }
+
+    // The same time of day `months` calendar months later, in UTC, moved
+    // back to the last day of the month when that day does not exist (so
+    // Jan 31 + 1 month is Feb 28/29). Plain arithmetic with no library
+    // calls, so the end-of-day run can call it from every thread.
+    static int64_t addMonths(int64_t nanos, int months) {
+        const int64_t DAY = 86400LL * 1000000000;
+        int64_t days = nanos / DAY;
+        int64_t timeOfDay = nanos % DAY;
+        if (timeOfDay < 0) {
+            timeOfDay += DAY;
+            --days;
+        }
+        int64_t year;
+        int month, day;
+        civilFromDays(days, year, month, day);
+        int64_t index = year * 12 + (month - 1) + months;
+        year = index >= 0 ? index / 12 : (index - 11) / 12;
+        month = static_cast<int>(index - year * 12) + 1;
+        day = min(day, daysInMonth(year, month));
+        return daysFromCivil(year, month, day) * DAY + timeOfDay;
+    }
+
+    // The uncached path every record used to take; kept for --bench-clock
+    static string formatUncached(time_t seconds) {
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char buf[80];
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &local);
+        return string(buf);
+    }
+};
+
+#endif
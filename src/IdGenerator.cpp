@@ -0,0 +1,5 @@
+#include "IdGenerator.h"
+
+IdGenerator::Slot IdGenerator::slots[IdGenerator::SLOT_COUNT];
+atomic<uint64_t> IdGenerator::leased(0);
+atomic<uint32_t> IdGenerator::nodeId(0);
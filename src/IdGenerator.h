@@ -0,0 +1,125 @@
+#ifndef BANKING_ID_GENERATOR_H
+#define BANKING_ID_GENERATOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "DateTime.h"
+
+using namespace std;
+
+// Snowflake-style 64-bit id generator for transactions, loans and
+// accounts. An id packs, from the top bit down:
+//   41 bits  milliseconds since 2024-01-01 UTC
+//    7 bits  node id, so several bank processes never collide
+//    6 bits  generator slot
+//   10 bits  sequence within the millisecond
+// Each thread leases a slot and is normally its only user, so next() is
+// one clock read and one uncontended compare-exchange. A slot's last
+// (millisecond, sequence) pair only ever increases: when a thread issues
+// more than 1024 ids in a millisecond it borrows the next millisecond,
+// and a slot outlives the thread that leased it, so ids are never
+// repeated within a process. Across restarts the slots start over, so
+// recovery calls advancePast with the highest id it finds (or highWater
+// as saved by the previous process) before any id is issued. Threads
+// beyond the 63 leasable slots share slot 0.
+class IdGenerator {
+private:
+    static const int SLOT_BITS = 6;
+    static const int SEQUENCE_BITS = 10;
+    static const int NODE_BITS = 7;
+    static const int SLOT_COUNT = 1 << SLOT_BITS;
+    static const int MILLIS_SHIFT = NODE_BITS + SLOT_BITS + SEQUENCE_BITS;
+    static const int64_t EPOCH_MS = 1704067200000LL;
+
+    struct alignas(64) Slot {
+        atomic<uint64_t> last{0};       // (milliseconds << SEQUENCE_BITS) | sequence
+    };
+
+    static Slot slots[SLOT_COUNT];
+    static atomic<uint64_t> leased;     // bitmap of slots owned by a thread
+    static atomic<uint32_t> nodeId;
+
+    // Leases a free slot for the calling thread and returns it at exit
+    struct Lease {
+        int slot;
+
+        Lease() : slot(0) {
+            uint64_t used = leased.load();
+            while (true) {
+                uint64_t free = ~used & ~uint64_t(1);
+                if (free == 0) return;
+                int candidate = __builtin_ctzll(free);
+                if (leased.compare_exchange_weak(used, used | (uint64_t(1) << candidate))) {
+                    slot = candidate;
+                    return;
+                }
+            }
+        }
+
+        ~Lease() {
+            if (slot != 0) leased.fetch_and(~(uint64_t(1) << slot));
+        }
+    };
+
+public:
+    static const uint32_t NODE_COUNT = 1u << NODE_BITS;
+
+    static void setNodeId(uint32_t id) { nodeId = id & ((1u << NODE_BITS) - 1); }
+    static uint32_t getNodeId() { return nodeId.load(memory_order_relaxed); }
+
+    // Makes every id issued from now on larger than id, whatever its node
+    // and slot: each slot continues from the millisecond after id's
+    static void advancePast(uint64_t id) {
+        uint64_t floor = ((id >> MILLIS_SHIFT) << SEQUENCE_BITS) | ((1u << SEQUENCE_BITS) - 1);
+        for (Slot& slot : slots) {
+            uint64_t last = slot.last.load(memory_order_relaxed);
+            while (last < floor && !slot.last.compare_exchange_weak(last, floor, memory_order_relaxed)) {}
+        }
+    }
+
+    // An id at least as large as every id issued so far, or passed to
+    // advancePast
+    static uint64_t highWater() {
+        uint64_t last = 0;
+        for (const Slot& slot : slots) {
+            last = max(last, slot.last.load(memory_order_relaxed));
+        }
+        return ((last >> SEQUENCE_BITS) << MILLIS_SHIFT) | ((uint64_t(1) << MILLIS_SHIFT) - 1);
+    }
+
+    // The node an id was issued for
+    static uint32_t nodeOf(uint64_t id) {
+        return static_cast<uint32_t>(id >> (SLOT_BITS + SEQUENCE_BITS)) & ((1u << NODE_BITS) - 1);
+    }
+
+    static uint64_t next() {
+        return next(nodeId.load(memory_order_relaxed));
+    }
+
+    // An id tagged with the given node rather than this process's, for a
+    // process that hosts several nodes (in-process shards)
+    static uint64_t next(uint32_t node) {
+        static thread_local Lease lease;
+        Slot& slot = slots[lease.slot];
+        uint64_t now = static_cast<uint64_t>(chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count() - EPOCH_MS);
+        uint64_t last = slot.last.load(memory_order_relaxed);
+        uint64_t issued;
+        do {
+            uint64_t fresh = now << SEQUENCE_BITS;
+            // A sequence overflow carries into the millisecond field
+            issued = fresh > last ? fresh : last + 1;
+        } while (!slot.last.compare_exchange_weak(last, issued, memory_order_relaxed));
+
+        uint64_t millis = issued >> SEQUENCE_BITS;
+        uint64_t sequence = issued & ((1u << SEQUENCE_BITS) - 1);
+        return (millis << MILLIS_SHIFT) |
+               (uint64_t(node & ((1u << NODE_BITS) - 1)) << (SLOT_BITS + SEQUENCE_BITS)) |
+               (uint64_t(lease.slot) << SEQUENCE_BITS) | sequence;
+    }
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef BANKING_INTEREST_KERNEL_H
+#define BANKING_INTEREST_KERNEL_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "Money.h"
+
+using namespace std;
+
+// Bulk interest kernel over structure-of-arrays input: for every i,
+// interest[i] = balance[i] * rate[i] / RATE_SCALE rounded half-even to the
+// cent, the same result as Money::mulDiv with INTEREST_ROUNDING. Balances
+// are cents and rates ppm. While |balance * rate| < 2^52 the product is exact
+// in a double and the correctly rounded quotient cannot cross a half-cent
+// boundary, so round-to-nearest-even yields the exact cent; lanes outside
+// that range fall back to mulDiv. Uses AVX2 (four lanes) when the CPU has it.
+class InterestKernel {
+private:
+    static constexpr double EXACT_LIMIT = 4503599627370496.0;    // 2^52
+
+    static int64_t accrueOne(int64_t balance, int64_t rate) {
+        double product = static_cast<double>(balance) * static_cast<double>(rate);
+        if (fabs(product) < EXACT_LIMIT) {
+            return static_cast<int64_t>(nearbyint(product / RATE_SCALE));
+        }
+        return Money::fromCents(balance).mulDiv(rate, RATE_SCALE, INTEREST_ROUNDING).getCents();
+    }
+
+    static void runScalar(const int64_t* balances, const int64_t* rates, int64_t* interest, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            interest[i] = accrueOne(balances[i], rates[i]);
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // int64 <-> double conversions use the 2^52 + 2^51 bias trick, valid
+    // for magnitudes below 2^51, which every lane is checked against
+    __attribute__((target("avx2")))
+    static void runAvx2(const int64_t* balances, const int64_t* rates, int64_t* interest, size_t n) {
+        const __m256i biasBits = _mm256_set1_epi64x(0x4338000000000000LL);
+        const __m256d bias = _mm256_set1_pd(6755399441055744.0);
+        const __m256i upper = _mm256_set1_epi64x(1LL << 51);
+        const __m256i lower = _mm256_set1_epi64x(-(1LL << 51));
+        const __m256d limit = _mm256_set1_pd(EXACT_LIMIT);
+        const __m256d scale = _mm256_set1_pd(static_cast<double>(RATE_SCALE));
+        const __m256d signBit = _mm256_set1_pd(-0.0);
+
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(balances + i));
+            __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rates + i));
+            __m256i inRange = _mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpgt_epi64(upper, b), _mm256_cmpgt_epi64(b, lower)),
+                _mm256_and_si256(_mm256_cmpgt_epi64(upper, r), _mm256_cmpgt_epi64(r, lower)));
+            __m256d bd = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(b, biasBits)), bias);
+            __m256d rd = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(r, biasBits)), bias);
+            __m256d product = _mm256_mul_pd(bd, rd);
+            __m256d exact = _mm256_cmp_pd(_mm256_andnot_pd(signBit, product), limit, _CMP_LT_OQ);
+            if (_mm256_movemask_pd(_mm256_and_pd(exact, _mm256_castsi256_pd(inRange))) != 0xF) {
+                runScalar(balances + i, rates + i, interest + i, 4);
+                continue;
+            }
+            __m256d cents = _mm256_round_pd(_mm256_div_pd(product, scale),
+                                            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m256i out = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(cents, bias)), biasBits);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(interest + i), out);
+        }
+        runScalar(balances + i, rates + i, interest + i, n - i);
+    }
+#endif
+
+public:
+    static void run(const int64_t* balances, const int64_t* rates, int64_t* interest, size_t n) {
+#if defined(__x86_64__) || defined(__i386__)
+        static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+        if (hasAvx2) {
+            runAvx2(balances, rates, interest, n);
+            return;
+        }
+#endif
+        runScalar(balances, rates, interest, n);
+    }
+};
+
+#endif
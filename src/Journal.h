@@ -0,0 +1,286 @@
+#ifndef BANKING_JOURNAL_H
+#define BANKING_JOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Storage.h"
+
+using namespace std;
+
+// Mutations recorded in the journal
+enum class JournalOp : uint8_t {
+    CREATE_SAVINGS = 1,
+    CREATE_CHECKING = 2,
+    DEPOSIT = 3,
+    WITHDRAW = 4,
+    TRANSFER = 5,
+    APPLY_LOAN = 6,
+    PAY_LOAN = 7,
+    APPLY_INTEREST = 8,
+    REQUEST_RESULT = 9,     // outcome of a refused operation that carried a request id
+    MULTI_TRANSFER = 10,    // multi-leg transfer applied in one step
+    TRANSFER_PREPARE = 11,  // multi-leg transfer voted for, funds held
+    TRANSFER_COMMIT = 12,
+    TRANSFER_ABORT = 13
+};
+
+inline const char* journalOpName(JournalOp op) {
+    switch (op) {
+        case JournalOp::CREATE_SAVINGS: return "CREATE_SAVINGS";
+        case JournalOp::CREATE_CHECKING: return "CREATE_CHECKING";
+        case JournalOp::DEPOSIT: return "DEPOSIT";
+        case JournalOp::WITHDRAW: return "WITHDRAW";
+        case JournalOp::TRANSFER: return "TRANSFER";
+        case JournalOp::APPLY_LOAN: return "APPLY_LOAN";
+        case JournalOp::PAY_LOAN: return "PAY_LOAN";
+        case JournalOp::APPLY_INTEREST: return "APPLY_INTEREST";
+        case JournalOp::REQUEST_RESULT: return "REQUEST_RESULT";
+        case JournalOp::MULTI_TRANSFER: return "MULTI_TRANSFER";
+        case JournalOp::TRANSFER_PREPARE: return "TRANSFER_PREPARE";
+        case JournalOp::TRANSFER_COMMIT: return "TRANSFER_COMMIT";
+        case JournalOp::TRANSFER_ABORT: return "TRANSFER_ABORT";
+    }
+    return "UNKNOWN";
+}
+
+// Append-only write-ahead journal with group commit.
+// File layout: [u32 magic][u32 version] then records of
+// [u32 length][u32 checksum][u64 seq][u8 op][body].
+// Appends only buffer the record; a flusher thread writes and fdatasyncs
+// everything pending in one go, so concurrent committers share a sync.
+// The first failed write or sync is final: nothing from then on is made
+// durable, and every wait for a later record reports the failure.
+class Journal {
+public:
+    static const uint32_t MAGIC = 0x4C4E524A;     // "JRNL"
+    // Raised whenever a record body changes; replay reads only this one
+    static const uint32_t VERSION = 3;
+    static const size_t HEADER_SIZE = 8;
+
+private:
+    int fd;
+    string pending;
+    uint64_t nextSeq;
+    uint64_t durableSeq;
+    size_t waiters;
+    bool stopping;
+    bool failed;
+    size_t groupCommitBytes;
+    chrono::milliseconds commitInterval;
+    mutex mtx;
+    condition_variable workCv;
+    condition_variable durableCv;
+    thread flusher;
+
+    void flushLoop() {
+        unique_lock<mutex> lock(mtx);
+        while (true) {
+            workCv.wait_for(lock, commitInterval, [this] {
+                return stopping || (!pending.empty() &&
+                       (waiters > 0 || pending.size() >= groupCommitBytes));
+            });
+            if (pending.empty()) {
+                if (stopping) break;
+                continue;
+            }
+            string batch;
+            batch.swap(pending);
+            // A failed write may have left a torn record behind, so nothing
+            // may follow it; recovery cuts the file off there
+            if (failed) continue;
+            uint64_t batchSeq = nextSeq - 1;
+            lock.unlock();
+            bool ok = writeAll(fd, batch.data(), batch.size()) && ::fdatasync(fd) == 0;
+            lock.lock();
+            if (ok) {
+                durableSeq = batchSeq;
+            } else {
+                failed = true;
+            }
+            durableCv.notify_all();
+        }
+    }
+
+    bool writeHeader() {
+        uint32_t header[2] = {MAGIC, VERSION};
+        return writeAll(fd, reinterpret_cast<const char*>(header), sizeof(header)) && ::fdatasync(fd) == 0;
+    }
+
+    // Caller holds mtx
+    uint64_t encodeRecord(JournalOp op, const BinaryWriter& body) {
+        uint64_t seq = nextSeq++;
+        BinaryWriter payload;
+        payload.u64(seq);
+        payload.u8(static_cast<uint8_t>(op));
+        string record = payload.data() + body.data();
+        uint32_t len = static_cast<uint32_t>(record.size());
+        uint32_t sum = checksum(record.data(), record.size());
+        pending.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        pending.append(reinterpret_cast<const char*>(&sum), sizeof(sum));
+        pending.append(record);
+        return seq;
+    }
+
+public:
+    Journal() : fd(-1), nextSeq(1), durableSeq(0), waiters(0), stopping(false), failed(false),
+                groupCommitBytes(1 << 20), commitInterval(2) {}
+
+    ~Journal() { close(); }
+
+    // Opens the journal for appends, writing the header if the file is
+    // empty. Replay must already have checked an existing file's header.
+    bool open(const string& path, uint64_t lastSeq) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) return false;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || (st.st_size == 0 && !writeHeader())) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        nextSeq = lastSeq + 1;
+        durableSeq = lastSeq;
+        stopping = false;
+        failed = false;
+        flusher = thread(&Journal::flushLoop, this);
+        return true;
+    }
+
+    void close() {
+        if (fd < 0) return;
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        workCv.notify_one();
+        flusher.join();
+        ::close(fd);
+        fd = -1;
+    }
+
+    // Buffers one record and returns its sequence number
+    uint64_t append(JournalOp op, const BinaryWriter& body) {
+        lock_guard<mutex> lock(mtx);
+        uint64_t seq = encodeRecord(op, body);
+        if (pending.size() >= groupCommitBytes) {
+            workCv.notify_one();
+        }
+        return seq;
+    }
+
+    // Buffers consecutive records under one lock; returns the last sequence
+    // number, or 0 if there was nothing to append
+    uint64_t appendBatch(const vector<pair<JournalOp, BinaryWriter>>& records) {
+        if (records.empty()) return 0;
+        lock_guard<mutex> lock(mtx);
+        uint64_t seq = 0;
+        for (const auto& rec : records) {
+            seq = encodeRecord(rec.first, rec.second);
+        }
+        if (pending.size() >= groupCommitBytes) {
+            workCv.notify_one();
+        }
+        return seq;
+    }
+
+    // Blocks until every record up to seq is on stable storage. False if
+    // the journal failed before getting there.
+    bool waitDurable(uint64_t seq) {
+        unique_lock<mutex> lock(mtx);
+        if (durableSeq >= seq) return true;
+        ++waiters;
+        workCv.notify_one();
+        durableCv.wait(lock, [this, seq] { return durableSeq >= seq || failed; });
+        --waiters;
+        return durableSeq >= seq;
+    }
+
+    bool sync() {
+        uint64_t last;
+        {
+            lock_guard<mutex> lock(mtx);
+            last = nextSeq - 1;
+        }
+        return waitDurable(last);
+    }
+
+    bool hasFailed() {
+        lock_guard<mutex> lock(mtx);
+        return failed;
+    }
+
+    uint64_t lastSeq() {
+        lock_guard<mutex> lock(mtx);
+        return nextSeq - 1;
+    }
+
+    // Drops all records once a snapshot covers them; the header stays
+    bool truncate() {
+        if (!sync()) return false;
+        lock_guard<mutex> lock(mtx);
+        return ::ftruncate(fd, HEADER_SIZE) == 0 && ::fdatasync(fd) == 0;
+    }
+
+    // Calls apply for every intact record with seq > afterSeq. validBytes
+    // is set to the byte offset just past the last intact record (0 for a
+    // missing file or a torn header). False, with error set and nothing
+    // applied, if the file is not a journal of this version or the records
+    // following afterSeq are missing from it.
+    static bool replay(const string& path, uint64_t afterSeq, uint64_t& lastSeq, size_t& validBytes,
+                       const function<void(JournalOp, BinaryReader&)>& apply, string& error) {
+        string data;
+        lastSeq = afterSeq;
+        validBytes = 0;
+        if (!readWholeFile(path, data) || data.size() < HEADER_SIZE) return true;
+        uint32_t header[2];
+        memcpy(header, data.data(), sizeof(header));
+        if (header[0] != MAGIC) {
+            error = path + " is not a journal, or was written before journals carried a version";
+            return false;
+        }
+        if (header[1] != VERSION) {
+            error = path + " is journal format version " + to_string(header[1]) +
+                    "; this build reads only version " + to_string(VERSION);
+            return false;
+        }
+
+        size_t offset = HEADER_SIZE;
+        bool first = true;
+        while (data.size() - offset >= 8) {
+            uint32_t len, sum;
+            memcpy(&len, data.data() + offset, sizeof(len));
+            memcpy(&sum, data.data() + offset + 4, sizeof(sum));
+            if (len < 9 || data.size() - offset - 8 < len) break;
+            const char* record = data.data() + offset + 8;
+            if (checksum(record, len) != sum) break;
+
+            BinaryReader r(record, len);
+            uint64_t seq = r.u64();
+            JournalOp op = static_cast<JournalOp>(r.u8());
+            if (seq > afterSeq) {
+                // Sequence numbers have no gaps, so a later first record
+                // means the ones before it were lost with their snapshot
+                if (first && seq != afterSeq + 1) {
+                    error = path + " continues from record " + to_string(seq - 1) +
+                            ", but the snapshot covers only up to record " + to_string(afterSeq);
+                    return false;
+                }
+                first = false;
+                apply(op, r);
+            }
+            lastSeq = max(lastSeq, seq);
+            offset += 8 + len;
+        }
+        validBytes = offset;
+        return true;
+    }
+};
+
+#endif
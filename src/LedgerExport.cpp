@@ -0,0 +1,155 @@
+#include "LedgerExport.h"
+
+#include <algorithm>
+
+namespace {
+
+size_t padded(uint64_t bytes) {
+    return (bytes + 7) / 8 * 8;
+}
+
+} // namespace
+
+size_t ledgerColumnOffset(LedgerColumn column, uint64_t rows) {
+    // The five 8-byte columns come first, the type bytes last
+    return static_cast<size_t>(column) * rows * 8;
+}
+
+size_t ledgerRowGroupSize(uint64_t rows) {
+    return ledgerColumnOffset(LedgerColumn::TYPE, rows) + padded(rows);
+}
+
+void LedgerRowGroupBuilder::add(uint64_t account, const Transaction* records, size_t count) {
+    if (count == 0) return;
+    accounts.insert(accounts.end(), count, account);
+    for (size_t i = 0; i < count; ++i) {
+        const Transaction& t = records[i];
+        ids.push_back(t.getId());
+        times.push_back(t.getTimestamp());
+        amounts.push_back(t.getAmount().getCents());
+        counterparties.push_back(t.getCounterparty());
+        types.push_back(static_cast<uint8_t>(t.getType()));
+    }
+    // Histories are in time order
+    minTime = min(minTime, records[0].getTimestamp());
+    maxTime = max(maxTime, records[count - 1].getTimestamp());
+}
+
+void LedgerRowGroupBuilder::clear() {
+    accounts.clear();
+    ids.clear();
+    times.clear();
+    amounts.clear();
+    counterparties.clear();
+    types.clear();
+    minTime = INT64_MAX;
+    maxTime = INT64_MIN;
+}
+
+LedgerFileWriter::~LedgerFileWriter() {
+    if (fd >= 0) {
+        ::close(fd);
+        ::unlink(tmpPath.c_str());
+    }
+}
+
+bool LedgerFileWriter::open(const string& filename) {
+    path = filename;
+    tmpPath = filename + ".tmp";
+    fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    LedgerFileHeader header = {MAGIC, VERSION, 0};
+    end = sizeof(header);
+    failed = !pwriteAll(fd, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+    return !failed;
+}
+
+void LedgerFileWriter::write(LedgerRowGroupBuilder& builder) {
+    uint64_t rows = builder.rows();
+    if (rows == 0) return;
+    LedgerRowGroup group;
+    group.offset = end.fetch_add(ledgerRowGroupSize(rows));
+    group.rows = rows;
+    group.minTime = builder.minTime;
+    group.maxTime = builder.maxTime;
+    group.firstAccount = builder.accounts.front();
+    group.lastAccount = builder.accounts.back();
+
+    builder.types.resize(padded(rows), 0);
+    const void* columns[LEDGER_COLUMN_COUNT] = {
+        builder.accounts.data(), builder.ids.data(), builder.times.data(),
+        builder.amounts.data(), builder.counterparties.data(), builder.types.data()
+    };
+    bool ok = true;
+    for (size_t c = 0; c < LEDGER_COLUMN_COUNT && ok; ++c) {
+        LedgerColumn column = static_cast<LedgerColumn>(c);
+        size_t bytes = column == LedgerColumn::TYPE ? padded(rows) : rows * 8;
+        ok = pwriteAll(fd, static_cast<const char*>(columns[c]), bytes, group.offset + ledgerColumnOffset(column, rows));
+    }
+    builder.clear();
+    if (!ok) {
+        failed = true;
+        return;
+    }
+    lock_guard<mutex> lock(directoryMtx);
+    directory.push_back(group);
+}
+
+bool LedgerFileWriter::finish(uint64_t& rowCount, uint64_t& bytes) {
+    sort(directory.begin(), directory.end(),
+         [](const LedgerRowGroup& a, const LedgerRowGroup& b) { return a.offset < b.offset; });
+    LedgerFileTrailer trailer = {};
+    trailer.directoryOffset = end;
+    trailer.groupCount = directory.size();
+    for (const LedgerRowGroup& g : directory) trailer.rowCount += g.rows;
+    const char* dir = reinterpret_cast<const char*>(directory.data());
+    size_t dirBytes = directory.size() * sizeof(LedgerRowGroup);
+    trailer.directoryChecksum = checksum(dir, dirBytes);
+    trailer.magic = MAGIC;
+
+    bool ok = !failed && pwriteAll(fd, dir, dirBytes, trailer.directoryOffset) &&
+              pwriteAll(fd, reinterpret_cast<const char*>(&trailer), sizeof(trailer),
+                        trailer.directoryOffset + dirBytes) &&
+              ::fsync(fd) == 0;
+    ::close(fd);
+    fd = -1;
+    if (!ok || ::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    rowCount = trailer.rowCount;
+    bytes = trailer.directoryOffset + dirBytes + sizeof(trailer);
+    return true;
+}
+
+bool LedgerFile::open(const string& filename) {
+    file = MappedFile::open(filename);
+    if (!file || file->size() < sizeof(LedgerFileHeader) + sizeof(LedgerFileTrailer)) return false;
+    LedgerFileHeader header;
+    LedgerFileTrailer trailer;
+    memcpy(&header, file->data(), sizeof(header));
+    memcpy(&trailer, file->data() + file->size() - sizeof(trailer), sizeof(trailer));
+    uint64_t dataEnd = file->size() - sizeof(trailer);
+    if (header.magic != LedgerFileWriter::MAGIC || header.version != LedgerFileWriter::VERSION ||
+        trailer.magic != LedgerFileWriter::MAGIC || trailer.directoryOffset > dataEnd ||
+        dataEnd - trailer.directoryOffset != trailer.groupCount * sizeof(LedgerRowGroup)) {
+        return false;
+    }
+    groups = reinterpret_cast<const LedgerRowGroup*>(file->data() + trailer.directoryOffset);
+    groupCount = trailer.groupCount;
+    if (checksum(reinterpret_cast<const char*>(groups), groupCount * sizeof(LedgerRowGroup)) !=
+        trailer.directoryChecksum) {
+        return false;
+    }
+    uint64_t rows = 0;
+    for (size_t i = 0; i < groupCount; ++i) {
+        if (groups[i].offset < sizeof(header) ||
+            groups[i].rows > trailer.directoryOffset ||
+            groups[i].offset + ledgerRowGroupSize(groups[i].rows) > trailer.directoryOffset) {
+            return false;
+        }
+        rows += groups[i].rows;
+    }
+    rowCount = rows;
+    return rows == trailer.rowCount;
+}
@@ -0,0 +1,145 @@
+#ifndef BANKING_LEDGER_EXPORT_H
+#define BANKING_LEDGER_EXPORT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Transaction.h"
+
+using namespace std;
+
+// Columnar ledger file, for analytics. Like Parquet, rows are cut into row
+// groups stored column by column, and a footer at the end lists the groups,
+// so writers can fill groups independently and readers can skip by
+// account or time range:
+//   header | row group | row group | ... | group directory | trailer
+// A row group of n rows holds six columns back to back, each 8-aligned:
+//   account u64[n] | id u64[n] | timestamp i64[n] | amount i64[n] (cents) |
+//   counterparty u64[n] | type u8[n] (TxnType, padded)
+// Within a group rows are in account order and each account's rows in
+// history order; groups themselves are in no particular order.
+struct LedgerFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t reserved;
+};
+
+struct LedgerRowGroup {
+    uint64_t offset;
+    uint64_t rows;
+    int64_t minTime;
+    int64_t maxTime;
+    uint64_t firstAccount;
+    uint64_t lastAccount;
+};
+
+struct LedgerFileTrailer {
+    uint64_t directoryOffset;
+    uint64_t groupCount;
+    uint64_t rowCount;
+    uint32_t directoryChecksum;
+    uint32_t magic;
+};
+
+static_assert(sizeof(LedgerFileHeader) == 16, "ledger header layout changed");
+static_assert(sizeof(LedgerRowGroup) == 48, "ledger row group layout changed");
+static_assert(sizeof(LedgerFileTrailer) == 32, "ledger trailer layout changed");
+
+enum class LedgerColumn : uint8_t {
+    ACCOUNT,
+    ID,
+    TIMESTAMP,
+    AMOUNT,
+    COUNTERPARTY,
+    TYPE
+};
+
+const size_t LEDGER_COLUMN_COUNT = 6;
+
+// Bytes from the start of a row group of `rows` rows to the column
+size_t ledgerColumnOffset(LedgerColumn column, uint64_t rows);
+size_t ledgerRowGroupSize(uint64_t rows);
+
+// One worker's row group under construction. Accounts are added whole.
+class LedgerRowGroupBuilder {
+private:
+    vector<uint64_t> accounts;
+    vector<uint64_t> ids;
+    vector<int64_t> times;
+    vector<int64_t> amounts;
+    vector<uint64_t> counterparties;
+    vector<uint8_t> types;
+    int64_t minTime;
+    int64_t maxTime;
+
+    friend class LedgerFileWriter;
+
+public:
+    LedgerRowGroupBuilder() { clear(); }
+
+    void add(uint64_t account, const Transaction* records, size_t count);
+    size_t rows() const { return ids.size(); }
+    void clear();
+};
+
+// Writes a ledger file from any number of threads at once: each row group
+// gets its own range of the file from an atomic bump pointer and its
+// columns are written straight from the builder's arrays, so workers only
+// meet to record the group in the directory. The file is written aside and
+// renamed into place by finish().
+class LedgerFileWriter {
+private:
+    string path;
+    string tmpPath;
+    int fd;
+    atomic<uint64_t> end;
+    atomic<bool> failed;
+    mutex directoryMtx;
+    vector<LedgerRowGroup> directory;
+
+public:
+    static const uint32_t MAGIC = 0x5844454C;   // "LEDX"
+    static const uint32_t VERSION = 1;
+
+    LedgerFileWriter() : fd(-1), end(0), failed(false) {}
+    ~LedgerFileWriter();
+
+    LedgerFileWriter(const LedgerFileWriter&) = delete;
+    LedgerFileWriter& operator=(const LedgerFileWriter&) = delete;
+
+    bool open(const string& filename);
+    // Writes the builder's rows as a row group and empties it
+    void write(LedgerRowGroupBuilder& builder);
+    // Writes the directory and trailer, syncs and renames the file into place
+    bool finish(uint64_t& rowCount, uint64_t& bytes);
+};
+
+// Read-only view of a ledger file, mapped in place
+class LedgerFile {
+private:
+    shared_ptr<MappedFile> file;
+    const LedgerRowGroup* groups;
+    size_t groupCount;
+    uint64_t rowCount;
+
+public:
+    LedgerFile() : groups(nullptr), groupCount(0), rowCount(0) {}
+
+    // False if the file is missing, truncated or not a ledger file
+    bool open(const string& filename);
+
+    size_t getGroupCount() const { return groupCount; }
+    uint64_t getRowCount() const { return rowCount; }
+    const LedgerRowGroup& group(size_t i) const { return groups[i]; }
+
+    // The column's values in group i, as u64, i64 or u8 per its type
+    template <typename T>
+    const T* column(size_t i, LedgerColumn c) const {
+        return reinterpret_cast<const T*>(file->data() + groups[i].offset + ledgerColumnOffset(c, groups[i].rows));
+    }
+};
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef BANKING_LOGSINK_H
+#define BANKING_LOGSINK_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Journal.h"
+#include "Transaction.h"
+
+using namespace std;
+
+// One finished operation, as reported to a LogSink. Plain data, so
+// posting one is a copy; its text is produced on the sink's thread.
+struct Notification {
+    int64_t at;                 // nanoseconds since the epoch
+    JournalOp op;
+    TxnStatus status;
+    uint64_t account;
+    uint64_t counterparty;      // TRANSFER only
+    Money amount;
+};
+
+// Buffered asynchronous output. Callers only append to an in-memory queue
+// under a short lock; a writer thread formats whatever has queued up and
+// writes it to the stream in one go, every flushInterval or as soon as
+// batchSize entries are waiting, so nothing that posts ever waits on the
+// console or a file. If the writer falls maxPending notifications behind,
+// further notifications are counted and dropped instead of queued.
+// Preformatted text passed to write() is never dropped.
+class LogSink {
+private:
+    struct Entry {
+        Notification notice;
+        string text;            // preformatted output, used when not empty
+    };
+
+    ostream& out;
+    vector<Entry> pending;
+    size_t batchSize;
+    size_t maxPending;
+    chrono::milliseconds flushInterval;
+    uint64_t requestedPass;
+    uint64_t completedPass;
+    uint64_t dropped;
+    bool stopping;
+    mutex mtx;
+    condition_variable workCv;
+    condition_variable drainedCv;
+    thread writer;
+
+    static void format(string& buf, const Notification& n) {
+        buf.append(DateTime::format(n.at));
+        buf += ' ';
+        buf += journalOpName(n.op);
+        buf += ' ';
+        buf += formatAccountNumber(n.account);
+        if (n.counterparty != 0) {
+            buf += " -> ";
+            buf += formatAccountNumber(n.counterparty);
+        }
+        buf += ' ';
+        buf += n.amount.toString();
+        buf += ' ';
+        buf += statusName(n.status);
+        buf += '\n';
+    }
+
+    void writeLoop() {
+        vector<Entry> batch;
+        string buf;
+        unique_lock<mutex> lock(mtx);
+        while (true) {
+            workCv.wait_for(lock, flushInterval, [this] {
+                return stopping || requestedPass > completedPass || pending.size() >= batchSize;
+            });
+            uint64_t pass = requestedPass;
+            bool stop = stopping;
+            batch.swap(pending);
+            lock.unlock();
+            for (const Entry& e : batch) {
+                if (e.text.empty()) {
+                    format(buf, e.notice);
+                } else {
+                    buf += e.text;
+                }
+            }
+            if (!buf.empty()) {
+                out.write(buf.data(), buf.size());
+                out.flush();
+                buf.clear();
+            }
+            batch.clear();
+            lock.lock();
+            completedPass = pass;
+            drainedCv.notify_all();
+            if (stop && pending.empty()) break;
+        }
+    }
+
+public:
+    explicit LogSink(ostream& out, size_t batchSize = 4096, size_t maxPending = 1 << 20,
+                     chrono::milliseconds flushInterval = chrono::milliseconds(50))
+        : out(out), batchSize(batchSize), maxPending(maxPending), flushInterval(flushInterval),
+          requestedPass(0), completedPass(0), dropped(0), stopping(false) {
+        writer = thread(&LogSink::writeLoop, this);
+    }
+
+    // Writes out everything still queued
+    ~LogSink() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        workCv.notify_one();
+        writer.join();
+        if (dropped > 0) {
+            out << dropped << " notifications dropped\n";
+            out.flush();
+        }
+    }
+
+    void post(const Notification& notice) {
+        lock_guard<mutex> lock(mtx);
+        if (pending.size() >= maxPending) {
+            ++dropped;
+            return;
+        }
+        pending.push_back(Entry{notice, string()});
+        if (pending.size() == batchSize) {
+            workCv.notify_one();
+        }
+    }
+
+    void write(string text) {
+        if (text.empty()) return;
+        lock_guard<mutex> lock(mtx);
+        pending.push_back(Entry{Notification{}, move(text)});
+        if (pending.size() == batchSize) {
+            workCv.notify_one();
+        }
+    }
+
+    // Blocks until everything queued before the call has been written
+    void flush() {
+        unique_lock<mutex> lock(mtx);
+        uint64_t pass = ++requestedPass;
+        workCv.notify_one();
+        drainedCv.wait(lock, [this, pass] { return completedPass >= pass; });
+    }
+
+    uint64_t droppedCount() {
+        lock_guard<mutex> lock(mtx);
+        return dropped;
+    }
+};
+
+#endif
@@ -0,0 +1,293 @@
+#include "Metrics.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+const char* metricOpName(MetricOp op) {
+    switch (op) {
+        case MetricOp::FIND_ACCOUNT: return "find_account";
+        case MetricOp::CREATE_ACCOUNT: return "create_account";
+        case MetricOp::DEPOSIT: return "deposit";
+        case MetricOp::WITHDRAW: return "withdraw";
+        case MetricOp::TRANSFER: return "transfer";
+        case MetricOp::APPLY_LOAN: return "apply_loan";
+        case MetricOp::PAY_LOAN: return "pay_loan";
+        case MetricOp::APPLY_INTEREST: return "apply_interest";
+        case MetricOp::MULTI_TRANSFER: return "multi_transfer";
+        case MetricOp::PREPARE_TRANSFER: return "prepare_transfer";
+        case MetricOp::COMMIT_TRANSFER: return "commit_transfer";
+        case MetricOp::ABORT_TRANSFER: return "abort_transfer";
+    }
+    return "unknown";
+}
+
+uint64_t LatencySummary::quantile(double q) const {
+    if (count == 0) return 0;
+    uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(q * count)));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < buckets.size(); ++b) {
+        seen += buckets[b];
+        if (seen >= rank) return min(LatencyBuckets::upperBound(b), maxNanos);
+    }
+    return maxNanos;
+}
+
+void LatencySummary::merge(const LatencySummary& other) {
+    for (size_t b = 0; b < buckets.size(); ++b) buckets[b] += other.buckets[b];
+    count += other.count;
+    sumNanos += other.sumNanos;
+    maxNanos = max(maxNanos, other.maxNanos);
+}
+
+uint64_t MetricsSnapshot::total(MetricOp op) const {
+    uint64_t sum = 0;
+    for (uint64_t n : counts[static_cast<size_t>(op)]) sum += n;
+    return sum;
+}
+
+// One thread's counters. Only the owning thread writes them; snapshot()
+// reads them concurrently, hence atomics with relaxed ordering.
+struct Metrics::ThreadBlock {
+    atomic<uint64_t> counts[METRIC_OP_COUNT][TXN_STATUS_COUNT];
+    atomic<uint64_t> buckets[METRIC_OP_COUNT][2][LatencyBuckets::COUNT];
+    atomic<uint64_t> sumNanos[METRIC_OP_COUNT][2];
+    atomic<uint64_t> maxNanos[METRIC_OP_COUNT][2];
+
+    void addTo(MetricsSnapshot& s) const {
+        for (size_t op = 0; op < METRIC_OP_COUNT; ++op) {
+            for (size_t st = 0; st < TXN_STATUS_COUNT; ++st) {
+                s.counts[op][st] += counts[op][st].load(memory_order_relaxed);
+            }
+            LatencySummary* outcomes[2] = {&s.ok[op], &s.failed[op]};
+            for (int o = 0; o < 2; ++o) {
+                LatencySummary& sum = *outcomes[o];
+                for (size_t b = 0; b < LatencyBuckets::COUNT; ++b) {
+                    uint64_t n = buckets[op][o][b].load(memory_order_relaxed);
+                    sum.buckets[b] += n;
+                    sum.count += n;
+                }
+                sum.sumNanos += sumNanos[op][o].load(memory_order_relaxed);
+                sum.maxNanos = max(sum.maxNanos, maxNanos[op][o].load(memory_order_relaxed));
+            }
+        }
+    }
+};
+
+struct Metrics::Registry {
+    mutex mtx;
+    vector<ThreadBlock*> live;
+    MetricsSnapshot retired;        // blocks of threads that have exited
+};
+
+namespace {
+
+// Single-writer increment: a load and a store, no locked instruction
+inline void bump(atomic<uint64_t>& cell, uint64_t delta) {
+    cell.store(cell.load(memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+} // namespace
+
+struct Metrics::Registration {
+    ThreadBlock* block;
+
+    Registration() : block(new ThreadBlock()) {
+        Registry& r = registry();
+        lock_guard<mutex> lock(r.mtx);
+        r.live.push_back(block);
+    }
+
+    ~Registration();
+};
+
+atomic<bool> Metrics::enabled(true);
+
+// Never destroyed, so threads that exit during shutdown can still retire
+Metrics::Registry& Metrics::registry() {
+    static Registry* r = new Registry();
+    return *r;
+}
+
+Metrics::ThreadBlock& Metrics::local() {
+    static thread_local Registration registration;
+    return *registration.block;
+}
+
+Metrics::Registration::~Registration() {
+    Registry& r = registry();
+    {
+        lock_guard<mutex> lock(r.mtx);
+        block->addTo(r.retired);
+        r.live.erase(find(r.live.begin(), r.live.end(), block));
+    }
+    delete block;
+}
+
+void Metrics::record(MetricOp op, TxnStatus status, int64_t nanos) {
+    ThreadBlock& b = local();
+    size_t o = static_cast<size_t>(op);
+    bump(b.counts[o][static_cast<size_t>(status)], 1);
+    if (nanos < 0) return;
+    size_t outcome = status == TxnStatus::OK ? 0 : 1;
+    uint64_t value = static_cast<uint64_t>(nanos);
+    bump(b.buckets[o][outcome][LatencyBuckets::bucketFor(value)], 1);
+    bump(b.sumNanos[o][outcome], value);
+    if (value > b.maxNanos[o][outcome].load(memory_order_relaxed)) {
+        b.maxNanos[o][outcome].store(value, memory_order_relaxed);
+    }
+}
+
+MetricsSnapshot Metrics::snapshot() {
+    Registry& r = registry();
+    lock_guard<mutex> lock(r.mtx);
+    MetricsSnapshot s = r.retired;
+    for (const ThreadBlock* block : r.live) {
+        block->addTo(s);
+    }
+    return s;
+}
+
+void Metrics::writePrometheus(ostream& out) {
+    static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+    MetricsSnapshot s = snapshot();
+    char value[32];
+    auto seconds = [&value](uint64_t nanos) {
+        snprintf(value, sizeof(value), "%.9g", nanos / 1e9);
+        return value;
+    };
+
+    out << "# HELP bank_operations_total Finished operations by result.\n";
+    out << "# TYPE bank_operations_total counter\n";
+    for (size_t op = 0; op < METRIC_OP_COUNT; ++op) {
+        for (size_t st = 0; st < TXN_STATUS_COUNT; ++st) {
+            // OK is always listed so every operation has a series
+            if (s.counts[op][st] == 0 && st != 0) continue;
+            out << "bank_operations_total{op=\"" << metricOpName(static_cast<MetricOp>(op))
+                << "\",status=\"" << statusName(static_cast<TxnStatus>(st)) << "\"} "
+                << s.counts[op][st] << '\n';
+        }
+    }
+
+    out << "# HELP bank_operation_latency_seconds Operation latency (find_account is sampled).\n";
+    out << "# TYPE bank_operation_latency_seconds summary\n";
+    for (size_t op = 0; op < METRIC_OP_COUNT; ++op) {
+        const LatencySummary* outcomes[2] = {&s.ok[op], &s.failed[op]};
+        for (int o = 0; o < 2; ++o) {
+            const LatencySummary& sum = *outcomes[o];
+            if (sum.count == 0) continue;
+            string labels = string("op=\"") + metricOpName(static_cast<MetricOp>(op)) +
+                            "\",result=\"" + (o == 0 ? "ok" : "failed") + "\"";
+            for (double q : QUANTILES) {
+                out << "bank_operation_latency_seconds{" << labels << ",quantile=\"" << q << "\"} "
+                    << seconds(sum.quantile(q)) << '\n';
+            }
+            out << "bank_operation_latency_seconds_sum{" << labels << "} " << seconds(sum.sumNanos) << '\n';
+            out << "bank_operation_latency_seconds_count{" << labels << "} " << sum.count << '\n';
+        }
+    }
+
+    out << "# HELP bank_operation_latency_max_seconds Slowest operation seen.\n";
+    out << "# TYPE bank_operation_latency_max_seconds gauge\n";
+    for (size_t op = 0; op < METRIC_OP_COUNT; ++op) {
+        const LatencySummary* outcomes[2] = {&s.ok[op], &s.failed[op]};
+        for (int o = 0; o < 2; ++o) {
+            if (outcomes[o]->count == 0) continue;
+            out << "bank_operation_latency_max_seconds{op=\"" << metricOpName(static_cast<MetricOp>(op))
+                << "\",result=\"" << (o == 0 ? "ok" : "failed") << "\"} "
+                << seconds(outcomes[o]->maxNanos) << '\n';
+        }
+    }
+}
+
+string Metrics::prometheusText() {
+    ostringstream out;
+    writePrometheus(out);
+    return out.str();
+}
+
+bool Metrics::exportToFile(const string& path) {
+    string tmpName = path + ".tmp";
+    {
+        ofstream file(tmpName, ios::trunc);
+        if (!file) return false;
+        writePrometheus(file);
+        if (!file.flush()) return false;
+    }
+    return ::rename(tmpName.c_str(), path.c_str()) == 0;
+}
+
+bool MetricsServer::start(uint16_t port) {
+    listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) return false;
+    int one = 1;
+    ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listenFd, 16) != 0) {
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    stopping = false;
+    acceptor = thread(&MetricsServer::acceptLoop, this);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (listenFd < 0) return;
+    stopping = true;
+    // Wakes the blocked accept()
+    ::shutdown(listenFd, SHUT_RDWR);
+    acceptor.join();
+    ::close(listenFd);
+    listenFd = -1;
+}
+
+void MetricsServer::acceptLoop() {
+    while (!stopping) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        // Read the request headers (whatever was asked, the answer is the dump)
+        timeval timeout{1, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        string request;
+        char buf[1024];
+        while (request.find("\r\n\r\n") == string::npos && request.size() < 16384) {
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) break;
+            request.append(buf, n);
+        }
+
+        string body = Metrics::prometheusText();
+        string response = "HTTP/1.0 200 OK\r\n"
+                          "Content-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: " + to_string(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n" + body;
+        const char* p = response.data();
+        size_t left = response.size();
+        while (left > 0) {
+            ssize_t n = ::send(fd, p, left, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            p += n;
+            left -= n;
+        }
+        ::close(fd);
+    }
+}
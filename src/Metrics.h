@@ -0,0 +1,192 @@
+#ifndef BANKING_METRICS_H
+#define BANKING_METRICS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Money.h"
+
+using namespace std;
+
+// Operations the bank keeps counters and latency histograms for
+enum class MetricOp : uint8_t {
+    FIND_ACCOUNT,
+    CREATE_ACCOUNT,
+    DEPOSIT,
+    WITHDRAW,
+    TRANSFER,
+    APPLY_LOAN,
+    PAY_LOAN,
+    APPLY_INTEREST,
+    MULTI_TRANSFER,
+    PREPARE_TRANSFER,
+    COMMIT_TRANSFER,
+    ABORT_TRANSFER
+};
+
+const size_t METRIC_OP_COUNT = 12;
+
+// Lower-case name used as the op label in exported metrics
+const char* metricOpName(MetricOp op);
+
+// Log-linear latency buckets in the style of HdrHistogram. Values below
+// 2 * SUB_COUNT nanoseconds get a bucket each; above that every power of
+// two is split into SUB_COUNT equal buckets, so a recorded value is known
+// to within 1/16 of itself. Values from 1 ns to about 68 s are kept apart;
+// anything longer lands in the last bucket.
+class LatencyBuckets {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_BITS = 36;
+    static const size_t COUNT = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+    static size_t bucketFor(uint64_t nanos) {
+        if (nanos < SUB_COUNT) return nanos;
+        int msb = 63 - __builtin_clzll(nanos);
+        if (msb >= MAX_BITS) return COUNT - 1;
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_COUNT + ((nanos >> shift) - SUB_COUNT);
+    }
+
+    // Smallest value that falls in the bucket
+    static uint64_t lowerBound(size_t bucket) {
+        if (bucket < SUB_COUNT) return bucket;
+        size_t shift = bucket / SUB_COUNT - 1;
+        return (SUB_COUNT + bucket % SUB_COUNT) << shift;
+    }
+
+    // Largest value that falls in the bucket
+    static uint64_t upperBound(size_t bucket) {
+        return bucket + 1 < COUNT ? lowerBound(bucket + 1) - 1 : UINT64_MAX;
+    }
+};
+
+// Aggregated latencies of one operation and outcome
+struct LatencySummary {
+    vector<uint64_t> buckets = vector<uint64_t>(LatencyBuckets::COUNT);
+    uint64_t count = 0;
+    uint64_t sumNanos = 0;
+    uint64_t maxNanos = 0;
+
+    void add(uint64_t nanos) {
+        ++buckets[LatencyBuckets::bucketFor(nanos)];
+        ++count;
+        sumNanos += nanos;
+        maxNanos = max(maxNanos, nanos);
+    }
+
+    void merge(const LatencySummary& other);
+
+    // Value at quantile q (0..1): the upper edge of the bucket holding
+    // that rank, capped at the largest value seen. 0 if nothing recorded.
+    uint64_t quantile(double q) const;
+};
+
+// Every thread's counters added together at one moment
+struct MetricsSnapshot {
+    uint64_t counts[METRIC_OP_COUNT][TXN_STATUS_COUNT] = {};
+    LatencySummary ok[METRIC_OP_COUNT];         // operations that returned OK
+    LatencySummary failed[METRIC_OP_COUNT];     // operations refused with any other status
+
+    uint64_t total(MetricOp op) const;
+};
+
+// Process-wide operation metrics. Each thread writes to its own block of
+// counters with plain relaxed stores (no locked instructions, no shared
+// cache lines), so recording is a clock read and a few increments.
+// Blocks are registered on a thread's first use and folded into a shared
+// total when the thread exits; snapshot() adds them all up on demand.
+// Lookups are much cheaper than a clock read, so findAccount latency is
+// timed for one call in LOOKUP_SAMPLE; it is still counted every time.
+class Metrics {
+private:
+    struct ThreadBlock;
+    struct Registry;
+    struct Registration;
+
+    static atomic<bool> enabled;
+
+    static Registry& registry();
+    static ThreadBlock& local();
+
+public:
+    static const unsigned LOOKUP_SAMPLE = 64;
+
+    static bool isEnabled() { return enabled.load(memory_order_relaxed); }
+    static void setEnabled(bool on) { enabled.store(on, memory_order_relaxed); }
+
+    static int64_t now() {
+        return chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // True for one call in every `every` on the calling thread
+    static bool sample(unsigned every) {
+        static thread_local unsigned calls = 0;
+        return every <= 1 || ++calls % every == 0;
+    }
+
+    // Counts one finished operation and, if nanos >= 0, records its latency
+    static void record(MetricOp op, TxnStatus status, int64_t nanos);
+
+    static MetricsSnapshot snapshot();
+
+    // Prometheus text exposition format
+    static void writePrometheus(ostream& out);
+    static string prometheusText();
+
+    // Writes the Prometheus dump to path (through a temporary file, so a
+    // scraper reading the file never sees half of it)
+    static bool exportToFile(const string& path);
+};
+
+// Times one operation from construction and records it when done() is
+// called with the operation's status. With sampleEvery > 1 only that
+// share of calls is timed; all of them are counted.
+class OpTimer {
+private:
+    MetricOp op;
+    int64_t start;      // -1 when this call is not timed
+
+public:
+    explicit OpTimer(MetricOp op, unsigned sampleEvery = 1) : op(op), start(-1) {
+        if (Metrics::isEnabled() && Metrics::sample(sampleEvery)) {
+            start = Metrics::now();
+        }
+    }
+
+    TxnStatus done(TxnStatus status) {
+        if (Metrics::isEnabled()) {
+            Metrics::record(op, status, start >= 0 ? Metrics::now() - start : -1);
+        }
+        return status;
+    }
+};
+
+// Serves the Prometheus dump over HTTP on a local TCP port, one response
+// per connection, from its own thread
+class MetricsServer {
+private:
+    int listenFd;
+    atomic<bool> stopping;
+    thread acceptor;
+
+    void acceptLoop();
+
+public:
+    MetricsServer() : listenFd(-1), stopping(false) {}
+    ~MetricsServer() { stop(); }
+
+    // Listens on 127.0.0.1:port; false if the port cannot be bound
+    bool start(uint16_t port);
+    void stop();
+};
+
+#endif
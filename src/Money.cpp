@@ -0,0 +1,55 @@
+#include "Money.h"
+
+int64_t percentToRate(double percent) {
+    return llround(percent * (RATE_SCALE / 100));
+}
+
+double rateToPercent(int64_t rate) {
+    return rate / static_cast<double>(RATE_SCALE / 100);
+}
+
+ostream& operator<<(ostream& os, Money m) {
+    return os << m.toString();
+}
+
+string statusMessage(TxnStatus status) {
+    switch (status) {
+        case TxnStatus::OK: return "Success!";
+        case TxnStatus::INVALID_AMOUNT: return "Invalid amount!";
+        case TxnStatus::INSUFFICIENT_FUNDS: return "Insufficient balance!";
+        case TxnStatus::OVERDRAFT_EXCEEDED: return "Exceeds overdraft limit!";
+        case TxnStatus::ACCOUNT_NOT_FOUND: return "Account not found!";
+        case TxnStatus::INVALID_LOAN_INDEX: return "Invalid loan index!";
+        case TxnStatus::LOAN_PAID_OFF: return "This loan is already paid off!";
+        case TxnStatus::PAYMENT_TOO_SMALL: return "Payment must be at least the monthly payment amount!";
+        case TxnStatus::NOT_SAVINGS_ACCOUNT: return "Not a savings account!";
+        case TxnStatus::INSTALLMENT_NOT_DUE: return "No installment is due yet!";
+        case TxnStatus::REQUEST_ID_CONFLICT: return "Request ID was already used for a different operation!";
+        case TxnStatus::TRANSFER_NOT_PREPARED: return "No prepared transfer with that ID!";
+        case TxnStatus::SHARD_UNAVAILABLE: return "A shard holding one of the accounts could not be reached!";
+        case TxnStatus::RISK_DECLINED: return "Declined by a fraud or velocity rule!";
+        case TxnStatus::NOT_DURABLE: return "Could not be saved to the journal and may be lost on restart!";
+    }
+    return "Unknown error!";
+}
+
+const char* statusName(TxnStatus status) {
+    switch (status) {
+        case TxnStatus::OK: return "OK";
+        case TxnStatus::INVALID_AMOUNT: return "INVALID_AMOUNT";
+        case TxnStatus::INSUFFICIENT_FUNDS: return "INSUFFICIENT_FUNDS";
+        case TxnStatus::OVERDRAFT_EXCEEDED: return "OVERDRAFT_EXCEEDED";
+        case TxnStatus::ACCOUNT_NOT_FOUND: return "ACCOUNT_NOT_FOUND";
+        case TxnStatus::INVALID_LOAN_INDEX: return "INVALID_LOAN_INDEX";
+        case TxnStatus::LOAN_PAID_OFF: return "LOAN_PAID_OFF";
+        case TxnStatus::PAYMENT_TOO_SMALL: return "PAYMENT_TOO_SMALL";
+        case TxnStatus::NOT_SAVINGS_ACCOUNT: return "NOT_SAVINGS_ACCOUNT";
+        case TxnStatus::INSTALLMENT_NOT_DUE: return "INSTALLMENT_NOT_DUE";
+        case TxnStatus::REQUEST_ID_CONFLICT: return "REQUEST_ID_CONFLICT";
+        case TxnStatus::TRANSFER_NOT_PREPARED: return "TRANSFER_NOT_PREPARED";
+        case TxnStatus::SHARD_UNAVAILABLE: return "SHARD_UNAVAILABLE";
+        case TxnStatus::RISK_DECLINED: return "RISK_DECLINED";
+        case TxnStatus::NOT_DURABLE: return "NOT_DURABLE";
+    }
+    return "UNKNOWN";
+}
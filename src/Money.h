@@ -0,0 +1,168 @@
+#ifndef BANKING_MONEY_H
+#define BANKING_MONEY_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+// How results that fall between two cents are rounded. DOWN and UP round
+// toward and away from zero; the HALF_ modes round to the nearest cent and
+// differ only on exact ties.
+enum class RoundingMode {
+    HALF_EVEN,
+    HALF_UP,
+    DOWN,
+    UP
+};
+
+// Interest is credited with banker's rounding; loan installments are
+// rounded up so that paying every installment always covers the principal
+const RoundingMode INTEREST_ROUNDING = RoundingMode::HALF_EVEN;
+const RoundingMode PAYMENT_ROUNDING = RoundingMode::UP;
+
+// Interest rates are stored as integer parts per million (3.5% == 35000)
+const int64_t RATE_SCALE = 1000000;
+
+int64_t percentToRate(double percent);
+
+double rateToPercent(int64_t rate);
+
+// Fixed-point money amount held as a whole number of cents, so balances
+// never drift and replaying the same operations gives bit-identical results
+class Money {
+private:
+    int64_t cents;
+
+    explicit constexpr Money(int64_t c) : cents(c) {}
+
+public:
+    constexpr Money() : cents(0) {}
+
+    static constexpr Money fromCents(int64_t c) { return Money(c); }
+
+    // Rounds to the nearest cent; used for amounts typed in by users
+    static Money fromDouble(double amount) { return Money(llround(amount * 100)); }
+
+    static Money roundCents(long double cents, RoundingMode mode) {
+        switch (mode) {
+            case RoundingMode::HALF_EVEN: return Money(static_cast<int64_t>(rintl(cents)));
+            case RoundingMode::HALF_UP: return Money(static_cast<int64_t>(roundl(cents)));
+            case RoundingMode::DOWN: return Money(static_cast<int64_t>(truncl(cents)));
+            case RoundingMode::UP: break;
+        }
+        return Money(static_cast<int64_t>(cents < 0 ? floorl(cents) : ceill(cents)));
+    }
+
+    // Parses "[-]digits[.digits]" exactly; digits past the cents are rounded
+    // half up. Advances p past the number.
+    static bool parse(const char*& p, const char* end, Money& out) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        bool negative = p < end && *p == '-';
+        if (negative) ++p;
+        int64_t value = 0;
+        int digits = 0;
+        while (p < end && *p >= '0' && *p <= '9' && digits < 16) {
+            value = value * 10 + (*p++ - '0');
+            ++digits;
+        }
+        int64_t fraction = 0;
+        int fractionDigits = 0;
+        if (p < end && *p == '.') {
+            ++p;
+            while (p < end && *p >= '0' && *p <= '9') {
+                if (fractionDigits < 2) {
+                    fraction = fraction * 10 + (*p - '0');
+                } else if (fractionDigits == 2 && *p >= '5') {
+                    ++fraction;
+                }
+                ++fractionDigits;
+                ++p;
+            }
+        }
+        if (digits == 0 && fractionDigits == 0) return false;
+        if (p < end && *p >= '0' && *p <= '9') return false;     // too many digits
+        if (fractionDigits == 1) fraction *= 10;
+        int64_t total = value * 100 + fraction;
+        out = Money(negative ? -total : total);
+        return true;
+    }
+
+    // this * num / den, computed exactly and rounded to a cent with mode
+    Money mulDiv(int64_t num, int64_t den, RoundingMode mode) const {
+        __int128 n = static_cast<__int128>(cents) * num;
+        __int128 q = n / den;
+        __int128 r = n % den;
+        if (r != 0) {
+            bool negative = (n < 0) != (den < 0);
+            __int128 twice = 2 * (r < 0 ? -r : r);
+            __int128 d = den < 0 ? -static_cast<__int128>(den) : den;
+            bool away = false;
+            switch (mode) {
+                case RoundingMode::HALF_EVEN: away = twice > d || (twice == d && (q & 1)); break;
+                case RoundingMode::HALF_UP: away = twice >= d; break;
+                case RoundingMode::DOWN: away = false; break;
+                case RoundingMode::UP: away = true; break;
+            }
+            if (away) q += negative ? -1 : 1;
+        }
+        return Money(static_cast<int64_t>(q));
+    }
+
+    int64_t getCents() const { return cents; }
+    double toDouble() const { return cents / 100.0; }
+
+    string toString() const {
+        uint64_t magnitude = cents < 0 ? -static_cast<uint64_t>(cents) : cents;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%s%llu.%02llu", cents < 0 ? "-" : "",
+                 static_cast<unsigned long long>(magnitude / 100),
+                 static_cast<unsigned long long>(magnitude % 100));
+        return buf;
+    }
+
+    Money operator+(Money o) const { return Money(cents + o.cents); }
+    Money operator-(Money o) const { return Money(cents - o.cents); }
+    Money operator-() const { return Money(-cents); }
+    Money& operator+=(Money o) { cents += o.cents; return *this; }
+    Money& operator-=(Money o) { cents -= o.cents; return *this; }
+    bool operator==(Money o) const { return cents == o.cents; }
+    bool operator!=(Money o) const { return cents != o.cents; }
+    bool operator<(Money o) const { return cents < o.cents; }
+    bool operator<=(Money o) const { return cents <= o.cents; }
+    bool operator>(Money o) const { return cents > o.cents; }
+    bool operator>=(Money o) const { return cents >= o.cents; }
+};
+
+ostream& operator<<(ostream& os, Money m);
+
+// Outcome of a banking operation
+enum class TxnStatus {
+    OK,
+    INVALID_AMOUNT,
+    INSUFFICIENT_FUNDS,
+    OVERDRAFT_EXCEEDED,
+    ACCOUNT_NOT_FOUND,
+    INVALID_LOAN_INDEX,
+    LOAN_PAID_OFF,
+    PAYMENT_TOO_SMALL,
+    NOT_SAVINGS_ACCOUNT,
+    INSTALLMENT_NOT_DUE,
+    REQUEST_ID_CONFLICT,
+    TRANSFER_NOT_PREPARED,
+    SHARD_UNAVAILABLE,
+    RISK_DECLINED,
+    NOT_DURABLE         // applied, but the journal failed before it was on disk
+};
+
+const size_t TXN_STATUS_COUNT = static_cast<size_t>(TxnStatus::NOT_DURABLE) + 1;
+
+string statusMessage(TxnStatus status);
+
+// Stable machine-readable name, used in batch result files
+const char* statusName(TxnStatus status);
+
+#endif
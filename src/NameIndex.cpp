@@ -0,0 +1,287 @@
+#include "NameIndex.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "Account.h"
+
+namespace {
+
+// The delta is merged once it holds this many accounts, or one per
+// MERGE_RATIO in the run if that is more
+const size_t MIN_MERGE = 4096;
+const size_t MERGE_RATIO = 16;
+
+// Rough heap cost of a delta entry beyond its name's bytes: the tree node
+// with the key and the account
+const size_t DELTA_ENTRY_BYTES = 80;
+
+// A name's first 8 bytes (zero padded) as a big-endian number: names in
+// order give these in order
+uint64_t namePrefix(string_view name) {
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        prefix = (prefix << 8) | (i < name.size() ? static_cast<uint8_t>(name[i]) : 0);
+    }
+    return prefix;
+}
+
+} // namespace
+
+size_t NameIndex::Run::lowerBound(string_view key) const {
+    // Names sampled below the key's prefix are below the key, and those
+    // above it are above, which leaves the names between two samples
+    uint64_t prefix = namePrefix(key);
+    size_t below = lower_bound(sample.begin(), sample.end(), prefix) - sample.begin();
+    size_t above = upper_bound(sample.begin() + below, sample.end(), prefix) - sample.begin();
+    size_t lo = below == 0 ? 0 : (below - 1) * SAMPLE_EVERY + 1;
+    size_t hi = min(names(), above * SAMPLE_EVERY);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (name(mid) < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void NameIndex::Run::add(string_view n, Account* const* begin, Account* const* end) {
+    if (names() == 0 || name(names() - 1) != n) {
+        text.append(n.data(), n.size());
+        nameStart.push_back(text.size());
+        firstAccount.push_back(firstAccount.back());
+    }
+    accounts.insert(accounts.end(), begin, end);
+    firstAccount.back() += end - begin;
+}
+
+void NameIndex::Run::finish() {
+    sample.clear();
+    sample.reserve(names() / SAMPLE_EVERY + 1);
+    for (size_t i = 0; i < names(); i += SAMPLE_EVERY) {
+        sample.push_back(namePrefix(name(i)));
+    }
+}
+
+size_t NameIndex::Run::memoryBytes() const {
+    return text.capacity() + (nameStart.capacity() + sample.capacity()) * sizeof(uint64_t) +
+           firstAccount.capacity() * sizeof(uint32_t) + accounts.capacity() * sizeof(Account*);
+}
+
+string NameIndex::fold(string_view name) {
+    string out(name);
+    foldInPlace(out);
+    return out;
+}
+
+void NameIndex::foldInPlace(string& name) {
+    for (char& c : name) {
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    }
+}
+
+shared_ptr<const NameIndex::Run> NameIndex::merge(const Run& run, const Delta& added) {
+    auto out = make_shared<Run>();
+    size_t addedText = 0;
+    for (const auto& entry : added) {
+        addedText += entry.first.size();
+    }
+    out->text.reserve(run.text.size() + addedText);
+    out->nameStart.reserve(run.names() + added.size() + 1);
+    out->firstAccount.reserve(run.names() + added.size() + 1);
+    out->accounts.reserve(run.accounts.size() + added.size());
+
+    size_t i = 0;
+    auto it = added.begin();
+    while (i < run.names() || it != added.end()) {
+        if (it == added.end() || (i < run.names() && run.name(i) <= it->first)) {
+            out->add(run.name(i), run.accounts.data() + run.firstAccount[i],
+                     run.accounts.data() + run.firstAccount[i + 1]);
+            ++i;
+        } else {
+            out->add(it->first, &it->second, &it->second + 1);
+            ++it;
+        }
+    }
+    out->finish();
+    return out;
+}
+
+NameIndex::~NameIndex() {
+    {
+        unique_lock<shared_mutex> lock(mtx);
+        stopping = true;
+    }
+    mergeCv.notify_all();
+    if (merger.joinable()) merger.join();
+}
+
+bool NameIndex::mergeDue() const {
+    return !merging && delta.size() >= max(MIN_MERGE, base->accounts.size() / MERGE_RATIO);
+}
+
+void NameIndex::mergeLoop() {
+    unique_lock<shared_mutex> lock(mtx);
+    while (true) {
+        mergeCv.wait(lock, [this] { return stopping || merging; });
+        if (stopping) return;
+        shared_ptr<const Run> from = base;
+        shared_ptr<const Delta> added = frozen;
+        lock.unlock();
+        shared_ptr<const Run> merged = merge(*from, *added);
+        lock.lock();
+        base = move(merged);
+        frozen.reset();
+        merging = false;
+        // Inserts during the merge may already call for the next one
+        if (mergeDue()) {
+            merging = true;
+            frozen = make_shared<const Delta>(move(delta));
+            delta.clear();
+        }
+        mergeCv.notify_all();
+    }
+}
+
+void NameIndex::waitMerged(unique_lock<shared_mutex>& lock) {
+    mergeCv.wait(lock, [this] { return !merging; });
+}
+
+void NameIndex::insert(Account* acc) {
+    string name = acc->getAccountHolder();
+    foldInPlace(name);
+    {
+        unique_lock<shared_mutex> lock(mtx);
+        delta.emplace(move(name), acc);
+        if (!mergeDue()) return;
+        merging = true;
+        frozen = make_shared<const Delta>(move(delta));
+        delta.clear();
+        if (!merger.joinable()) merger = thread(&NameIndex::mergeLoop, this);
+    }
+    mergeCv.notify_all();
+}
+
+void NameIndex::assign(const vector<Account*>& accounts) {
+    // Every folded name back to back, then (name, account) pairs sorted
+    string folded;
+    vector<uint64_t> start;
+    start.reserve(accounts.size() + 1);
+    for (Account* acc : accounts) {
+        start.push_back(folded.size());
+        folded += acc->getAccountHolder();
+    }
+    foldInPlace(folded);
+    start.push_back(folded.size());
+    vector<pair<string_view, Account*>> order;
+    order.reserve(accounts.size());
+    for (size_t i = 0; i < accounts.size(); ++i) {
+        order.emplace_back(string_view(folded).substr(start[i], start[i + 1] - start[i]), accounts[i]);
+    }
+    vector<uint64_t>().swap(start);
+    sort(order.begin(), order.end(), [](const pair<string_view, Account*>& a, const pair<string_view, Account*>& b) {
+        return a.first < b.first;
+    });
+
+    auto run = make_shared<Run>();
+    run->text.reserve(folded.size());
+    run->accounts.reserve(accounts.size());
+    for (const auto& entry : order) {
+        run->add(entry.first, &entry.second, &entry.second + 1);
+    }
+    run->text.shrink_to_fit();
+    run->nameStart.shrink_to_fit();
+    run->firstAccount.shrink_to_fit();
+    run->finish();
+
+    unique_lock<shared_mutex> lock(mtx);
+    waitMerged(lock);
+    base = move(run);
+    delta.clear();
+}
+
+void NameIndex::swap(NameIndex& other) {
+    // Each merger writes to its own index, so neither may be mid-merge
+    // when the contents change hands
+    unique_lock<shared_mutex> mine(mtx, defer_lock), theirs(other.mtx, defer_lock);
+    mine.lock();
+    waitMerged(mine);
+    mine.unlock();
+    theirs.lock();
+    other.waitMerged(theirs);
+    theirs.unlock();
+    lock(mine, theirs);
+    base.swap(other.base);
+    delta.swap(other.delta);
+}
+
+void NameIndex::find(string_view text, NameMatch match, const function<bool(Account*)>& visit) const {
+    string key = fold(text);
+    bool prefix = match == NameMatch::PREFIX;
+    auto matches = [&](string_view name) {
+        return prefix ? name.substr(0, key.size()) == key : name == key;
+    };
+
+    shared_lock<shared_mutex> lock(mtx);
+    // A cursor per source at its next name, merged in name order; on equal
+    // names the run goes first, then the frozen delta, then the live one
+    const Run& run = *base;
+    size_t next = run.lowerBound(key);
+    const Delta* deltas[2] = {frozen.get(), &delta};
+    Delta::const_iterator cursors[2];
+    for (size_t d = 0; d < 2; ++d) {
+        if (deltas[d]) cursors[d] = deltas[d]->lower_bound(key);
+    }
+    while (true) {
+        int from = -1;      // 0 for the run, 1 + d for deltas[d]
+        string_view best;
+        if (next < run.names() && matches(run.name(next))) {
+            from = 0;
+            best = run.name(next);
+        }
+        for (size_t d = 0; d < 2; ++d) {
+            if (!deltas[d] || cursors[d] == deltas[d]->end()) continue;
+            string_view name = cursors[d]->first;
+            if (matches(name) && (from < 0 || name < best)) {
+                from = 1 + d;
+                best = name;
+            }
+        }
+        if (from < 0) return;
+
+        Account* const* begin;
+        Account* const* end;
+        if (from == 0) {
+            begin = run.accounts.data() + run.firstAccount[next];
+            end = run.accounts.data() + run.firstAccount[next + 1];
+            ++next;
+        } else {
+            begin = &cursors[from - 1]->second;
+            end = begin + 1;
+            ++cursors[from - 1];
+        }
+        for (; begin != end; ++begin) {
+            if (match == NameMatch::EXACT && (*begin)->getAccountHolder() != text) continue;
+            if (!visit(*begin)) return;
+        }
+    }
+}
+
+size_t NameIndex::size() const {
+    shared_lock<shared_mutex> lock(mtx);
+    return base->accounts.size() + (frozen ? frozen->size() : 0) + delta.size();
+}
+
+size_t NameIndex::memoryBytes() const {
+    shared_lock<shared_mutex> lock(mtx);
+    size_t bytes = base->memoryBytes();
+    for (const Delta* d : {frozen.get(), &delta}) {
+        if (!d) continue;
+        for (const auto& entry : *d) {
+            bytes += DELTA_ENTRY_BYTES + entry.first.capacity();
+        }
+    }
+    return bytes;
+}
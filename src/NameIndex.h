@@ -0,0 +1,124 @@
+#ifndef BANKING_NAME_INDEX_H
+#define BANKING_NAME_INDEX_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class Account;
+
+// How account holder names are compared by a search
+enum class NameMatch : uint8_t {
+    EXACT,          // the whole name, same case
+    IGNORE_CASE,    // the whole name, any case
+    PREFIX          // names starting with the text, any case
+};
+
+// Secondary index from account holder name to account, for exact,
+// case-insensitive and prefix searches. Names are kept case-folded (ASCII
+// only; other bytes compare as they are) and in order, so every search is
+// a binary search followed by a walk over the matching names.
+//
+// Most accounts live in one immutable sorted run: the distinct names back
+// to back in one string, an offset per name and one flat array of account
+// pointers grouped by name, so a name costs its bytes plus 12, and an
+// account 8 more. A sample of every 16th name's first bytes keeps most of
+// a search's probes in a small array. New accounts go to a small ordered
+// delta. Once the delta holds a sixteenth as many accounts as the run, the
+// insert that tipped it freezes it and wakes a merger thread, which builds
+// the new run outside the lock; searches and inserts carry on against the
+// old run, the frozen delta and a fresh one meanwhile, and no insert waits
+// for a merge.
+//
+// Accounts are never taken out. The bank deactivates accounts rather than
+// deleting them, and has no operation that does so, so a search checks
+// each account it visits (see Bank::findAccountsByHolder) instead of the
+// index dropping it.
+class NameIndex {
+private:
+    struct Run {
+        string text;                    // distinct names, ascending, back to back
+        vector<uint64_t> nameStart;     // name i is text[nameStart[i], nameStart[i + 1])
+        vector<uint32_t> firstAccount;  // name i's accounts are accounts[firstAccount[i], firstAccount[i + 1])
+        vector<Account*> accounts;
+        // The first 8 bytes of every SAMPLE_EVERY-th name as a big-endian
+        // number, so a search narrows down to a few names in a small array
+        // before it touches the text
+        vector<uint64_t> sample;
+
+        static const size_t SAMPLE_EVERY = 16;
+
+        Run() : nameStart(1, 0), firstAccount(1, 0) {}
+
+        size_t names() const { return nameStart.size() - 1; }
+        string_view name(size_t i) const {
+            return string_view(text).substr(nameStart[i], nameStart[i + 1] - nameStart[i]);
+        }
+        // First name not less than key
+        size_t lowerBound(string_view key) const;
+        // Appends accounts under a name; names must arrive in order
+        void add(string_view name, Account* const* begin, Account* const* end);
+        // Builds the sample once every name is added
+        void finish();
+        size_t memoryBytes() const;
+    };
+
+    using Delta = multimap<string, Account*, less<>>;
+
+    mutable shared_mutex mtx;
+    shared_ptr<const Run> base;
+    // The delta being merged into base, if a merge is running
+    shared_ptr<const Delta> frozen;
+    Delta delta;
+    bool merging;
+    bool stopping;
+    // Wakes the merger when a delta is frozen, and waiters when it is merged
+    condition_variable_any mergeCv;
+    thread merger;                      // started by the first merge
+
+    static void foldInPlace(string& name);
+    static shared_ptr<const Run> merge(const Run& run, const Delta& added);
+    void mergeLoop();
+    // Caller holds mtx
+    bool mergeDue() const;
+    void waitMerged(unique_lock<shared_mutex>& lock);
+
+public:
+    NameIndex() : base(make_shared<Run>()), merging(false), stopping(false) {}
+    ~NameIndex();
+
+    NameIndex(const NameIndex&) = delete;
+    NameIndex& operator=(const NameIndex&) = delete;
+
+    // The form names are indexed and searched under
+    static string fold(string_view name);
+
+    void insert(Account* acc);
+
+    // Replaces the contents with these accounts, sorted in one pass.
+    // assign and swap must not overlap inserts; they wait for a running
+    // merge to finish.
+    void assign(const vector<Account*>& accounts);
+
+    void swap(NameIndex& other);
+
+    // Calls visit with each account whose holder name matches text, in
+    // folded-name order (accounts sharing a name in no particular order),
+    // until visit returns false. Holds the index shared, so visit must not
+    // insert.
+    void find(string_view text, NameMatch match, const function<bool(Account*)>& visit) const;
+
+    size_t size() const;
+    size_t memoryBytes() const;
+};
+
+#endif
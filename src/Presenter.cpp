@@ -0,0 +1,236 @@
+#include "Presenter.h"
+
+#include <iomanip>
+
+void Presenter::transactionHeader(ostream& out) {
+    out << setw(23) << "Transaction ID"
+        << setw(12) << "Type"
+        << setw(12) << "Amount"
+        << setw(22) << "Date"
+        << "  Description\n";
+    out << string(90, '-') << '\n';
+}
+
+void Presenter::details(ostream& out, const SavingsAccount& acc) {
+    out << "Interest Rate: " << fixed << setprecision(2) << rateToPercent(acc.getInterestRate()) << "%\n";
+}
+
+void Presenter::details(ostream& out, const CheckingAccount& acc) {
+    out << "Overdraft Limit: $" << acc.getOverdraftLimit() << '\n';
+}
+
+void Presenter::account(ostream& out, const Account& acc) {
+    out << "\n========================================\n";
+    out << "Account Type: " << acc.getAccountType() << '\n';
+    out << "Account Number: " << acc.getAccountNumber() << '\n';
+    out << "Account Holder: " << acc.getAccountHolder() << '\n';
+    out << "Balance: $" << acc.getBalance() << '\n';
+    out << "Created: " << DateTime::format(acc.getCreatedAt()) << '\n';
+    out << "Status: " << (acc.getIsActive() ? "Active" : "Inactive") << '\n';
+    out << "========================================\n";
+    acc.visit([&out](const auto& concrete) { details(out, concrete); });
+}
+
+void Presenter::loan(ostream& out, const Loan& loan) {
+    out << "\n--- Loan Details ---\n";
+    out << "Loan ID: LOAN" << loan.getLoanId() << '\n';
+    out << "Start Date: " << DateTime::format(loan.getStartedAt()) << '\n';
+    out << "Principal: $" << loan.getPrincipal() << '\n';
+    out << "Interest Rate: " << fixed << setprecision(2) << rateToPercent(loan.getInterestRate()) << "%\n";
+    out << "Term: " << loan.getTermMonths() << " months\n";
+    out << "Monthly Payment: $" << loan.getMonthlyPayment() << '\n';
+    out << "Payments Made: " << loan.getPaymentsMade() << '\n';
+    out << "Remaining Balance: $" << loan.getRemainingBalance() << '\n';
+    if (loan.getIsActive()) {
+        out << "Next Payment Due: " << DateTime::format(loan.nextInstallment().dueAt) << '\n';
+    }
+    out << "Status: " << (loan.getIsActive() ? "Active" : "Paid Off") << '\n';
+}
+
+void Presenter::loans(ostream& out, const Account& acc) {
+    if (acc.getLoanCount() == 0) {
+        out << "\nNo loans on this account.\n";
+        return;
+    }
+
+    out << "\n--- Loans ---\n";
+    for (size_t i = 0; i < acc.getLoanCount(); ++i) {
+        out << "\nLoan #" << i + 1;
+        loan(out, acc.getLoan(i));
+    }
+}
+
+void Presenter::loanSchedule(ostream& out, const Loan& loan) {
+    vector<Installment> installments = loan.schedule();
+    out << "\n--- Payment Schedule (LOAN" << loan.getLoanId() << ") ---\n";
+    if (installments.empty()) {
+        out << "This loan is paid off.\n";
+        return;
+    }
+    out << setw(4) << "#"
+        << setw(22) << "Due Date"
+        << setw(13) << "Payment"
+        << setw(13) << "Interest"
+        << setw(13) << "Principal"
+        << setw(15) << "Remaining" << '\n';
+    out << string(80, '-') << '\n';
+    for (const auto& due : installments) {
+        out << setw(4) << due.number
+            << setw(22) << DateTime::format(due.dueAt)
+            << setw(13) << due.payment
+            << setw(13) << due.interest
+            << setw(13) << due.principal
+            << setw(15) << due.remaining << '\n';
+    }
+}
+
+void Presenter::transaction(ostream& out, const Transaction& txn) {
+    string description = txnTypeDescription(txn.getType());
+    if (txn.getType() == TxnType::TRANSFER_OUT || txn.getType() == TxnType::TRANSFER_IN) {
+        description += formatAccountNumber(txn.getCounterparty());
+    }
+    out << setw(23) << "TXN" + to_string(txn.getId())
+        << setw(12) << txnTypeName(txn.getType())
+        << setw(12) << txn.getAmount()
+        << setw(22) << DateTime::format(txn.getTimestamp())
+        << "  " << description << '\n';
+}
+
+void Presenter::transactionHistory(ostream& out, const Account& acc) {
+    out << "\n--- Transaction History ---\n";
+    if (acc.getTransactionCount() == 0) {
+        out << "No transactions yet.\n";
+        return;
+    }
+
+    transactionHeader(out);
+    acc.getHistory().forEachChunk([&out](const Transaction* records, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            transaction(out, records[i]);
+        }
+    });
+}
+
+void Presenter::transactions(ostream& out, const vector<Transaction>& txns) {
+    out << "\n--- Transaction History ---\n";
+    if (txns.empty()) {
+        out << "No matching transactions.\n";
+        return;
+    }
+    transactionHeader(out);
+    for (const auto& t : txns) {
+        transaction(out, t);
+    }
+}
+
+void Presenter::accountList(ostream& out, const vector<AccountRow>& rows) {
+    if (rows.empty()) {
+        out << "\nNo accounts in the system.\n";
+        return;
+    }
+
+    out << "\n========== All Accounts ==========\n";
+    accountTable(out, rows);
+}
+
+void Presenter::accountMatches(ostream& out, const vector<AccountRow>& rows, size_t limit) {
+    if (rows.empty()) {
+        out << "\nNo matching accounts found!\n";
+        return;
+    }
+
+    out << "\n========== Matching Accounts ==========\n";
+    accountTable(out, rows);
+    if (rows.size() == limit) {
+        out << "(first " << limit << " matches shown)\n";
+    }
+}
+
+void Presenter::accountTable(ostream& out, const vector<AccountRow>& rows) {
+    out << setw(24) << "Acc Number"
+        << setw(20) << "Holder Name"
+        << setw(15) << "Type"
+        << setw(15) << "Balance" << '\n';
+    out << string(74, '-') << '\n';
+    for (const auto& row : rows) {
+        out << setw(24) << formatAccountNumber(row.id)
+            << setw(20) << row.holder
+            << setw(15) << accountKindName(row.kind)
+            << setw(15) << row.balance << '\n';
+    }
+}
+
+void Presenter::summary(ostream& out, const BankTotals& totals, const vector<TopBalances::Entry>& top) {
+    out << "\n========== Bank Summary ==========\n";
+    out << "Accounts: " << totals.accounts << '\n';
+    for (size_t i = 0; i < ACCOUNT_KIND_COUNT; ++i) {
+        out << "Total " << accountKindName(static_cast<AccountKind>(i)) << " deposits: $"
+            << totals.deposits[i] << '\n';
+    }
+    out << "Outstanding loans: $" << totals.outstandingLoans << '\n';
+    out << "Overdrawn checking accounts: " << totals.overdrawnChecking << '\n';
+    out << "\nTop balances:\n";
+    for (const auto& entry : top) {
+        out << setw(24) << formatAccountNumber(entry.id) << setw(15) << entry.balance << '\n';
+    }
+}
+
+void Presenter::metrics(ostream& out, const MetricsSnapshot& snapshot) {
+    out << "\n========== Operation Metrics ==========\n";
+    out << setw(18) << "Operation"
+        << setw(12) << "OK"
+        << setw(12) << "Failed"
+        << setw(12) << "p50 (us)"
+        << setw(12) << "p99 (us)"
+        << setw(12) << "Max (us)" << '\n';
+    out << string(78, '-') << '\n';
+    auto micros = [](uint64_t nanos) { return nanos / 1000.0; };
+    for (size_t op = 0; op < METRIC_OP_COUNT; ++op) {
+        uint64_t total = snapshot.total(static_cast<MetricOp>(op));
+        if (total == 0) continue;
+        uint64_t ok = snapshot.counts[op][static_cast<size_t>(TxnStatus::OK)];
+        // Failures are usually fast; show them only for operations that never succeeded
+        const LatencySummary& latency = snapshot.ok[op].count > 0 ? snapshot.ok[op] : snapshot.failed[op];
+        out << setw(18) << metricOpName(static_cast<MetricOp>(op))
+            << setw(12) << ok
+            << setw(12) << total - ok
+            << fixed << setprecision(2)
+            << setw(12) << micros(latency.quantile(0.5))
+            << setw(12) << micros(latency.quantile(0.99))
+            << setw(12) << micros(latency.maxNanos) << '\n';
+    }
+
+    bool header = false;
+    for (size_t op = 0; op < METRIC_OP_COUNT; ++op) {
+        for (size_t st = 1; st < TXN_STATUS_COUNT; ++st) {
+            if (snapshot.counts[op][st] == 0) continue;
+            if (!header) {
+                out << "\nFailures:\n";
+                header = true;
+            }
+            out << setw(18) << metricOpName(static_cast<MetricOp>(op))
+                << setw(24) << statusName(static_cast<TxnStatus>(st))
+                << setw(12) << snapshot.counts[op][st] << '\n';
+        }
+    }
+}
+
+void Presenter::riskRules(ostream& out, const vector<RiskRuleStats>& rules) {
+    out << "\n========== Risk Rules ==========\n";
+    out << setw(24) << "Rule" << setw(10) << "Action" << setw(12) << "Hits" << '\n';
+    out << string(46, '-') << '\n';
+    for (const RiskRuleStats& rule : rules) {
+        out << setw(24) << rule.name
+            << setw(10) << (rule.action == RiskAction::DECLINE ? "decline" : "flag")
+            << setw(12) << rule.hits << '\n';
+    }
+}
+
+void Presenter::changeFeed(ostream& out, const ChangeFeedStats& stats) {
+    out << "\n========== Change Feed ==========\n";
+    out << "Events Published: " << stats.published << '\n';
+    out << "Events Written: " << stats.written << '\n';
+    out << "Full-Ring Waits: " << stats.stalls << '\n';
+    out << "Failed Writes: " << stats.writeErrors << '\n';
+    out << "Dropped Events: " << stats.dropped << '\n';
+}
@@ -0,0 +1,38 @@
+#ifndef BANKING_PRESENTER_H
+#define BANKING_PRESENTER_H
+
+#include <ostream>
+#include <vector>
+
+#include "Bank.h"
+#include "Metrics.h"
+
+using namespace std;
+
+// Presenter class. Turns what the core returns (accounts, loans, history
+// query results, totals) into the text people read. The core itself never
+// writes output. Callers hold an account's lock while it is shown.
+class Presenter {
+private:
+    static void transactionHeader(ostream& out);
+    static void details(ostream& out, const SavingsAccount& acc);
+    static void details(ostream& out, const CheckingAccount& acc);
+    static void accountTable(ostream& out, const vector<AccountRow>& rows);
+
+public:
+    static void account(ostream& out, const Account& acc);
+    static void loan(ostream& out, const Loan& loan);
+    static void loans(ostream& out, const Account& acc);
+    static void loanSchedule(ostream& out, const Loan& loan);
+    static void transaction(ostream& out, const Transaction& txn);
+    static void transactionHistory(ostream& out, const Account& acc);
+    static void transactions(ostream& out, const vector<Transaction>& txns);
+    static void accountList(ostream& out, const vector<AccountRow>& rows);
+    static void accountMatches(ostream& out, const vector<AccountRow>& rows, size_t limit);
+    static void summary(ostream& out, const BankTotals& totals, const vector<TopBalances::Entry>& top);
+    static void metrics(ostream& out, const MetricsSnapshot& snapshot);
+    static void riskRules(ostream& out, const vector<RiskRuleStats>& rules);
+    static void changeFeed(ostream& out, const ChangeFeedStats& stats);
+};
+
+#endif
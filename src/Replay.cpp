@@ -0,0 +1,225 @@
+#include "Replay.h"
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include "Zipf.h"
+
+namespace {
+
+// Head start the workers get to be waiting before the first due time
+const int64_t START_DELAY = 20000000;
+// Workers sleep until shortly before an operation is due, then yield
+const int64_t SPIN_WINDOW = 200000;
+
+// The operation kind a record is reported under; false if the record is
+// not a replayable operation
+bool metricOpFor(JournalOp op, MetricOp& out) {
+    switch (op) {
+        case JournalOp::CREATE_SAVINGS:
+        case JournalOp::CREATE_CHECKING: out = MetricOp::CREATE_ACCOUNT; return true;
+        case JournalOp::DEPOSIT: out = MetricOp::DEPOSIT; return true;
+        case JournalOp::WITHDRAW: out = MetricOp::WITHDRAW; return true;
+        case JournalOp::TRANSFER: out = MetricOp::TRANSFER; return true;
+        case JournalOp::APPLY_LOAN: out = MetricOp::APPLY_LOAN; return true;
+        case JournalOp::PAY_LOAN: out = MetricOp::PAY_LOAN; return true;
+        case JournalOp::APPLY_INTEREST: out = MetricOp::APPLY_INTEREST; return true;
+        default: return false;
+    }
+}
+
+// One operation ready to issue, with the replay bank's account ids
+struct Step {
+    int64_t due;                // nanoseconds after the start
+    uint64_t account;
+    uint64_t counterparty;
+    const TraceRecord* rec;
+    MetricOp metric;
+};
+
+TxnStatus issue(Bank& bank, const Step& step) {
+    const TraceRecord& rec = *step.rec;
+    Money amt = Money::fromCents(rec.amount);
+    switch (rec.op) {
+        case JournalOp::CREATE_SAVINGS:
+            bank.createSavingsAccount("Replay");
+            return TxnStatus::OK;
+        case JournalOp::CREATE_CHECKING:
+            bank.createCheckingAccount("Replay");
+            return TxnStatus::OK;
+        case JournalOp::DEPOSIT:
+            return bank.deposit(step.account, amt, rec.requestId);
+        case JournalOp::WITHDRAW:
+            return bank.withdraw(step.account, amt, rec.requestId);
+        case JournalOp::TRANSFER:
+            return bank.transfer(step.account, step.counterparty, amt, rec.requestId);
+        case JournalOp::APPLY_LOAN:
+            return bank.applyLoan(step.account, amt, rec.rate, rec.count);
+        case JournalOp::PAY_LOAN:
+            return bank.payLoan(step.account, rec.count, amt);
+        case JournalOp::APPLY_INTEREST:
+        default: {
+            Money interest;
+            return bank.applyInterest(step.account, interest);
+        }
+    }
+}
+
+} // namespace
+
+ReplayReport replayTrace(Bank& bank, const vector<TraceRecord>& trace, const ReplayOptions& options) {
+    ReplayReport report;
+    unsigned threads = max(1u, options.threads);
+
+    vector<Step> steps;
+    steps.reserve(trace.size());
+    for (const TraceRecord& rec : trace) {
+        MetricOp metric;
+        if (metricOpFor(rec.op, metric)) {
+            steps.push_back(Step{0, rec.account, rec.counterparty, &rec, metric});
+        } else {
+            ++report.skipped;
+        }
+    }
+
+    // Open the accounts and point every step at them
+    if (options.accounts > 0) {
+        vector<uint64_t> ids;
+        ids.reserve(options.accounts);
+        for (size_t i = 0; i < options.accounts; ++i) {
+            ids.push_back(i % 2 == 0 ? bank.createSavingsAccount("Replay", options.opening)
+                                     : bank.createCheckingAccount("Replay", options.opening));
+        }
+        mt19937_64 rng(options.seed);
+        shuffle(ids.begin(), ids.end(), rng);
+        ZipfDistribution ranks(ids.size(), options.skew);
+        for (Step& step : steps) {
+            step.account = ids[ranks(rng)];
+            step.counterparty = ids[ranks(rng)];
+            while (step.counterparty == step.account && ids.size() > 1) step.counterparty = ids[ranks(rng)];
+        }
+        report.accounts = ids.size();
+    } else {
+        // Recorded id -> whether it has to be a savings account, in order of appearance
+        unordered_map<uint64_t, size_t> seen;
+        vector<pair<uint64_t, bool>> wanted;
+        auto want = [&](uint64_t id, bool savings) {
+            auto found = seen.emplace(id, wanted.size());
+            if (found.second) wanted.emplace_back(id, savings);
+            else wanted[found.first->second].second |= savings;
+        };
+        for (const Step& step : steps) {
+            JournalOp op = step.rec->op;
+            want(step.account, op == JournalOp::CREATE_SAVINGS || op == JournalOp::APPLY_INTEREST);
+            if (op == JournalOp::TRANSFER) want(step.counterparty, false);
+        }
+        unordered_map<uint64_t, uint64_t> mapped;
+        mapped.reserve(wanted.size());
+        for (const auto& w : wanted) {
+            mapped[w.first] = w.second ? bank.createSavingsAccount("Replay", options.opening)
+                                       : bank.createCheckingAccount("Replay", options.opening);
+        }
+        for (Step& step : steps) {
+            step.account = mapped[step.account];
+            if (step.rec->op == JournalOp::TRANSFER) step.counterparty = mapped[step.counterparty];
+        }
+        report.accounts = wanted.size();
+    }
+
+    // Due times, and each account's operations to one worker
+    vector<vector<const Step*>> queues(threads);
+    int64_t firstAt = steps.empty() ? 0 : steps[0].rec->at;
+    for (size_t i = 0; i < steps.size(); ++i) {
+        Step& step = steps[i];
+        if (options.pace == ReplayPace::RECORDED) {
+            step.due = max<int64_t>(0, static_cast<int64_t>((step.rec->at - firstAt) / options.speed));
+        } else if (options.pace == ReplayPace::RATE) {
+            step.due = static_cast<int64_t>(i * 1e9 / options.rate);
+        }
+        bool creates = step.metric == MetricOp::CREATE_ACCOUNT;
+        uint64_t key = creates ? i : (step.account * 0x9E3779B97F4A7C15ull) >> 32;
+        queues[key % threads].push_back(&step);
+        report.scheduledSeconds = max(report.scheduledSeconds, step.due / 1e9);
+    }
+
+    vector<vector<ReplayOpStats>> stats(threads, vector<ReplayOpStats>(METRIC_OP_COUNT));
+    vector<int64_t> lastDone(threads, 0);
+    vector<int64_t> maxLag(threads, 0);
+    int64_t start = Metrics::now() + START_DELAY;
+    auto worker = [&](unsigned t) {
+        for (const Step* step : queues[t]) {
+            int64_t due = start + step->due;
+            int64_t now = Metrics::now();
+            while (now < due) {
+                if (due - now > SPIN_WINDOW) {
+                    this_thread::sleep_for(chrono::nanoseconds(due - now - SPIN_WINDOW / 2));
+                } else {
+                    this_thread::yield();
+                }
+                now = Metrics::now();
+            }
+            // Closed loop: due as soon as the worker is free
+            if (options.pace == ReplayPace::MAX) due = now;
+            maxLag[t] = max(maxLag[t], now - due);
+            TxnStatus status = issue(bank, *step);
+            int64_t done = Metrics::now();
+            ReplayOpStats& s = stats[t][static_cast<size_t>(step->metric)];
+            s.latency.add(done - due);
+            ++s.statuses[static_cast<size_t>(status)];
+            lastDone[t] = done;
+        }
+    };
+    vector<thread> workers;
+    for (unsigned t = 1; t < threads; ++t) {
+        workers.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    int64_t end = start;
+    for (unsigned t = 0; t < threads; ++t) {
+        for (size_t op = 0; op < METRIC_OP_COUNT; ++op) {
+            report.ops[op].latency.merge(stats[t][op].latency);
+            for (size_t s = 0; s < TXN_STATUS_COUNT; ++s) report.ops[op].statuses[s] += stats[t][op].statuses[s];
+        }
+        end = max(end, lastDone[t]);
+        report.maxLagNanos = max(report.maxLagNanos, maxLag[t]);
+    }
+    report.total = steps.size();
+    report.seconds = (end - start) / 1e9;
+    return report;
+}
+
+vector<TraceRecord> generateTrace(const TraceShape& shape) {
+    vector<TraceRecord> out;
+    out.reserve(shape.operations);
+    mt19937_64 rng(shape.seed);
+    ZipfDistribution ranks(shape.accounts, shape.skew);
+    exponential_distribution<double> gap(shape.rate);
+    uniform_int_distribution<int64_t> cents(1, 5000);
+    double at = DateTime::nowNanos();
+    for (size_t i = 0; i < shape.operations; ++i) {
+        TraceRecord rec = {};
+        at += gap(rng) * 1e9;
+        rec.at = static_cast<int64_t>(at);
+        rec.account = ranks(rng) + 1;
+        rec.amount = cents(rng);
+        uint64_t kind = rng() % 100;
+        if (kind < 45) {
+            rec.op = JournalOp::DEPOSIT;
+        } else if (kind < 70) {
+            rec.op = JournalOp::WITHDRAW;
+        } else {
+            rec.op = JournalOp::TRANSFER;
+            do {
+                rec.counterparty = ranks(rng) + 1;
+            } while (rec.counterparty == rec.account && shape.accounts > 1);
+        }
+        out.push_back(rec);
+    }
+    return out;
+}
@@ -0,0 +1,75 @@
+#ifndef BANKING_REPLAY_H
+#define BANKING_REPLAY_H
+
+#include <vector>
+
+#include "Bank.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+using namespace std;
+
+// How replayed operations are spaced out
+enum class ReplayPace : uint8_t {
+    RECORDED,   // the recorded gaps, divided by speed
+    RATE,       // evenly, at rate operations per second
+    MAX         // each worker issues its next operation as soon as the last returns
+};
+
+struct ReplayOptions {
+    ReplayPace pace = ReplayPace::RECORDED;
+    double speed = 1;
+    double rate = 0;
+    unsigned threads = 1;
+    // With accounts > 0, every operation's accounts are drawn afresh from
+    // that many accounts with Zipf skew, instead of following the trace
+    size_t accounts = 0;
+    double skew = 0;
+    uint64_t seed = 42;
+    // Balance of each account opened for the replay
+    Money opening = Money::fromCents(100000000);
+};
+
+// Results of one kind of operation
+struct ReplayOpStats {
+    LatencySummary latency;
+    uint64_t statuses[TXN_STATUS_COUNT] = {};
+};
+
+struct ReplayReport {
+    ReplayOpStats ops[METRIC_OP_COUNT];
+    uint64_t total = 0;
+    uint64_t skipped = 0;           // records of operations that cannot be replayed
+    size_t accounts = 0;            // opened before the replay started
+    double seconds = 0;             // from the first operation's due time to the last completion
+    double scheduledSeconds = 0;    // from the first operation's due time to the last one's
+    int64_t maxLagNanos = 0;        // furthest any operation started behind its due time
+};
+
+// Replays a trace against bank. Accounts the trace refers to are opened
+// first (savings for those it creates as savings or credits interest to,
+// checking otherwise) and the trace's ids are mapped onto them; a
+// recorded account opening opens one more account. Operations are split
+// over the worker threads by account, so each account's operations run in
+// trace order, and each is issued at its due time from the start.
+//
+// Latency is measured open loop: from the operation's due time, not from
+// when a late worker got round to it, so a bank that falls behind shows
+// its queueing delay instead of hiding it (with MAX pace, from when it was
+// issued).
+ReplayReport replayTrace(Bank& bank, const vector<TraceRecord>& trace, const ReplayOptions& options);
+
+// Shape of a synthetic trace
+struct TraceShape {
+    size_t operations = 100000;
+    size_t accounts = 10000;
+    double skew = 0.99;
+    double rate = 10000;            // mean operations per second, Poisson arrivals
+    uint64_t seed = 42;
+};
+
+// A synthetic trace of deposits (45%), withdrawals (25%) and transfers
+// (30%) of $0.01 to $50.00 over accounts 1..accounts, picked with Zipf skew
+vector<TraceRecord> generateTrace(const TraceShape& shape);
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef BANKING_REQUEST_CACHE_H
+#define BANKING_REQUEST_CACHE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "DateTime.h"
+#include "Money.h"
+#include "Storage.h"
+
+using namespace std;
+
+// Outcome of RequestCache::claim
+enum class RequestClaim {
+    NEW,            // first time seen: the caller runs the operation and completes it
+    REPLAY,         // already done: the original status is returned
+    CONFLICT        // the id was used for a different operation
+};
+
+// Results of recent client requests, keyed by request id, so a retried
+// request gets its original result instead of running again. Entries are
+// kept for a retention window and up to a fixed capacity, whichever runs
+// out first; the oldest go first.
+// Split into shards, each with its own lock, an insertion-ordered queue
+// of entries and an open-addressing table (linear probing, backward-shift
+// deletion) from request id to queue position. A request that arrives
+// while the same id is still running waits for that run to finish.
+class RequestCache {
+private:
+    static const size_t SHARD_COUNT = 64;
+
+    struct Entry {
+        uint64_t requestId;     // 0 once expired or replaced
+        int64_t at;
+        uint32_t fingerprint;
+        TxnStatus status;
+        bool pending;
+        uint64_t journalSeq;    // record that made the result durable, 0 if unknown
+    };
+
+    struct Slot {
+        uint64_t requestId;     // 0 marks an empty slot
+        uint64_t position;      // of the entry in the queue
+    };
+
+    struct alignas(64) Shard {
+        mutex mtx;
+        condition_variable finished;
+        size_t waiters = 0;
+        deque<Entry> entries;
+        uint64_t firstPosition = 0;     // of entries.front()
+        size_t live = 0;
+        vector<Slot> table;
+        size_t mask = 0;
+    };
+
+    Shard shards[SHARD_COUNT];
+    size_t shardCapacity;
+    int64_t retention;
+
+    static uint64_t mix(uint64_t id) {
+        id ^= id >> 31;
+        id *= 0x7FB5D329728EA185ULL;
+        id ^= id >> 27;
+        id *= 0x81DADEF4BC2DD44DULL;
+        return id ^ (id >> 33);
+    }
+
+    Shard& shardFor(uint64_t requestId) {
+        return shards[mix(requestId) >> 58];
+    }
+
+    // A new id usually costs two table misses, its own slot and the slot
+    // of the entry it evicts; starting both loads at once overlaps them
+    static void prefetchSlots(const Shard& s, uint64_t requestId) {
+        if (s.table.empty()) return;
+        __builtin_prefetch(&s.table[mix(requestId) & s.mask]);
+        if (!s.entries.empty() && s.entries.front().requestId != 0) {
+            __builtin_prefetch(&s.table[mix(s.entries.front().requestId) & s.mask]);
+        }
+    }
+
+    static size_t findSlot(const Shard& s, uint64_t requestId) {
+        if (s.table.empty()) return SIZE_MAX;
+        for (size_t i = mix(requestId) & s.mask;; i = (i + 1) & s.mask) {
+            if (s.table[i].requestId == requestId) return i;
+            if (s.table[i].requestId == 0) return SIZE_MAX;
+        }
+    }
+
+    static Entry* find(Shard& s, uint64_t requestId) {
+        size_t i = findSlot(s, requestId);
+        return i == SIZE_MAX ? nullptr : &s.entries[s.table[i].position - s.firstPosition];
+    }
+
+    static void place(Shard& s, uint64_t requestId, uint64_t position) {
+        for (size_t i = mix(requestId) & s.mask;; i = (i + 1) & s.mask) {
+            if (s.table[i].requestId == 0) {
+                s.table[i] = Slot{requestId, position};
+                return;
+            }
+        }
+    }
+
+    // Kept at most half full so probe sequences stay short
+    static void grow(Shard& s) {
+        s.table.assign(s.table.empty() ? 256 : s.table.size() * 2, Slot{0, 0});
+        s.mask = s.table.size() - 1;
+        for (size_t i = 0; i < s.entries.size(); ++i) {
+            if (s.entries[i].requestId != 0) place(s, s.entries[i].requestId, s.firstPosition + i);
+        }
+    }
+
+    // Empties the slot and moves later members of its probe run back, so
+    // every lookup still finds its entry without tombstones
+    static void removeSlot(Shard& s, size_t hole) {
+        s.table[hole].requestId = 0;
+        for (size_t i = (hole + 1) & s.mask; s.table[i].requestId != 0; i = (i + 1) & s.mask) {
+            size_t home = mix(s.table[i].requestId) & s.mask;
+            // Moving is allowed unless home lies cyclically in (hole, i]
+            bool stays = hole <= i ? (home > hole && home <= i) : (home > hole || home <= i);
+            if (!stays) {
+                s.table[hole] = s.table[i];
+                s.table[i].requestId = 0;
+                hole = i;
+            }
+        }
+    }
+
+    static void drop(Shard& s, Entry& e) {
+        removeSlot(s, findSlot(s, e.requestId));
+        e.requestId = 0;
+        --s.live;
+    }
+
+    // Retires entries from the front that have expired, or that are over
+    // capacity. A running request is never retired, so it can always be
+    // completed; the shard runs briefly over capacity instead.
+    void evict(Shard& s, int64_t now) {
+        while (!s.entries.empty()) {
+            Entry& front = s.entries.front();
+            if (front.requestId != 0) {
+                if (front.pending) break;
+                if (s.live < shardCapacity && front.at >= now - retention) break;
+                drop(s, front);
+            }
+            s.entries.pop_front();
+            ++s.firstPosition;
+        }
+    }
+
+    Entry& insert(Shard& s, uint64_t requestId, uint32_t fingerprint, TxnStatus status,
+                  bool pending, int64_t at) {
+        if ((s.live + 1) * 2 > s.table.size()) grow(s);
+        s.entries.push_back(Entry{requestId, at, fingerprint, status, pending, 0});
+        place(s, requestId, s.firstPosition + s.entries.size() - 1);
+        ++s.live;
+        return s.entries.back();
+    }
+
+public:
+    RequestCache(size_t capacity = 1 << 20, int64_t retentionNanos = 86400LL * 1000000000)
+        : shardCapacity(max<size_t>(1, capacity / SHARD_COUNT)), retention(retentionNanos) {}
+
+    void configure(size_t capacity, int64_t retentionNanos) {
+        shardCapacity = max<size_t>(1, capacity / SHARD_COUNT);
+        retention = retentionNanos;
+    }
+
+    // Looks up requestId. NEW registers it as running: the caller must
+    // call complete() with the result. For REPLAY, status is set to the
+    // original result and journalSeq to the record the caller must see
+    // durable before answering. fingerprint identifies the operation, so
+    // reusing an id for something else is a CONFLICT, not a false replay.
+    RequestClaim claim(uint64_t requestId, uint32_t fingerprint, TxnStatus& status, uint64_t& journalSeq) {
+        Shard& s = shardFor(requestId);
+        int64_t now = DateTime::coarseNanos();
+        unique_lock<mutex> lock(s.mtx);
+        prefetchSlots(s, requestId);
+        while (true) {
+            Entry* e = find(s, requestId);
+            if (e && !e->pending && e->at < now - retention) {
+                drop(s, *e);
+                e = nullptr;
+            }
+            if (!e) {
+                evict(s, now);
+                insert(s, requestId, fingerprint, TxnStatus::OK, true, now);
+                return RequestClaim::NEW;
+            }
+            if (e->fingerprint != fingerprint) return RequestClaim::CONFLICT;
+            if (!e->pending) {
+                status = e->status;
+                journalSeq = e->journalSeq;
+                return RequestClaim::REPLAY;
+            }
+            ++s.waiters;
+            s.finished.wait(lock);
+            --s.waiters;
+        }
+    }
+
+    void complete(uint64_t requestId, TxnStatus status, uint64_t journalSeq) {
+        Shard& s = shardFor(requestId);
+        lock_guard<mutex> lock(s.mtx);
+        Entry* e = find(s, requestId);
+        if (!e) return;
+        e->status = status;
+        e->pending = false;
+        e->journalSeq = journalSeq;
+        if (s.waiters > 0) s.finished.notify_all();
+    }
+
+    // Adds a finished result (from a snapshot or the journal)
+    void restore(uint64_t requestId, uint32_t fingerprint, TxnStatus status, int64_t at) {
+        Shard& s = shardFor(requestId);
+        lock_guard<mutex> lock(s.mtx);
+        Entry* e = find(s, requestId);
+        if (e) drop(s, *e);
+        evict(s, DateTime::coarseNanos());
+        insert(s, requestId, fingerprint, status, false, at);
+    }
+
+    // Calls fn with every finished, unexpired result, shard by shard,
+    // oldest first within a shard
+    template <typename Fn>
+    void forEach(Fn fn) {
+        int64_t now = DateTime::coarseNanos();
+        for (Shard& s : shards) {
+            lock_guard<mutex> lock(s.mtx);
+            for (const Entry& e : s.entries) {
+                if (e.requestId == 0 || e.pending || e.at < now - retention) continue;
+                fn(RequestRecord{e.requestId, e.at, e.fingerprint, static_cast<uint32_t>(e.status)});
+            }
+        }
+    }
+
+    size_t size() {
+        size_t total = 0;
+        for (Shard& s : shards) {
+            lock_guard<mutex> lock(s.mtx);
+            total += s.live;
+        }
+        return total;
+    }
+
+    // Drops every finished result; running requests are kept
+    void clear() {
+        for (Shard& s : shards) {
+            lock_guard<mutex> lock(s.mtx);
+            for (Entry& e : s.entries) {
+                if (e.requestId != 0 && !e.pending) drop(s, e);
+            }
+            while (!s.entries.empty() && s.entries.front().requestId == 0) {
+                s.entries.pop_front();
+                ++s.firstPosition;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,220 @@
+#include "RiskEngine.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+const RiskEngine::WindowShape RiskEngine::WINDOWS[RiskEngine::WINDOW_COUNT] = {
+    {"1m", 5LL * 1000000000, 12},
+    {"1h", 300LL * 1000000000, 12},
+    {"1d", 3600LL * 1000000000, 24},
+};
+
+namespace {
+
+// Account blocks per arena chunk
+const size_t CHUNK_BLOCKS = 4096;
+
+bool parseOps(const string& word, uint8_t& ops) {
+    const uint8_t deposit = 1 << static_cast<int>(RiskOp::DEPOSIT);
+    const uint8_t withdraw = 1 << static_cast<int>(RiskOp::WITHDRAW);
+    const uint8_t transfer = 1 << static_cast<int>(RiskOp::TRANSFER);
+    if (word == "deposit") ops = deposit;
+    else if (word == "withdraw") ops = withdraw;
+    else if (word == "transfer") ops = transfer;
+    else if (word == "debit") ops = withdraw | transfer;
+    else if (word == "any") ops = deposit | withdraw | transfer;
+    else return false;
+    return true;
+}
+
+bool parseAmount(const string& word, int64_t& cents) {
+    const char* p = word.data();
+    Money amt;
+    if (!Money::parse(p, word.data() + word.size(), amt) || p != word.data() + word.size()) return false;
+    cents = amt.getCents();
+    return cents >= 0;
+}
+
+bool parseCount(const string& word, int64_t& count) {
+    char* stop;
+    count = strtoll(word.c_str(), &stop, 10);
+    return !word.empty() && *stop == '\0' && count >= 0;
+}
+
+} // namespace
+
+unique_ptr<RiskEngine> RiskEngine::compile(const string& text, string& error) {
+    unique_ptr<RiskEngine> engine(new RiskEngine());
+    istringstream lines(text);
+    string line;
+    size_t lineNo = 0;
+    auto fail = [&](const string& problem) {
+        error = "line " + to_string(lineNo) + ": " + problem;
+        return nullptr;
+    };
+    while (getline(lines, line)) {
+        ++lineNo;
+        istringstream words(line);
+        string name, action, opsWord, measureWord, limitWord, extra;
+        if (!(words >> name) || name[0] == '#') continue;
+        if (!(words >> action >> opsWord >> measureWord >> limitWord) || (words >> extra)) {
+            return fail("expected <name> <decline|flag> <ops> <measure> <limit>");
+        }
+
+        Rule rule;
+        if (action == "decline") rule.action = RiskAction::DECLINE;
+        else if (action == "flag") rule.action = RiskAction::FLAG;
+        else return fail("unknown action '" + action + "'");
+        if (!parseOps(opsWord, rule.ops)) return fail("unknown operations '" + opsWord + "'");
+
+        string kind = measureWord.substr(0, measureWord.find('/'));
+        string windowName = measureWord.find('/') == string::npos ? "" : measureWord.substr(kind.size() + 1);
+        if (kind == "amount" && windowName.empty()) rule.measure = Measure::AMOUNT;
+        else if (kind == "count") rule.measure = Measure::COUNT;
+        else if (kind == "sum") rule.measure = Measure::SUM;
+        else if (kind == "overdrafts") rule.measure = Measure::OVERDRAFTS;
+        else return fail("unknown measure '" + measureWord + "'");
+
+        bool money = rule.measure == Measure::AMOUNT || rule.measure == Measure::SUM;
+        if (!(money ? parseAmount(limitWord, rule.limit) : parseCount(limitWord, rule.limit))) {
+            return fail("bad limit '" + limitWord + "'");
+        }
+
+        rule.counter = 0;
+        if (rule.measure != Measure::AMOUNT) {
+            size_t window = 0;
+            while (window < WINDOW_COUNT && windowName != WINDOWS[window].name) ++window;
+            if (window == WINDOW_COUNT) return fail("unknown window '" + windowName + "' (use 1m, 1h or 1d)");
+            bool overdrafts = rule.measure == Measure::OVERDRAFTS;
+            if (overdrafts) {
+                // Only a withdrawal can take an account into overdraft
+                if (!(rule.ops & opBit(RiskOp::WITHDRAW))) return fail("overdrafts need withdraw operations");
+                rule.ops = opBit(RiskOp::WITHDRAW);
+            }
+            // Rules measuring the same operations over the same window
+            // share a counter
+            vector<Counter>& counters = engine->counters;
+            size_t c = 0;
+            while (c < counters.size() && !(counters[c].ops == rule.ops && counters[c].window == window &&
+                                            counters[c].overdrafts == overdrafts)) {
+                ++c;
+            }
+            if (c == counters.size()) {
+                counters.push_back(Counter{0, 0, rule.ops, static_cast<uint8_t>(window), overdrafts});
+            }
+            rule.counter = static_cast<uint16_t>(c);
+        }
+        engine->rules.push_back(rule);
+        engine->names.push_back(name);
+    }
+    // Block layout: every counter's totals, then every counter's buckets
+    size_t offset = engine->counters.size() * sizeof(Window);
+    for (size_t c = 0; c < engine->counters.size(); ++c) {
+        Counter& counter = engine->counters[c];
+        counter.offset = static_cast<uint32_t>(c * sizeof(Window));
+        counter.bucketOffset = static_cast<uint32_t>(offset);
+        offset += WINDOWS[counter.window].buckets * sizeof(Bucket);
+    }
+    engine->blockSize = offset;
+    engine->hits.reset(new atomic<uint64_t>[engine->rules.size()]);
+    for (size_t i = 0; i < engine->rules.size(); ++i) engine->hits[i] = 0;
+    return engine;
+}
+
+unsigned char* RiskEngine::blockOf(Account& acc) {
+    RiskCounters*& slot = acc.riskCountersSlot();
+    if (!slot) {
+        lock_guard<mutex> lock(arenaMtx);
+        if (chunks.empty() || chunkUsed == CHUNK_BLOCKS) {
+            // Zeroed: a zero window is empty and older than any bucket
+            chunks.emplace_back(new unsigned char[CHUNK_BLOCKS * blockSize]());
+            chunkUsed = 0;
+        }
+        slot = reinterpret_cast<RiskCounters*>(chunks.back().get() + chunkUsed++ * blockSize);
+    }
+    return reinterpret_cast<unsigned char*>(slot);
+}
+
+RiskEngine::Window& RiskEngine::windowAt(unsigned char* block, const Counter& c, int64_t now) {
+    Window& w = *reinterpret_cast<Window*>(block + c.offset);
+    Bucket* buckets = bucketsOf(block, c);
+    const WindowShape& shape = WINDOWS[c.window];
+    int64_t bucket = now / shape.bucketNanos;
+    // A clock that steps back keeps counting into the newest bucket
+    if (bucket <= w.newest) return w;
+    if (bucket - w.newest >= shape.buckets) {
+        memset(buckets, 0, shape.buckets * sizeof(Bucket));
+        w.sum = 0;
+        w.count = 0;
+    } else {
+        for (int64_t b = w.newest + 1; b <= bucket; ++b) {
+            Bucket& old = buckets[b % shape.buckets];
+            w.sum -= old.sum;
+            w.count -= old.count;
+            old = Bucket{0, 0};
+        }
+    }
+    w.newest = bucket;
+    return w;
+}
+
+TxnStatus RiskEngine::screen(Account& acc, RiskOp op, Money amt, int64_t now) {
+    uint8_t bit = opBit(op);
+    unsigned char* block = nullptr;
+    for (size_t i = 0; i < rules.size(); ++i) {
+        const Rule& rule = rules[i];
+        if (!(rule.ops & bit)) continue;
+        int64_t value;
+        if (rule.measure == Measure::AMOUNT) {
+            value = amt.getCents();
+        } else {
+            if (!block) block = blockOf(acc);
+            const Window& w = windowAt(block, counters[rule.counter], now);
+            switch (rule.measure) {
+                case Measure::COUNT:
+                    value = w.count + 1;
+                    break;
+                case Measure::SUM:
+                    value = w.sum + amt.getCents();
+                    break;
+                case Measure::OVERDRAFTS:
+                default: {
+                    Money balance = acc.getBalance();
+                    value = balance >= Money() && balance < amt ? w.count + 1 : 0;
+                    break;
+                }
+            }
+        }
+        if (value <= rule.limit) continue;
+        hits[i].fetch_add(1, memory_order_relaxed);
+        if (rule.action == RiskAction::DECLINE) return TxnStatus::RISK_DECLINED;
+    }
+    return TxnStatus::OK;
+}
+
+void RiskEngine::record(Account& acc, RiskOp op, Money amt, Money balanceBefore, int64_t now) {
+    if (counters.empty()) return;
+    uint8_t bit = opBit(op);
+    bool overdrawn = balanceBefore >= Money() && acc.getBalance() < Money();
+    unsigned char* block = blockOf(acc);
+    for (const Counter& c : counters) {
+        if (!(c.ops & bit) || (c.overdrafts && !overdrawn)) continue;
+        Window& w = windowAt(block, c, now);
+        Bucket& b = bucketsOf(block, c)[w.newest % WINDOWS[c.window].buckets];
+        int64_t cents = c.overdrafts ? 0 : amt.getCents();
+        b.sum += cents;
+        ++b.count;
+        w.sum += cents;
+        ++w.count;
+    }
+}
+
+vector<RiskRuleStats> RiskEngine::stats() const {
+    vector<RiskRuleStats> out;
+    out.reserve(rules.size());
+    for (size_t i = 0; i < rules.size(); ++i) {
+        out.push_back(RiskRuleStats{names[i], rules[i].action, hits[i].load(memory_order_relaxed)});
+    }
+    return out;
+}
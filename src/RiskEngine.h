@@ -0,0 +1,151 @@
+#ifndef BANKING_RISK_ENGINE_H
+#define BANKING_RISK_ENGINE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Account.h"
+
+using namespace std;
+
+// Operations the risk rules see; a transfer is seen from the paying side
+enum class RiskOp : uint8_t {
+    DEPOSIT,
+    WITHDRAW,
+    TRANSFER
+};
+
+enum class RiskAction : uint8_t {
+    DECLINE,    // the operation is refused with RISK_DECLINED
+    FLAG        // the operation goes ahead; only the hit is counted
+};
+
+struct RiskRuleStats {
+    string name;
+    RiskAction action;
+    uint64_t hits;
+};
+
+// Fraud and velocity rules, checked inline on deposits, withdrawals and
+// transfers. Rules are read from a text file, one per line:
+//
+//   <name> <decline|flag> <ops> <measure> <limit>
+//
+// ops is deposit, withdraw, transfer, debit (withdraw or transfer) or any;
+// measure is
+//   amount              the operation's amount
+//   count/<window>      operations of those kinds in the window, this one included
+//   sum/<window>        their total amount, this one included
+//   overdrafts/<window> times the account went from zero or more into
+//                       overdraft in the window, counting this withdrawal
+//                       only if it would do so (and 0 if it would not)
+// and window is 1m, 1h or 1d. A rule trips when its measure exceeds the
+// limit, an amount for amount and sum and a whole number otherwise.
+// Blank lines and lines starting with '#' are skipped:
+//
+//   burst           decline  debit     count/1m       20
+//   daily-outflow   decline  debit     sum/1d         25000.00
+//   large-transfer  flag     transfer  amount         10000
+//   overdraft-loop  decline  withdraw  overdrafts/1d  3
+//
+// compile() turns the rules into a flat plan. The distinct (ops, window)
+// pairs the rules measure become counters, laid out in one fixed-size
+// block per account; each rule is an entry naming its counter. A window
+// is a ring of time buckets (1m: 12 x 5 s, 1h: 12 x 5 min, 1d: 24 x 1 h)
+// with running totals, so it slides a bucket at a time, and checking or
+// counting an operation is O(1) and allocates nothing once the account
+// has its block. The caller holds the account's lock. Counters live in
+// memory only, so they start empty after a restart.
+class RiskEngine {
+private:
+    enum class Measure : uint8_t {
+        AMOUNT,
+        COUNT,
+        SUM,
+        OVERDRAFTS
+    };
+
+    struct WindowShape {
+        const char* name;
+        int64_t bucketNanos;
+        uint32_t buckets;
+    };
+
+    static const size_t WINDOW_COUNT = 3;
+    static const WindowShape WINDOWS[WINDOW_COUNT];
+
+    // One counter's totals in an account's block. The totals of all
+    // counters come first, so a check reads them from a line or two; the
+    // buckets follow.
+    struct Window {
+        int64_t newest;         // absolute number of the newest bucket
+        int64_t sum;            // cents, over all buckets
+        int64_t count;
+    };
+
+    struct Bucket {
+        int64_t sum;
+        int64_t count;
+    };
+
+    struct Counter {
+        uint32_t offset;        // of its Window in the block
+        uint32_t bucketOffset;  // of its first Bucket
+        uint8_t ops;            // a bit per RiskOp
+        uint8_t window;
+        bool overdrafts;        // counts overdraft entries instead of operations
+    };
+
+    struct Rule {
+        uint8_t ops;
+        Measure measure;
+        RiskAction action;
+        uint16_t counter;       // unused for AMOUNT
+        int64_t limit;          // cents or a count
+    };
+
+    vector<Counter> counters;
+    vector<Rule> rules;
+    vector<string> names;
+    unique_ptr<atomic<uint64_t>[]> hits;
+    size_t blockSize;
+
+    // Account blocks, carved from large chunks and freed with the engine
+    mutex arenaMtx;
+    vector<unique_ptr<unsigned char[]>> chunks;
+    size_t chunkUsed;
+
+    RiskEngine() : blockSize(0), chunkUsed(0) {}
+
+    static uint8_t opBit(RiskOp op) { return 1 << static_cast<int>(op); }
+
+    unsigned char* blockOf(Account& acc);
+    // The counter with expired buckets dropped as of now
+    Window& windowAt(unsigned char* block, const Counter& c, int64_t now);
+    static Bucket* bucketsOf(unsigned char* block, const Counter& c) {
+        return reinterpret_cast<Bucket*>(block + c.bucketOffset);
+    }
+
+public:
+    RiskEngine(const RiskEngine&) = delete;
+    RiskEngine& operator=(const RiskEngine&) = delete;
+
+    // Compiles rules text; null, with error set to the line and problem,
+    // if the rules are invalid
+    static unique_ptr<RiskEngine> compile(const string& text, string& error);
+
+    // OK, or RISK_DECLINED if a decline rule trips. Counts the hits of the
+    // rules that trip but changes no counter.
+    TxnStatus screen(Account& acc, RiskOp op, Money amt, int64_t now);
+    // Counts an operation that went through; balanceBefore is the
+    // account's balance before it
+    void record(Account& acc, RiskOp op, Money amt, Money balanceBefore, int64_t now);
+
+    vector<RiskRuleStats> stats() const;
+    size_t ruleCount() const { return rules.size(); }
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "ShardLink.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace {
+
+bool sendAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool recvAll(int fd, char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::recv(fd, data, len, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool sendMessage(int fd, const BinaryWriter& payload) {
+    uint32_t len = static_cast<uint32_t>(payload.size());
+    string frame(reinterpret_cast<const char*>(&len), sizeof(len));
+    frame += payload.data();
+    return sendAll(fd, frame.data(), frame.size());
+}
+
+// Refuses messages over 64 MiB, about 2.8 million legs
+bool recvMessage(int fd, string& payload) {
+    uint32_t len;
+    if (!recvAll(fd, reinterpret_cast<char*>(&len), sizeof(len)) || len > (64u << 20)) return false;
+    payload.resize(len);
+    return len == 0 || recvAll(fd, &payload[0], len);
+}
+
+} // namespace
+
+bool ShardServer::start(uint16_t port) {
+    listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) return false;
+    int one = 1;
+    ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listenFd, 16) != 0 ||
+        ::getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0) {
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    boundPort = ntohs(addr.sin_port);
+    stopping = false;
+    acceptor = thread(&ShardServer::acceptLoop, this);
+    return true;
+}
+
+void ShardServer::stop() {
+    if (listenFd < 0) return;
+    stopping = true;
+    // Wakes the blocked accept() and every connection's recv()
+    ::shutdown(listenFd, SHUT_RDWR);
+    acceptor.join();
+    {
+        lock_guard<mutex> lock(connMtx);
+        for (int fd : connections) ::shutdown(fd, SHUT_RDWR);
+    }
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+    for (int fd : connections) ::close(fd);
+    connections.clear();
+    ::close(listenFd);
+    listenFd = -1;
+}
+
+void ShardServer::acceptLoop() {
+    while (!stopping) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        lock_guard<mutex> lock(connMtx);
+        if (stopping) {
+            ::close(fd);
+            break;
+        }
+        connections.push_back(fd);
+        workers.emplace_back(&ShardServer::serve, this, fd);
+    }
+}
+
+void ShardServer::serve(int fd) {
+    string request;
+    while (recvMessage(fd, request)) {
+        BinaryReader r(request.data(), request.size());
+        ShardVerb verb = static_cast<ShardVerb>(r.u8());
+        uint64_t transferId = r.u64();
+        vector<TransferLeg> legs;
+        if (verb == ShardVerb::APPLY_ALL || verb == ShardVerb::PREPARE) {
+            legs = readLegs(r);
+        }
+        if (!r.good()) break;
+
+        TxnStatus status;
+        switch (verb) {
+            case ShardVerb::APPLY_ALL: status = bank.transferLegs(legs); break;
+            case ShardVerb::PREPARE: status = bank.prepareTransfer(transferId, legs); break;
+            case ShardVerb::COMMIT: status = bank.commitTransfer(transferId); break;
+            case ShardVerb::ABORT: status = bank.abortTransfer(transferId); break;
+            default: return;
+        }
+        BinaryWriter reply;
+        reply.u8(static_cast<uint8_t>(status));
+        if (!sendMessage(fd, reply)) break;
+    }
+}
+
+RemoteShard::~RemoteShard() {
+    disconnectLocked();
+}
+
+bool RemoteShard::connectLocked() {
+    if (fd >= 0) return true;
+    fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    int one = 1;
+    // Waits out a slow shard, but not forever
+    timeval timeout{timeoutMillis / 1000, (timeoutMillis % 1000) * 1000};
+    if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+        ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        disconnectLocked();
+        return false;
+    }
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return true;
+}
+
+void RemoteShard::disconnectLocked() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+TxnStatus RemoteShard::call(ShardVerb verb, uint64_t transferId, const vector<TransferLeg>* legs) {
+    BinaryWriter request;
+    request.u8(static_cast<uint8_t>(verb));
+    request.u64(transferId);
+    if (legs) writeLegs(request, *legs);
+
+    lock_guard<mutex> lock(mtx);
+    string reply;
+    if (!connectLocked() || !sendMessage(fd, request) || !recvMessage(fd, reply) || reply.size() != 1) {
+        disconnectLocked();
+        return TxnStatus::SHARD_UNAVAILABLE;
+    }
+    return static_cast<TxnStatus>(static_cast<uint8_t>(reply[0]));
+}
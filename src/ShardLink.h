@@ -0,0 +1,81 @@
+#ifndef BANKING_SHARD_LINK_H
+#define BANKING_SHARD_LINK_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TransferCoordinator.h"
+
+using namespace std;
+
+// Multi-leg transfer calls over TCP, so a coordinator can drive banks in
+// other processes. Every message is [u32 length][payload]. A request is
+// [u8 verb][u64 transfer id][u32 leg count][legs: u64 from, u64 to,
+// i64 cents]; the reply is [u8 status].
+enum class ShardVerb : uint8_t {
+    APPLY_ALL = 1,
+    PREPARE = 2,
+    COMMIT = 3,
+    ABORT = 4
+};
+
+// Serves one Bank's participant calls on a local TCP port, one thread per
+// connection; calls on a connection run in order
+class ShardServer {
+private:
+    Bank& bank;
+    int listenFd;
+    uint16_t boundPort;
+    atomic<bool> stopping;
+    thread acceptor;
+    mutex connMtx;
+    vector<int> connections;
+    vector<thread> workers;
+
+    void acceptLoop();
+    void serve(int fd);
+
+public:
+    explicit ShardServer(Bank& bank) : bank(bank), listenFd(-1), boundPort(0), stopping(false) {}
+    ~ShardServer() { stop(); }
+
+    // Listens on 127.0.0.1:port (0 picks a free port); false if it cannot bind
+    bool start(uint16_t port);
+    void stop();
+    uint16_t port() const { return boundPort; }
+};
+
+// A bank reached through a ShardServer. Calls share one connection, made
+// on first use and again after a failure; a call that fails in transit,
+// or gets no reply within the timeout, returns SHARD_UNAVAILABLE.
+class RemoteShard : public TransferParticipant {
+private:
+    string host;
+    uint16_t port;
+    int timeoutMillis;
+    int fd;
+    mutex mtx;
+
+    TxnStatus call(ShardVerb verb, uint64_t transferId, const vector<TransferLeg>* legs);
+    bool connectLocked();
+    void disconnectLocked();
+
+public:
+    RemoteShard(const string& host, uint16_t port, int timeoutMillis = 30000)
+        : host(host), port(port), timeoutMillis(timeoutMillis), fd(-1) {}
+    ~RemoteShard();
+
+    TxnStatus applyAll(const vector<TransferLeg>& legs) override {
+        return call(ShardVerb::APPLY_ALL, 0, &legs);
+    }
+    TxnStatus prepare(uint64_t transferId, const vector<TransferLeg>& legs) override {
+        return call(ShardVerb::PREPARE, transferId, &legs);
+    }
+    TxnStatus commit(uint64_t transferId) override { return call(ShardVerb::COMMIT, transferId, nullptr); }
+    TxnStatus abort(uint64_t transferId) override { return call(ShardVerb::ABORT, transferId, nullptr); }
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include <fstream>
+
+#include "Storage.h"
+
+uint32_t checksum(const char* data, size_t len, uint32_t h) {
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<uint8_t>(data[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool pwriteAll(int fd, const char* data, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = ::pwrite(fd, data, len, offset);
+        if (n < 0) return false;
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool readWholeFile(const string& path, string& out) {
+    ifstream file(path, ios::binary);
+    if (!file) return false;
+    file.seekg(0, ios::end);
+    streamoff size = file.tellg();
+    file.seekg(0, ios::beg);
+    out.resize(static_cast<size_t>(size));
+    file.read(&out[0], size);
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,245 @@
+#ifndef BANKING_STORAGE_H
+#define BANKING_STORAGE_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Money.h"
+
+using namespace std;
+
+// Little-endian binary encoder used by the snapshot and journal
+class BinaryWriter {
+private:
+    string buf;
+
+public:
+    void u8(uint8_t v) { buf.push_back(static_cast<char>(v)); }
+    void u32(uint32_t v) { buf.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void u64(uint64_t v) { buf.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void i32(int32_t v) { buf.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void i64(int64_t v) { buf.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void money(Money m) { i64(m.getCents()); }
+    void str(const string& s) {
+        u32(static_cast<uint32_t>(s.size()));
+        buf.append(s);
+    }
+
+    const string& data() const { return buf; }
+    size_t size() const { return buf.size(); }
+    void clear() { buf.clear(); }
+};
+
+// Bounds-checked decoder; any overrun marks the reader as failed
+class BinaryReader {
+private:
+    const char* pos;
+    const char* end;
+    bool ok;
+
+    bool take(void* out, size_t n) {
+        if (!ok || static_cast<size_t>(end - pos) < n) {
+            ok = false;
+            return false;
+        }
+        memcpy(out, pos, n);
+        pos += n;
+        return true;
+    }
+
+public:
+    BinaryReader(const char* data, size_t len) : pos(data), end(data + len), ok(true) {}
+
+    uint8_t u8() { uint8_t v = 0; take(&v, sizeof(v)); return v; }
+    uint32_t u32() { uint32_t v = 0; take(&v, sizeof(v)); return v; }
+    uint64_t u64() { uint64_t v = 0; take(&v, sizeof(v)); return v; }
+    int32_t i32() { int32_t v = 0; take(&v, sizeof(v)); return v; }
+    int64_t i64() { int64_t v = 0; take(&v, sizeof(v)); return v; }
+    Money money() { return Money::fromCents(i64()); }
+    string str() {
+        uint32_t len = u32();
+        if (!ok || static_cast<size_t>(end - pos) < len) {
+            ok = false;
+            return string();
+        }
+        string s(pos, len);
+        pos += len;
+        return s;
+    }
+
+    bool good() const { return ok; }
+    size_t remaining() const { return end - pos; }
+};
+
+// FNV-1a, used to detect torn or corrupted records
+uint32_t checksum(const char* data, size_t len, uint32_t h = 2166136261u);
+
+bool writeAll(int fd, const char* data, size_t len);
+
+bool pwriteAll(int fd, const char* data, size_t len, uint64_t offset);
+
+bool readWholeFile(const string& path, string& out);
+
+// Copies a string into a fixed-width, NUL-padded record field
+template <size_t N>
+void setField(char (&field)[N], const string& value) {
+    memset(field, 0, N);
+    memcpy(field, value.data(), min(value.size(), N - 1));
+}
+
+template <size_t N>
+string_view fieldView(const char (&field)[N]) {
+    return string_view(field, strnlen(field, N));
+}
+
+// Snapshot file layout (version 11). A header followed by arrays of
+// fixed-size records, so the file can be mapped and read in place:
+//   header | account index | transactions | loans | request results |
+//   prepared legs | string pool
+// Accounts refer to their transactions and loans by index range, and to
+// variable-length text by offset into the string pool. Transactions are
+// stored as their in-memory Transaction records. Request results are the
+// request dedup cache, oldest first. Prepared legs are the multi-leg
+// transfers awaiting commit or abort, each transfer's legs in a row.
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t journalSeq;
+    uint32_t reserved;
+    uint32_t indexChecksum;
+    uint64_t accountCount;
+    uint64_t txnCount;
+    uint64_t loanCount;
+    uint64_t indexOffset;
+    uint64_t txnOffset;
+    uint64_t loanOffset;
+    uint64_t stringOffset;
+    uint64_t requestCount;
+    uint64_t requestOffset;
+    uint64_t preparedCount;
+    uint64_t preparedOffset;
+    uint64_t idHighWater;       // IdGenerator::highWater when written
+};
+
+struct AccountRecord {
+    uint64_t accountId;
+    char accountType[12];
+    uint32_t isActive;
+    int64_t balance;            // cents
+    int64_t typeParameter;      // interest rate (ppm) or overdraft limit (cents)
+    int64_t createdAt;          // nanoseconds since the epoch
+    uint64_t nameOffset;
+    uint64_t nameLength;
+    uint64_t firstTxn;
+    uint64_t txnCount;
+    uint64_t firstLoan;
+    uint64_t loanCount;
+};
+
+struct LoanRecord {
+    uint64_t loanId;
+    int64_t principal;
+    int64_t interestRate;
+    int64_t monthlyPayment;
+    int64_t remainingBalance;
+    int32_t termMonths;
+    uint32_t isActive;
+    int64_t startedAt;          // nanoseconds since the epoch
+    int32_t paymentsMade;
+    uint32_t reserved;
+};
+
+struct RequestRecord {
+    uint64_t requestId;
+    int64_t at;                 // nanoseconds since the epoch
+    uint32_t fingerprint;
+    uint32_t status;
+};
+
+struct PreparedLegRecord {
+    uint64_t transferId;
+    uint64_t from;
+    uint64_t to;
+    int64_t amount;             // cents
+};
+
+static_assert(sizeof(SnapshotHeader) == 120, "snapshot header layout changed");
+static_assert(sizeof(AccountRecord) == 96, "account record layout changed");
+static_assert(sizeof(LoanRecord) == 64, "loan record layout changed");
+static_assert(sizeof(RequestRecord) == 24, "request record layout changed");
+static_assert(sizeof(PreparedLegRecord) == 32, "prepared leg record layout changed");
+
+// Read-only mapping of a whole file; pages are faulted in on first touch
+class MappedFile {
+private:
+    void* base;
+    size_t length;
+
+    MappedFile(void* b, size_t len) : base(b), length(len) {}
+
+public:
+    ~MappedFile() { munmap(base, length); }
+
+    static shared_ptr<MappedFile> open(const string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) return nullptr;
+        return shared_ptr<MappedFile>(new MappedFile(base, st.st_size));
+    }
+
+    void advise(uint64_t offset, uint64_t len, int advice) const {
+        uint64_t page = sysconf(_SC_PAGESIZE);
+        uint64_t start = offset / page * page;
+        madvise(static_cast<char*>(base) + start, len + (offset - start), advice);
+    }
+
+    const char* data() const { return static_cast<const char*>(base); }
+    size_t size() const { return length; }
+};
+
+// Buffered writer for one section of a snapshot file. Sections start at
+// offsets computed up front, so all of them can be filled in one pass.
+class SnapshotSection {
+private:
+    int fd;
+    uint64_t offset;
+    uint64_t written;
+    string buf;
+    bool ok;
+
+public:
+    SnapshotSection(int fd, uint64_t offset) : fd(fd), offset(offset), written(0), ok(true) {}
+
+    // Returns the position of the data relative to the section start
+    uint64_t append(const void* data, size_t len) {
+        uint64_t pos = written;
+        buf.append(static_cast<const char*>(data), len);
+        written += len;
+        if (buf.size() >= (1 << 20)) flush();
+        return pos;
+    }
+
+    void flush() {
+        ok = ok && pwriteAll(fd, buf.data(), buf.size(), offset);
+        offset += buf.size();
+        buf.clear();
+    }
+
+    bool good() const { return ok; }
+};
+
+#endif
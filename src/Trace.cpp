@@ -0,0 +1,77 @@
+#include "Trace.h"
+
+#include <chrono>
+
+namespace {
+
+// How often buffered records are written when fewer than BATCH_SIZE wait
+const chrono::milliseconds FLUSH_INTERVAL(50);
+
+} // namespace
+
+bool writeTraceFile(const string& path, const vector<TraceRecord>& records) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    TraceFileHeader header = {TRACE_MAGIC, TRACE_VERSION, 0};
+    bool ok = writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+              writeAll(fd, reinterpret_cast<const char*>(records.data()), records.size() * sizeof(TraceRecord));
+    return ::close(fd) == 0 && ok;
+}
+
+bool readTraceFile(const string& path, vector<TraceRecord>& records) {
+    string data;
+    if (!readWholeFile(path, data) || data.size() < sizeof(TraceFileHeader)) return false;
+    TraceFileHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) return false;
+    size_t count = (data.size() - sizeof(header)) / sizeof(TraceRecord);
+    records.resize(count);
+    memcpy(records.data(), data.data() + sizeof(header), count * sizeof(TraceRecord));
+    return true;
+}
+
+bool TraceRecorder::open(const string& path) {
+    if (fd >= 0) return false;
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    TraceFileHeader header = {TRACE_MAGIC, TRACE_VERSION, 0};
+    if (!writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header))) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    writer = thread(&TraceRecorder::writeLoop, this);
+    return true;
+}
+
+void TraceRecorder::writeLoop() {
+    vector<TraceRecord> batch;
+    unique_lock<mutex> lock(mtx);
+    while (true) {
+        workCv.wait_for(lock, FLUSH_INTERVAL, [this] { return stopping || pending.size() >= BATCH_SIZE; });
+        batch.swap(pending);
+        bool done = stopping;
+        lock.unlock();
+        if (!batch.empty()) {
+            writeAll(fd, reinterpret_cast<const char*>(batch.data()), batch.size() * sizeof(TraceRecord));
+            batch.clear();
+        }
+        lock.lock();
+        if (done && pending.empty()) break;
+    }
+}
+
+void TraceRecorder::stop() {
+    if (writer.joinable()) {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        workCv.notify_one();
+        writer.join();
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
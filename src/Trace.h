@@ -0,0 +1,89 @@
+#ifndef BANKING_TRACE_H
+#define BANKING_TRACE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Journal.h"
+
+using namespace std;
+
+// One call into the bank, as recorded for replay. Names are not recorded.
+struct TraceRecord {
+    int64_t at;                 // nanoseconds since the epoch, when the call arrived
+    uint64_t account;           // for CREATE_*, the id the new account got
+    uint64_t counterparty;      // TRANSFER only
+    int64_t amount;             // cents
+    int64_t rate;               // APPLY_LOAN: annual rate, parts per million
+    uint64_t requestId;         // DEPOSIT, WITHDRAW, TRANSFER; 0 if none
+    int32_t count;              // APPLY_LOAN: months; PAY_LOAN: loan index
+    JournalOp op;               // CREATE_SAVINGS .. APPLY_INTEREST
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(TraceRecord) == 56, "trace record layout changed");
+
+// Trace file layout: a header, then TraceRecords in arrival order
+struct TraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(TraceFileHeader) == 16, "trace header layout changed");
+
+const uint32_t TRACE_MAGIC = 0x43525442;   // "BTRC"
+const uint32_t TRACE_VERSION = 1;
+
+bool writeTraceFile(const string& path, const vector<TraceRecord>& records);
+// False if the file is missing or not a trace; a torn last record is dropped
+bool readTraceFile(const string& path, vector<TraceRecord>& records);
+
+// Records the calls a Bank receives (see Bank::setTraceRecorder) to a
+// trace file. Callers append to an in-memory buffer under a short lock; a
+// writer thread swaps the buffer out and writes it every 50 ms, so
+// recording never waits on the disk.
+class TraceRecorder {
+private:
+    int fd;
+    vector<TraceRecord> pending;
+    uint64_t recorded;
+    bool stopping;
+    mutex mtx;
+    condition_variable workCv;
+    thread writer;
+
+    void writeLoop();
+
+public:
+    static const size_t BATCH_SIZE = 4096;
+
+    TraceRecorder() : fd(-1), recorded(0), stopping(false) {}
+    ~TraceRecorder() { stop(); }
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // Starts a new trace file, replacing any old one
+    bool open(const string& path);
+
+    void record(const TraceRecord& rec) {
+        lock_guard<mutex> lock(mtx);
+        pending.push_back(rec);
+        ++recorded;
+        if (pending.size() == BATCH_SIZE) workCv.notify_one();
+    }
+
+    // Writes what is buffered and stops the writer
+    void stop();
+
+    uint64_t getRecorded() {
+        lock_guard<mutex> lock(mtx);
+        return recorded;
+    }
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include "Transaction.h"
+
+string formatAccountNumber(uint64_t id) {
+    return "ACC" + to_string(id);
+}
+
+uint64_t parseAccountNumber(string_view text) {
+    if (text.size() < 4 || text.size() > 23 || text.compare(0, 3, "ACC") != 0) return 0;
+    uint64_t id = 0;
+    for (size_t i = 3; i < text.size(); ++i) {
+        char c = text[i];
+        if (c < '0' || c > '9') return 0;
+        if (id > (UINT64_MAX - (c - '0')) / 10) return 0;
+        id = id * 10 + (c - '0');
+    }
+    return id;
+}
+
+const char* txnTypeName(TxnType type) {
+    switch (type) {
+        case TxnType::DEPOSIT:      return "DEPOSIT";
+        case TxnType::WITHDRAW:     return "WITHDRAW";
+        case TxnType::TRANSFER_OUT: return "TRANSFER_OUT";
+        case TxnType::TRANSFER_IN:  return "TRANSFER_IN";
+        case TxnType::LOAN:         return "LOAN";
+        case TxnType::LOAN_PAYMENT: return "LOAN_PAYMENT";
+        case TxnType::INTEREST:     return "INTEREST";
+    }
+    return "UNKNOWN";
+}
+
+const char* txnTypeDescription(TxnType type) {
+    switch (type) {
+        case TxnType::DEPOSIT:      return "Cash deposit";
+        case TxnType::WITHDRAW:     return "Cash withdrawal";
+        case TxnType::TRANSFER_OUT: return "Transfer to ";
+        case TxnType::TRANSFER_IN:  return "Transfer from ";
+        case TxnType::LOAN:         return "Loan disbursement";
+        case TxnType::LOAN_PAYMENT: return "Loan payment";
+        case TxnType::INTEREST:     return "Interest credit";
+    }
+    return "";
+}
@@ -0,0 +1,306 @@
+#ifndef BANKING_TRANSACTION_H
+#define BANKING_TRANSACTION_H
+
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include "DateTime.h"
+#include "IdGenerator.h"
+#include "Storage.h"
+
+using namespace std;
+
+// Account numbers are "ACC" followed by the decimal account id. Ids are
+// what the bank stores and indexes; the text form is only for people.
+string formatAccountNumber(uint64_t id);
+
+// Returns the id in an account number, or 0 (never a valid id) if the
+// text is not a well-formed account number
+uint64_t parseAccountNumber(string_view text);
+
+enum class TxnType : uint8_t {
+    DEPOSIT,
+    WITHDRAW,
+    TRANSFER_OUT,
+    TRANSFER_IN,
+    LOAN,
+    LOAN_PAYMENT,
+    INTEREST
+};
+
+const char* txnTypeName(TxnType type);
+
+// Standard description for each type; transfers add the counterparty
+const char* txnTypeDescription(TxnType type);
+
+// Transaction class. A fixed-size record with no heap-owned members, so
+// appending one to a history never allocates, and the same bytes are
+// written to and mapped from the snapshot. Text (id, date, description)
+// is produced only when the record is displayed.
+class Transaction {
+private:
+    uint64_t transactionId;
+    int64_t timestamp;          // nanoseconds since the epoch
+    int64_t amount;             // cents
+    uint64_t counterparty;      // other account's id for transfers, else 0
+    TxnType type;
+    uint8_t reserved[7];
+
+public:
+    Transaction() = default;
+
+    Transaction(uint64_t id, int64_t time, TxnType type, Money amt, uint64_t counterparty = 0)
+        : transactionId(id), timestamp(time), amount(amt.getCents()),
+          counterparty(counterparty), type(type), reserved() {}
+
+    Transaction(TxnType type, Money amt, uint64_t counterparty = 0)
+        : Transaction(IdGenerator::next(), DateTime::nowNanos(), type, amt, counterparty) {}
+
+    uint64_t getId() const { return transactionId; }
+    int64_t getTimestamp() const { return timestamp; }
+    TxnType getType() const { return type; }
+    Money getAmount() const { return Money::fromCents(amount); }
+    uint64_t getCounterparty() const { return counterparty; }
+};
+
+static_assert(sizeof(Transaction) == 40, "transaction record layout changed");
+static_assert(is_trivially_copyable<Transaction>::value, "transactions are copied as raw bytes");
+
+// Append-only file that history chunks are moved to when they age out of
+// memory. Shared by all accounts of a bank; space is handed out with an
+// atomic bump pointer and every access is a positioned read or write.
+class SpillFile {
+private:
+    int fd;
+    atomic<uint64_t> end;
+
+public:
+    SpillFile() : fd(-1), end(0) {}
+    ~SpillFile() { if (fd >= 0) ::close(fd); }
+
+    bool open(const string& path) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        end = 0;
+        return fd >= 0;
+    }
+
+    // Returns the offset the data was written at, or UINT64_MAX on failure
+    uint64_t write(const void* data, size_t len) {
+        uint64_t offset = end.fetch_add(len);
+        if (!pwriteAll(fd, static_cast<const char*>(data), len, offset)) return UINT64_MAX;
+        return offset;
+    }
+
+    bool read(uint64_t offset, void* data, size_t len) const {
+        char* out = static_cast<char*>(data);
+        while (len > 0) {
+            ssize_t n = ::pread(fd, out, len, offset);
+            if (n <= 0) return false;
+            out += n;
+            offset += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // Drops everything; only safe once no history refers to the file
+    void reset() {
+        if (::ftruncate(fd, 0) == 0) end = 0;
+    }
+};
+
+// An account's transaction history, kept in time order as a list of chunks
+// of up to CHUNK_SIZE records. A chunk lives in one of three places: on the
+// heap (the newest chunks), in a mapped snapshot, or in the spill file.
+// Every chunk remembers its first timestamp and which transaction types it
+// holds, so the chunk list doubles as a time and type index: a query
+// binary-searches chunk start times, skips chunks with no matching type,
+// and reads only the chunks that contribute results (last-N, date range
+// and type queries cost O(log n + k) chunk visits).
+class TransactionHistory {
+public:
+    static const size_t CHUNK_SIZE = 256;
+    static const size_t RESIDENT_CHUNKS = 4;    // full chunks kept in memory before spilling
+    static const uint8_t ALL_TYPES = 0x7F;
+
+    static uint8_t typeBit(TxnType type) { return 1 << static_cast<int>(type); }
+
+private:
+    static const uint64_t NOT_SPILLED = UINT64_MAX;
+
+    struct Chunk {
+        vector<Transaction> live;       // records of an in-memory chunk
+        const Transaction* mapped;      // records in the snapshot mapping
+        uint64_t spillOffset;
+        uint32_t count;
+        int64_t firstTime;              // not filled in for mapped chunks
+        mutable uint8_t typeMask;       // ALL_TYPES until known for mapped chunks
+        mutable bool maskKnown;
+    };
+
+    shared_ptr<MappedFile> archive;
+    vector<Chunk> chunks;
+    size_t total;
+    SpillFile* spill;
+
+    // Mapped chunks are read only when a query reaches them, so attaching
+    // a snapshot touches none of its history pages
+    static int64_t startTime(const Chunk& c) {
+        return c.mapped ? c.mapped[0].getTimestamp() : c.firstTime;
+    }
+
+    int64_t newestTime() const {
+        if (chunks.empty()) return INT64_MIN;
+        const Chunk& c = chunks.back();
+        return c.mapped ? c.mapped[c.count - 1].getTimestamp() : c.live.back().getTimestamp();
+    }
+
+    // Records of a chunk; spilled chunks are read back into buf
+    const Transaction* view(const Chunk& c, vector<Transaction>& buf) const {
+        if (c.mapped) return c.mapped;
+        if (c.spillOffset == NOT_SPILLED) return c.live.data();
+        buf.resize(c.count);
+        if (!spill->read(c.spillOffset, buf.data(), c.count * sizeof(Transaction))) {
+            buf.clear();
+            return nullptr;
+        }
+        return buf.data();
+    }
+
+    bool mayContain(const Chunk& c, uint8_t types) const {
+        return !c.maskKnown || (c.typeMask & types) != 0;
+    }
+
+    void learnMask(const Chunk& c, const Transaction* records) const {
+        if (c.maskKnown || !records) return;
+        uint8_t mask = 0;
+        for (uint32_t i = 0; i < c.count; ++i) mask |= typeBit(records[i].getType());
+        c.typeMask = mask;
+        c.maskKnown = true;
+    }
+
+    void spillOldest() {
+        if (!spill || chunks.size() <= RESIDENT_CHUNKS) return;
+        Chunk& c = chunks[chunks.size() - 1 - RESIDENT_CHUNKS];
+        if (c.live.empty()) return;
+        uint64_t offset = spill->write(c.live.data(), c.count * sizeof(Transaction));
+        if (offset == UINT64_MAX) return;
+        c.spillOffset = offset;
+        vector<Transaction>().swap(c.live);
+    }
+
+    // Index of the last chunk starting at or before t (0 if none)
+    size_t chunkFor(int64_t t) const {
+        size_t lo = 0, hi = chunks.size();
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (startTime(chunks[mid]) <= t) lo = mid;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+public:
+    TransactionHistory() : total(0), spill(nullptr) {}
+
+    void setSpill(SpillFile* file) { spill = file; }
+
+    // Appends in time order; a timestamp earlier than the newest record
+    // (clock steps, or a bulk run stamped before it took the lock) is
+    // raised to keep the history sorted. Returns the record as stored.
+    const Transaction& append(Transaction t) {
+        int64_t newest = newestTime();
+        if (t.getTimestamp() < newest) {
+            t = Transaction(t.getId(), newest, t.getType(), t.getAmount(), t.getCounterparty());
+        }
+        if (chunks.empty() || chunks.back().mapped || chunks.back().count == CHUNK_SIZE) {
+            bool busy = !chunks.empty();
+            chunks.push_back(Chunk{{}, nullptr, NOT_SPILLED, 0, t.getTimestamp(), 0, true});
+            // Accounts that have filled a chunk get full-size ones straight away
+            if (busy) chunks.back().live.reserve(CHUNK_SIZE);
+            spillOldest();
+        }
+        Chunk& c = chunks.back();
+        c.live.push_back(t);
+        c.typeMask |= typeBit(t.getType());
+        ++c.count;
+        ++total;
+        return c.live.back();
+    }
+
+    // Points the history at records in a mapped snapshot, replacing what
+    // it held. With a previous layout (from this same history, written in
+    // the same order) chunk boundaries and type masks carry over.
+    void attach(const shared_ptr<MappedFile>& file, const Transaction* records, size_t count) {
+        vector<Chunk> rebuilt;
+        size_t pos = 0;
+        if (count == total) {
+            for (const Chunk& c : chunks) {
+                rebuilt.push_back(Chunk{{}, records + pos, NOT_SPILLED, c.count, c.firstTime,
+                                        c.typeMask, c.maskKnown});
+                pos += c.count;
+            }
+        }
+        for (; pos < count; pos += CHUNK_SIZE) {
+            uint32_t n = static_cast<uint32_t>(min(CHUNK_SIZE, count - pos));
+            rebuilt.push_back(Chunk{{}, records + pos, NOT_SPILLED, n, 0, ALL_TYPES, false});
+        }
+        chunks.swap(rebuilt);
+        archive = file;
+        total = count;
+    }
+
+    size_t size() const { return total; }
+
+    // Calls fn(records, count) for each chunk in order; false on a read error
+    template <typename Fn>
+    bool forEachChunk(Fn fn) const {
+        vector<Transaction> buf;
+        for (const Chunk& c : chunks) {
+            const Transaction* records = view(c, buf);
+            if (!records) return false;
+            fn(records, c.count);
+        }
+        return true;
+    }
+
+    // The newest n records whose type is in types, oldest first
+    vector<Transaction> last(size_t n, uint8_t types = ALL_TYPES) const {
+        vector<Transaction> out;
+        vector<Transaction> buf;
+        for (size_t i = chunks.size(); i-- > 0 && out.size() < n;) {
+            const Chunk& c = chunks[i];
+            if (!mayContain(c, types)) continue;
+            const Transaction* records = view(c, buf);
+            learnMask(c, records);
+            if (!records) continue;
+            for (uint32_t j = c.count; j-- > 0 && out.size() < n;) {
+                if (typeBit(records[j].getType()) & types) out.push_back(records[j]);
+            }
+        }
+        reverse(out.begin(), out.end());
+        return out;
+    }
+
+    // Records with from <= timestamp <= to whose type is in types
+    vector<Transaction> between(int64_t from, int64_t to, uint8_t types = ALL_TYPES) const {
+        vector<Transaction> out;
+        vector<Transaction> buf;
+        for (size_t i = chunkFor(from); i < chunks.size() && startTime(chunks[i]) <= to; ++i) {
+            const Chunk& c = chunks[i];
+            if (!mayContain(c, types)) continue;
+            const Transaction* records = view(c, buf);
+            learnMask(c, records);
+            if (!records) continue;
+            const Transaction* first = lower_bound(records, records + c.count, from,
+                [](const Transaction& t, int64_t v) { return t.getTimestamp() < v; });
+            for (const Transaction* t = first; t < records + c.count && t->getTimestamp() <= to; ++t) {
+                if (typeBit(t->getType()) & types) out.push_back(*t);
+            }
+        }
+        return out;
+    }
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "TransferCoordinator.h"
+
+TxnStatus TransferCoordinator::execute(const vector<TransferLeg>& legs) {
+    if (legs.empty()) return TxnStatus::INVALID_AMOUNT;
+
+    // Each leg goes to the shards of both of its accounts
+    vector<vector<TransferLeg>> parts(IdGenerator::NODE_COUNT);
+    vector<uint32_t> involved;
+    auto route = [&](uint32_t node, const TransferLeg& leg) {
+        if (parts[node].empty()) involved.push_back(node);
+        parts[node].push_back(leg);
+    };
+    for (const TransferLeg& leg : legs) {
+        uint32_t fromNode = IdGenerator::nodeOf(leg.from);
+        uint32_t toNode = IdGenerator::nodeOf(leg.to);
+        if (!shards[fromNode] || !shards[toNode]) return TxnStatus::ACCOUNT_NOT_FOUND;
+        route(fromNode, leg);
+        if (toNode != fromNode) route(toNode, leg);
+    }
+    if (involved.size() == 1) {
+        return shards[involved[0]]->applyAll(parts[involved[0]]);
+    }
+
+    uint64_t transferId = IdGenerator::next();
+    TxnStatus vote = TxnStatus::OK;
+    vector<TransferParticipant*> preparedShards;
+    for (uint32_t node : involved) {
+        vote = shards[node]->prepare(transferId, parts[node]);
+        // A shard that could not be reached may still have prepared
+        if (vote == TxnStatus::OK || vote == TxnStatus::SHARD_UNAVAILABLE) {
+            preparedShards.push_back(shards[node]);
+        }
+        if (vote != TxnStatus::OK) break;
+    }
+    for (TransferParticipant* shard : preparedShards) {
+        deliver(Decision{transferId, shard, vote == TxnStatus::OK});
+    }
+    return vote;
+}
+
+void TransferCoordinator::deliver(const Decision& decision) {
+    TxnStatus status = decision.commit ? decision.shard->commit(decision.transferId)
+                                       : decision.shard->abort(decision.transferId);
+    // TRANSFER_NOT_PREPARED means an earlier attempt got through
+    if (status == TxnStatus::SHARD_UNAVAILABLE) {
+        lock_guard<mutex> lock(pendingMtx);
+        pending.push_back(decision);
+    }
+}
+
+size_t TransferCoordinator::retryPending() {
+    vector<Decision> retry;
+    {
+        lock_guard<mutex> lock(pendingMtx);
+        retry.swap(pending);
+    }
+    for (const Decision& decision : retry) {
+        deliver(decision);
+    }
+    lock_guard<mutex> lock(pendingMtx);
+    return pending.size();
+}
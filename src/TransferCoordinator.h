@@ -0,0 +1,80 @@
+#ifndef BANKING_TRANSFER_COORDINATOR_H
+#define BANKING_TRANSFER_COORDINATOR_H
+
+#include <mutex>
+#include <vector>
+
+#include "Bank.h"
+
+using namespace std;
+
+// One shard's side of a multi-leg transfer: the calls a coordinator makes
+// to the bank holding some of the accounts. LocalShard is a Bank in this
+// process; RemoteShard (ShardLink.h) is a Bank behind a socket.
+class TransferParticipant {
+public:
+    virtual ~TransferParticipant() {}
+
+    // Applies legs whose accounts are all on this shard in one step
+    virtual TxnStatus applyAll(const vector<TransferLeg>& legs) = 0;
+    virtual TxnStatus prepare(uint64_t transferId, const vector<TransferLeg>& legs) = 0;
+    virtual TxnStatus commit(uint64_t transferId) = 0;
+    virtual TxnStatus abort(uint64_t transferId) = 0;
+};
+
+class LocalShard : public TransferParticipant {
+private:
+    Bank& bank;
+
+public:
+    explicit LocalShard(Bank& bank) : bank(bank) {}
+
+    TxnStatus applyAll(const vector<TransferLeg>& legs) override { return bank.transferLegs(legs); }
+    TxnStatus prepare(uint64_t transferId, const vector<TransferLeg>& legs) override {
+        return bank.prepareTransfer(transferId, legs);
+    }
+    TxnStatus commit(uint64_t transferId) override { return bank.commitTransfer(transferId); }
+    TxnStatus abort(uint64_t transferId) override { return bank.abortTransfer(transferId); }
+};
+
+// Runs multi-leg transfers over banks that each hold some of the accounts.
+// Legs are routed by the node id in their account ids (IdGenerator::nodeOf)
+// to the shard registered for that node. A transfer that stays on one
+// shard is applied there in one step. Otherwise it is a two-phase commit:
+// every shard involved prepares its part, validating it and holding the
+// debits; only if all of them vote OK are they told to commit, else the
+// ones that prepared are told to abort. Shards journal their votes, so a
+// shard that restarts still has its prepared part. The decision itself
+// is not journaled: a decision that cannot be delivered is kept and
+// re-sent by retryPending(), and if the coordinator dies before then, the
+// transfer stays listed in the shards' getPreparedTransfers().
+class TransferCoordinator {
+private:
+    struct Decision {
+        uint64_t transferId;
+        TransferParticipant* shard;
+        bool commit;
+    };
+
+    TransferParticipant* shards[IdGenerator::NODE_COUNT] = {};
+    mutex pendingMtx;
+    vector<Decision> pending;
+
+    void deliver(const Decision& decision);
+
+public:
+    void addShard(uint32_t node, TransferParticipant* shard) {
+        shards[node % IdGenerator::NODE_COUNT] = shard;
+    }
+
+    // Moves money along every leg or along none. ACCOUNT_NOT_FOUND if an
+    // account's node has no shard; otherwise the first refusal of any
+    // shard, or SHARD_UNAVAILABLE if one could not be reached to vote.
+    TxnStatus execute(const vector<TransferLeg>& legs);
+
+    // Sends decisions that could not be delivered again; returns how many
+    // are still undelivered
+    size_t retryPending();
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef BANKING_ZIPF_H
+#define BANKING_ZIPF_H
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// Zipf-distributed ranks in [0, n): rank k is drawn with weight
+// 1 / (k + 1)^skew. skew 0 is uniform; around 1 a handful of ranks take
+// most of the draws. A draw is a binary search of the cumulative weights.
+class ZipfDistribution {
+private:
+    vector<double> cdf;
+    size_t n;
+
+public:
+    ZipfDistribution(size_t n = 1, double skew = 0) : n(max<size_t>(n, 1)) {
+        if (skew <= 0) return;
+        cdf.reserve(this->n);
+        double total = 0;
+        for (size_t k = 1; k <= this->n; ++k) {
+            total += 1.0 / pow(static_cast<double>(k), skew);
+            cdf.push_back(total);
+        }
+        for (double& c : cdf) c /= total;
+    }
+
+    size_t operator()(mt19937_64& rng) const {
+        if (cdf.empty()) return rng() % n;
+        double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+        size_t rank = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        return min(rank, n - 1);
+    }
+};
+
+#endif
@@ -0,0 +1,666 @@
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+#include "Bank.h"
+#include "BankClient.h"
+#include "BankServer.h"
+#include "ChangeFeed.h"
+#include "NameIndex.h"
+#include "ShardLink.h"
+#include "TransferCoordinator.h"
+
+using namespace std;
+
+// Behaviour tests for the banking core. Each test is a function run by
+// name (bank_tests <name>), so ctest runs every one in its own process;
+// with no name every test runs. A failed CHECK reports itself and fails
+// the test but lets it carry on.
+
+namespace {
+
+bool failed = false;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #cond "\n"; \
+            failed = true;                                                       \
+        }                                                                        \
+    } while (0)
+
+// A fresh path under TMPDIR for this process, with nothing left there
+string tempPath(const string& name) {
+    const char* dir = getenv("TMPDIR");
+    string path = string(dir && *dir ? dir : "/tmp") + "/bank_tests_" + to_string(::getpid()) + "_" + name;
+    remove(path.c_str());
+    remove((path + ".spill").c_str());
+    return path;
+}
+
+// Snapshot and journal paths of a test's bank, removed again at exit
+struct Store {
+    string snapshot;
+    string journal;
+
+    explicit Store(const string& name) : snapshot(tempPath(name + ".snap")), journal(tempPath(name + ".jrnl")) {}
+    ~Store() {
+        remove(snapshot.c_str());
+        remove((snapshot + ".spill").c_str());
+        remove(journal.c_str());
+    }
+};
+
+// Everything replay must reproduce about some accounts, as text
+string dump(Bank& bank, const vector<uint64_t>& ids) {
+    ostringstream out;
+    for (uint64_t id : ids) {
+        Account* acc = bank.findAccount(id);
+        if (!acc) {
+            out << id << " missing\n";
+            continue;
+        }
+        out << id << " " << acc->getAccountHolder() << " " << acc->getCreatedAt() << " "
+            << acc->getBalance().getCents() << " " << acc->getAvailableBalance().getCents() << "\n";
+        for (size_t i = 0; i < acc->getLoanCount(); ++i) {
+            const Loan& loan = acc->getLoan(i);
+            out << "  loan " << loan.getLoanId() << " " << loan.getStartedAt() << " " << loan.getPaymentsMade()
+                << " " << loan.getRemainingBalance().getCents() << "\n";
+        }
+        acc->getHistory().forEachChunk([&out](const Transaction* records, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                const Transaction& t = records[i];
+                out << "  " << t.getId() << " " << t.getTimestamp() << " " << static_cast<int>(t.getType()) << " "
+                    << t.getAmount().getCents() << " " << t.getCounterparty() << "\n";
+            }
+            return true;
+        });
+    }
+    return out.str();
+}
+
+// One of every journaled operation on the two accounts. Request and
+// transfer ids start from base: 1 and 2 are request ids, 3 is left
+// prepared, and the transfer ids after it are used up.
+void runEveryOperation(Bank& bank, uint64_t a, uint64_t b, uint64_t base) {
+    CHECK(bank.deposit(a, Money::fromCents(1000), base + 1) == TxnStatus::OK);
+    CHECK(bank.withdraw(b, Money::fromCents(500)) == TxnStatus::OK);
+    CHECK(bank.withdraw(b, Money::fromCents(1000000000), base + 2) == TxnStatus::OVERDRAFT_EXCEEDED);
+    CHECK(bank.transfer(a, b, Money::fromCents(700)) == TxnStatus::OK);
+    CHECK(bank.applyLoan(b, Money::fromCents(120000), 50000, 12) == TxnStatus::OK);
+    Money installment = bank.findAccount(b)->getLoan(0).getMonthlyPayment();
+    CHECK(bank.payLoan(b, 0, installment) == TxnStatus::OK);
+    Money interest;
+    CHECK(bank.applyInterest(a, interest) == TxnStatus::OK);
+    CHECK(bank.transferLegs({{a, b, Money::fromCents(300)}, {b, a, Money::fromCents(200)}}) == TxnStatus::OK);
+    CHECK(bank.prepareTransfer(base + 4, {{a, b, Money::fromCents(400)}}) == TxnStatus::OK);
+    CHECK(bank.commitTransfer(base + 4) == TxnStatus::OK);
+    CHECK(bank.prepareTransfer(base + 5, {{b, a, Money::fromCents(100)}}) == TxnStatus::OK);
+    CHECK(bank.abortTransfer(base + 5) == TxnStatus::OK);
+    CHECK(bank.prepareTransfer(base + 3, {{a, b, Money::fromCents(50)}}) == TxnStatus::OK);
+    BatchOp ops[3] = {{BatchOpType::DEPOSIT, a, 0, Money::fromCents(100), 0},
+                      {BatchOpType::TRANSFER, a, b, Money::fromCents(100), 0},
+                      {BatchOpType::PAY_LOAN, b, 0, installment, 0}};
+    TxnStatus results[3];
+    bank.applyBatch(ops, 3, results);
+    for (TxnStatus status : results) CHECK(status == TxnStatus::OK);
+    bank.accrueInterestAll();
+    bank.runEndOfDay(DateTime::addMonths(DateTime::nowNanos(), 2));
+}
+
+// A restart replays the journal into exactly the state before it: the same
+// balances, holds, loans and transaction records down to ids and times
+void testJournalReplay() {
+    Store store("replay");
+    vector<uint64_t> ids;
+    string before;
+    {
+        Bank bank("Test Bank");
+        RecoveryReport report = bank.recover(store.snapshot, store.journal);
+        CHECK(report.error.empty() && report.journalOpen && !report.snapshotLoaded);
+        ids.push_back(bank.createSavingsAccount("Ann", Money::fromCents(100000)));
+        ids.push_back(bank.createCheckingAccount("Ben", Money::fromCents(50000)));
+        runEveryOperation(bank, ids[0], ids[1], 100);
+        before = dump(bank, ids);
+    }
+    Bank bank("Test Bank");
+    RecoveryReport report = bank.recover(store.snapshot, store.journal);
+    CHECK(report.error.empty() && report.replayed > 0);
+    CHECK(dump(bank, ids) == before);
+    // The prepared transfer and the request results came back too
+    CHECK(bank.commitTransfer(103) == TxnStatus::OK);
+    Money balance = bank.findAccount(ids[0])->getBalance();
+    CHECK(bank.deposit(ids[0], Money::fromCents(1000), 101) == TxnStatus::OK);
+    CHECK(bank.withdraw(ids[1], Money::fromCents(1000000000), 102) == TxnStatus::OVERDRAFT_EXCEEDED);
+    CHECK(bank.findAccount(ids[0])->getBalance() == balance);
+}
+
+// A checkpoint in the middle: the snapshot covers the first half and the
+// journal the rest, and a restart gives the same state as no restart
+void testSnapshotAndJournal() {
+    Store store("checkpoint");
+    vector<uint64_t> ids;
+    string before;
+    {
+        Bank bank("Test Bank");
+        bank.recover(store.snapshot, store.journal);
+        ids.push_back(bank.createSavingsAccount("Ann", Money::fromCents(100000)));
+        ids.push_back(bank.createCheckingAccount("Ben", Money::fromCents(50000)));
+        runEveryOperation(bank, ids[0], ids[1], 100);
+        CHECK(bank.checkpoint());
+        ids.push_back(bank.createSavingsAccount("Cleo", Money::fromCents(70000)));
+        runEveryOperation(bank, ids[2], ids[1], 200);
+        before = dump(bank, ids);
+    }
+    Bank bank("Test Bank");
+    RecoveryReport report = bank.recover(store.snapshot, store.journal);
+    CHECK(report.error.empty() && report.snapshotLoaded && report.replayed > 0);
+    CHECK(dump(bank, ids) == before);
+    CHECK(bank.checkpoint());
+}
+
+// Rewrites the u32 at offset in a file
+void patch(const string& path, size_t offset, uint32_t value) {
+    FILE* f = fopen(path.c_str(), "r+b");
+    CHECK(f != nullptr);
+    if (!f) return;
+    fseek(f, static_cast<long>(offset), SEEK_SET);
+    fwrite(&value, sizeof(value), 1, f);
+    fclose(f);
+}
+
+// Builds a store with a snapshot and a journal record after it
+void fillStore(const Store& store) {
+    Bank bank("Test Bank");
+    bank.recover(store.snapshot, store.journal);
+    uint64_t id = bank.createSavingsAccount("Ann", Money::fromCents(100000));
+    CHECK(bank.checkpoint());
+    CHECK(bank.deposit(id, Money::fromCents(5)) == TxnStatus::OK);
+}
+
+// Recovery refuses files it cannot restore, and a bank that refused to
+// recover will not checkpoint over them
+void testRecoveryRefusals() {
+    {
+        Store store("snapshot_version");
+        fillStore(store);
+        patch(store.snapshot, offsetof(SnapshotHeader, version), 9);
+        Bank bank("Test Bank");
+        RecoveryReport report = bank.recover(store.snapshot, store.journal);
+        CHECK(report.error.find("version 9") != string::npos);
+        CHECK(!bank.checkpoint());
+    }
+    {
+        Store store("snapshot_corrupt");
+        fillStore(store);
+        patch(store.snapshot, offsetof(SnapshotHeader, indexChecksum), 0xDEADBEEF);
+        Bank bank("Test Bank");
+        CHECK(!bank.recover(store.snapshot, store.journal).error.empty());
+        CHECK(!bank.checkpoint());
+    }
+    {
+        Store store("journal_magic");
+        fillStore(store);
+        patch(store.journal, 0, 0x12345678);
+        Bank bank("Test Bank");
+        CHECK(bank.recover(store.snapshot, store.journal).error.find("not a journal") != string::npos);
+    }
+    {
+        Store store("journal_version");
+        fillStore(store);
+        patch(store.journal, 4, Journal::VERSION + 1);
+        Bank bank("Test Bank");
+        CHECK(bank.recover(store.snapshot, store.journal).error.find("format version") != string::npos);
+    }
+    {
+        // The journal goes on from a later snapshot than the one on disk
+        Store store("journal_gap");
+        fillStore(store);
+        remove(store.snapshot.c_str());
+        Bank bank("Test Bank");
+        CHECK(bank.recover(store.snapshot, store.journal).error.find("continues from record") != string::npos);
+        CHECK(!bank.checkpoint());
+    }
+}
+
+// Once the journal cannot be written, operations report NOT_DURABLE
+// rather than OK, and so does everything after them
+void testJournalFailure() {
+    Store store("journal_failure");
+    signal(SIGXFSZ, SIG_IGN);
+    Bank bank("Test Bank");
+    bank.recover(store.snapshot, store.journal);
+    uint64_t id = bank.createSavingsAccount("Ann", Money::fromCents(100));
+    rlimit limit;
+    getrlimit(RLIMIT_FSIZE, &limit);
+    rlimit capped = limit;
+    capped.rlim_cur = 4096;
+    setrlimit(RLIMIT_FSIZE, &capped);
+    TxnStatus status = TxnStatus::OK;
+    for (int i = 0; i < 1000 && status == TxnStatus::OK; ++i) {
+        status = bank.deposit(id, Money::fromCents(1));
+    }
+    CHECK(status == TxnStatus::NOT_DURABLE);
+    CHECK(bank.withdraw(id, Money::fromCents(1)) == TxnStatus::NOT_DURABLE);
+    setrlimit(RLIMIT_FSIZE, &limit);
+    CHECK(bank.deposit(id, Money::fromCents(1)) == TxnStatus::NOT_DURABLE);
+}
+
+// A refused opening deposit is the create's status over the service
+void testCreateStatus() {
+    Bank bank("Test Bank");
+    TxnStatus status;
+    CHECK(bank.createSavingsAccount("Ann", Money::fromCents(-5), status) == 0);
+    CHECK(status == TxnStatus::INVALID_AMOUNT);
+    CHECK(bank.createCheckingAccount("Ben", Money::fromCents(500), status) != 0 && status == TxnStatus::OK);
+
+    BankServer server(bank);
+    CHECK(server.start(0, 1));
+    BankClient client;
+    CHECK(client.connect("127.0.0.1", server.port()));
+    client.createAccount(AccountKind::SAVINGS, "Cleo", Money::fromCents(-1));
+    client.createAccount(AccountKind::CHECKING, "Dev", Money::fromCents(1));
+    CHECK(client.send());
+    BinaryReader body(nullptr, 0);
+    CHECK(client.receive(status, body) && status == TxnStatus::INVALID_AMOUNT);
+    CHECK(client.receive(status, body) && status == TxnStatus::OK && body.u64() != 0);
+    server.stop();
+}
+
+// A failed write to the change feed is retried rather than skipped, so the
+// stream ends up whole and numbered without gaps
+void testChangeFeedRetry() {
+    string path = tempPath("feed.cdc");
+    signal(SIGXFSZ, SIG_IGN);
+    {
+        ChangeFeed feed(1024);
+        CHECK(feed.open(path));
+        rlimit limit;
+        getrlimit(RLIMIT_FSIZE, &limit);
+        rlimit capped = limit;
+        capped.rlim_cur = 100 * sizeof(ChangeRecord) + 20;
+        setrlimit(RLIMIT_FSIZE, &capped);
+        for (int i = 0; i < 300; ++i) feed.publish(1, Transaction(TxnType::DEPOSIT, Money::fromCents(i)));
+        while (feed.stats().writeErrors == 0) this_thread::sleep_for(chrono::milliseconds(1));
+        CHECK(!feed.drain());
+        setrlimit(RLIMIT_FSIZE, &limit);
+        while (!feed.drain()) this_thread::sleep_for(chrono::milliseconds(10));
+        CHECK(feed.stats().written == 300);
+    }
+    FILE* f = fopen(path.c_str(), "rb");
+    CHECK(f != nullptr);
+    if (f) {
+        ChangeRecord record;
+        uint64_t expected = 1;
+        while (fread(&record, sizeof(record), 1, f) == 1) {
+            CHECK(record.sequence == expected);
+            CHECK(record.txn.getAmount().getCents() == static_cast<int64_t>(expected - 1));
+            ++expected;
+        }
+        CHECK(expected == 301);
+        fclose(f);
+    }
+    remove(path.c_str());
+}
+
+// While the feed file cannot be written, a full ring drops and counts
+// events instead of holding up publishers, and the feed still stops;
+// what does get written stays in order
+void testChangeFeedFullRing() {
+    string path = tempPath("feed.cdc");
+    signal(SIGXFSZ, SIG_IGN);
+    rlimit limit;
+    getrlimit(RLIMIT_FSIZE, &limit);
+    rlimit capped = limit;
+    capped.rlim_cur = 10 * sizeof(ChangeRecord) + 20;
+    const uint64_t EVENTS = 20000;
+    {
+        ChangeFeed feed(64);
+        CHECK(feed.open(path));
+        setrlimit(RLIMIT_FSIZE, &capped);
+        vector<thread> publishers;
+        for (int t = 0; t < 4; ++t) {
+            publishers.emplace_back([&feed, t, EVENTS] {
+                for (uint64_t i = 0; i < EVENTS / 4; ++i) {
+                    feed.publish(t + 1, Transaction(TxnType::DEPOSIT, Money::fromCents(i)));
+                }
+            });
+        }
+        for (thread& publisher : publishers) publisher.join();
+        ChangeFeedStats stats = feed.stats();
+        CHECK(stats.published == EVENTS);
+        CHECK(stats.writeErrors > 0);
+        CHECK(stats.dropped > 0);
+        CHECK(!feed.drain());
+        setrlimit(RLIMIT_FSIZE, &limit);
+        while (!feed.drain()) this_thread::sleep_for(chrono::milliseconds(10));
+        stats = feed.stats();
+        CHECK(stats.written + stats.dropped == EVENTS);
+    }
+    FILE* f = fopen(path.c_str(), "rb");
+    CHECK(f != nullptr);
+    if (f) {
+        ChangeRecord record;
+        uint64_t last = 0;
+        while (fread(&record, sizeof(record), 1, f) == 1) {
+            CHECK(record.sequence > last);
+            last = record.sequence;
+        }
+        fclose(f);
+    }
+    remove(path.c_str());
+
+    // The same through a bank, stopped while the writes still fail
+    Bank bank("Test Bank");
+    uint64_t id = bank.createCheckingAccount("Ada", Money::fromCents(100000));
+    CHECK(bank.startChangeFeed(path));
+    setrlimit(RLIMIT_FSIZE, &capped);
+    for (int i = 0; i < 80000; ++i) CHECK(bank.deposit(id, Money::fromCents(1)) == TxnStatus::OK);
+    CHECK(bank.getChangeFeedStats().dropped > 0);
+    bank.stopChangeFeed();
+    setrlimit(RLIMIT_FSIZE, &limit);
+    CHECK(!bank.hasChangeFeed());
+    CHECK(bank.deposit(id, Money::fromCents(1)) == TxnStatus::OK);
+    remove(path.c_str());
+}
+
+// Multi-leg and prepared transfers go through the risk rules: each paying
+// account's total debit is screened as one transfer, a decline refuses
+// every leg, and what goes through counts in the windows
+void testRiskOnLegs() {
+    Bank bank("Test Bank");
+    string error;
+    CHECK(bank.setRiskRules("outflow decline transfer sum/1m 1000\n", error));
+    uint64_t a = bank.createCheckingAccount("Ada", Money::fromCents(500000));
+    uint64_t b = bank.createCheckingAccount("Ben", Money::fromCents(0));
+    uint64_t c = bank.createCheckingAccount("Cleo", Money::fromCents(0));
+    uint64_t d = bank.createCheckingAccount("Dan", Money::fromCents(500000));
+    auto balance = [&bank](uint64_t id) { return bank.findAccount(id)->getBalance().getCents(); };
+    auto available = [&bank](uint64_t id) { return bank.findAccount(id)->getAvailableBalance().getCents(); };
+
+    // Each leg is under the limit, their total is not
+    CHECK(bank.transferLegs({{a, b, Money::fromCents(60000)}, {a, c, Money::fromCents(60000)}}) ==
+          TxnStatus::RISK_DECLINED);
+    CHECK(balance(a) == 500000 && balance(b) == 0 && balance(c) == 0);
+    CHECK(bank.transferLegs({{a, b, Money::fromCents(40000)}, {a, c, Money::fromCents(40000)}}) == TxnStatus::OK);
+    CHECK(balance(a) == 420000 && balance(b) == 40000 && balance(c) == 40000);
+    CHECK(bank.transfer(a, b, Money::fromCents(30000)) == TxnStatus::RISK_DECLINED);
+    CHECK(bank.transfer(b, c, Money::fromCents(30000)) == TxnStatus::OK);
+
+    CHECK(bank.prepareTransfer(1, {{d, b, Money::fromCents(60000)}, {d, c, Money::fromCents(60000)}}) ==
+          TxnStatus::RISK_DECLINED);
+    CHECK(available(d) == 500000);
+    CHECK(bank.getPreparedTransfers().empty());
+    CHECK(bank.prepareTransfer(2, {{d, b, Money::fromCents(50000)}, {d, c, Money::fromCents(40000)}}) ==
+          TxnStatus::OK);
+    CHECK(available(d) == 410000);
+    CHECK(bank.commitTransfer(2) == TxnStatus::OK);
+    CHECK(balance(d) == 410000 && available(d) == 410000);
+    CHECK(bank.transfer(d, b, Money::fromCents(20000)) == TxnStatus::RISK_DECLINED);
+
+    vector<RiskRuleStats> stats = bank.getRiskRuleStats();
+    CHECK(stats.size() == 1 && stats[0].hits == 4);
+}
+
+// The top balances match a scan of every account after the largest ones
+// fall below untracked others, and stay ordered while transfers run
+// alongside reads
+void testTopBalances() {
+    Bank bank("Test Bank");
+    vector<uint64_t> ids;
+    for (int i = 0; i < 3000; ++i) {
+        ids.push_back(bank.createCheckingAccount("Holder " + to_string(i), Money::fromCents(1000 + 100 * i)));
+    }
+    auto matchesScan = [&bank, &ids] {
+        vector<pair<int64_t, uint64_t>> all;
+        for (uint64_t id : ids) all.emplace_back(bank.findAccount(id)->getBalance().getCents(), id);
+        sort(all.rbegin(), all.rend());
+        vector<TopBalances::Entry> top = bank.getTopBalances();
+        bool same = top.size() == TopBalances::K;
+        for (size_t i = 0; same && i < top.size(); ++i) {
+            same = top[i].id == all[i].second && top[i].balance.getCents() == all[i].first;
+        }
+        return same;
+    };
+    CHECK(matchesScan());
+    for (size_t i = 2000; i < ids.size(); ++i) {
+        CHECK(bank.withdraw(ids[i], Money::fromCents(100 * i)) == TxnStatus::OK);
+    }
+    CHECK(matchesScan());
+
+    atomic<bool> done(false);
+    thread mover([&bank, &ids, &done] {
+        for (size_t i = 0; i < 20000; ++i) {
+            bank.transfer(ids[i % ids.size()], ids[(i * 7 + 3) % ids.size()], Money::fromCents(1 + i % 500));
+        }
+        done = true;
+    });
+    while (!done) {
+        vector<TopBalances::Entry> top = bank.getTopBalances();
+        CHECK(top.size() == TopBalances::K);
+        for (size_t i = 1; i < top.size(); ++i) CHECK(top[i - 1].balance >= top[i].balance);
+    }
+    mover.join();
+    CHECK(matchesScan());
+}
+
+// A transfer over two in-process shards and one behind a ShardServer is
+// all or nothing in balances and holds: a refused leg releases the holds
+// already placed, a shard that cannot be reached gets its abort again
+// once it is back, and a prepare that times out but later goes through
+// on the shard holds nothing
+void testTransferCoordinator() {
+    Bank a("Bank A");
+    Bank b("Bank B");
+    Bank c("Bank C");
+    a.setNodeId(1);
+    b.setNodeId(2);
+    c.setNodeId(3);
+    uint64_t a1 = a.createCheckingAccount("Ada", Money::fromCents(100000));
+    uint64_t b1 = b.createCheckingAccount("Ben", Money::fromCents(100000));
+    uint64_t c1 = c.createCheckingAccount("Cleo", Money::fromCents(100000));
+    ShardServer server(c);
+    CHECK(server.start(0));
+    uint16_t port = server.port();
+    LocalShard shardA(a);
+    LocalShard shardB(b);
+    RemoteShard shardC("127.0.0.1", port, 200);
+    TransferCoordinator coordinator;
+    coordinator.addShard(1, &shardA);
+    coordinator.addShard(2, &shardB);
+    coordinator.addShard(3, &shardC);
+    Bank* banks[] = {&a, &b, &c};
+    uint64_t ids[] = {a1, b1, c1};
+    // Every balance as given and nothing held or left prepared
+    auto settled = [&](int64_t ca, int64_t cb, int64_t cc) {
+        int64_t expected[] = {ca, cb, cc};
+        bool same = true;
+        for (int i = 0; i < 3; ++i) {
+            Account* acc = banks[i]->findAccount(ids[i]);
+            same = same && acc->getBalance().getCents() == expected[i] && acc->getHeld() == Money() &&
+                   banks[i]->getPreparedTransfers().empty();
+        }
+        return same;
+    };
+
+    CHECK(coordinator.execute({{a1, b1, Money::fromCents(10000)}, {b1, c1, Money::fromCents(5000)}}) ==
+          TxnStatus::OK);
+    CHECK(settled(90000, 105000, 105000));
+
+    // A prepares and holds, then B refuses
+    CHECK(coordinator.execute({{a1, b1, Money::fromCents(10000)}, {b1, c1, Money::fromCents(500000)}}) ==
+          TxnStatus::INSUFFICIENT_FUNDS);
+    CHECK(settled(90000, 105000, 105000));
+
+    server.stop();
+    CHECK(coordinator.execute({{a1, c1, Money::fromCents(10000)}}) == TxnStatus::SHARD_UNAVAILABLE);
+    CHECK(settled(90000, 105000, 105000));
+    CHECK(coordinator.retryPending() == 1);
+    CHECK(server.start(port));
+    CHECK(coordinator.retryPending() == 0);
+    CHECK(coordinator.execute({{a1, c1, Money::fromCents(10000)}}) == TxnStatus::OK);
+    CHECK(settled(80000, 105000, 115000));
+
+    // C's prepare waits on the account past the timeout; the coordinator
+    // aborts, and the prepare that then runs must not keep its hold
+    {
+        unique_lock<mutex> busy(c.findAccount(c1)->getMutex());
+        CHECK(coordinator.execute({{a1, c1, Money::fromCents(10000)}, {c1, a1, Money::fromCents(5000)}}) ==
+              TxnStatus::SHARD_UNAVAILABLE);
+    }
+    server.stop();
+    CHECK(coordinator.retryPending() == 0);
+    CHECK(settled(80000, 105000, 115000));
+}
+
+// Searches agree with a scan of every name, through several merges
+void testNameIndex() {
+    vector<unique_ptr<CheckingAccount>> accounts;
+    map<string, size_t> exact;
+    NameIndex index;
+    for (size_t i = 0; i < 20000; ++i) {
+        string name = (i % 2 ? "Holder " : "HOLDER ") + to_string(i % 5000);
+        accounts.emplace_back(new CheckingAccount(i + 1, name));
+        index.insert(accounts.back().get());
+        ++exact[name];
+    }
+    auto count = [&index](const string& text, NameMatch match) {
+        size_t n = 0;
+        index.find(text, match, [&n](Account*) { return ++n > 0; });
+        return n;
+    };
+    for (size_t p = 0; p < 5000; p += 37) {
+        string name = "Holder " + to_string(p);
+        CHECK(count(name, NameMatch::EXACT) == exact[name]);
+        CHECK(count("hOLDER " + to_string(p), NameMatch::IGNORE_CASE) == 4);
+    }
+    CHECK(count("holder 12", NameMatch::PREFIX) == 4 * 111);
+    CHECK(count("holder", NameMatch::PREFIX) == accounts.size());
+    CHECK(count("Holder 5000", NameMatch::EXACT) == 0);
+    CHECK(index.size() == accounts.size());
+}
+
+// The largest generated id among some accounts: their own, their
+// transactions' and their loans'
+uint64_t largestId(Bank& bank, const vector<uint64_t>& ids) {
+    uint64_t largest = 0;
+    for (uint64_t id : ids) {
+        Account* acc = bank.findAccount(id);
+        if (!acc) continue;
+        largest = max(largest, id);
+        for (size_t i = 0; i < acc->getLoanCount(); ++i) largest = max(largest, acc->getLoan(i).getLoanId());
+        acc->getHistory().forEachChunk([&largest](const Transaction* records, size_t count) {
+            for (size_t i = 0; i < count; ++i) largest = max(largest, records[i].getId());
+            return true;
+        });
+    }
+    return largest;
+}
+
+// A process that issued ids ahead of the clock (over 1024 in a
+// millisecond) and stopped: the next one, started within that time,
+// issues only larger ids, whether the old ones come from the snapshot or
+// the journal
+void testIdsAfterRestart() {
+    Store store("ids");
+    string idFile = tempPath("ids.list");
+    pid_t child = fork();
+    if (child == 0) {
+        // The earlier process, with a generator of its own
+        {
+            Bank bank("Test Bank");
+            bank.recover(store.snapshot, store.journal);
+            vector<uint64_t> ids;
+            for (int round = 0; round < 2; ++round) {
+                for (int i = 0; i < 2000000; ++i) IdGenerator::next();
+                uint64_t a = bank.createSavingsAccount("Ann", Money::fromCents(100000));
+                uint64_t b = bank.createCheckingAccount("Ben", Money::fromCents(100000));
+                runEveryOperation(bank, a, b, 100 * (round + 1));
+                ids.push_back(a);
+                ids.push_back(b);
+                if (round == 0) bank.checkpoint();
+            }
+            FILE* f = fopen(idFile.c_str(), "w");
+            for (uint64_t id : ids) fprintf(f, "%llu\n", static_cast<unsigned long long>(id));
+            fclose(f);
+        }
+        _exit(failed ? 1 : 0);
+    }
+    int childStatus = 0;
+    waitpid(child, &childStatus, 0);
+    CHECK(WIFEXITED(childStatus) && WEXITSTATUS(childStatus) == 0);
+
+    vector<uint64_t> ids;
+    FILE* f = fopen(idFile.c_str(), "r");
+    CHECK(f != nullptr);
+    unsigned long long id;
+    while (f && fscanf(f, "%llu", &id) == 1) ids.push_back(id);
+    if (f) fclose(f);
+    remove(idFile.c_str());
+    CHECK(ids.size() == 4);
+
+    // What the clock alone would give
+    uint64_t unrecovered = IdGenerator::next();
+    Bank bank("Test Bank");
+    RecoveryReport report = bank.recover(store.snapshot, store.journal);
+    CHECK(report.error.empty() && report.snapshotLoaded && report.replayed > 0);
+    uint64_t recovered = largestId(bank, ids);
+    CHECK(recovered > unrecovered);
+    uint64_t fresh = bank.createCheckingAccount("Cleo", Money::fromCents(100000));
+    CHECK(fresh > recovered);
+    CHECK(bank.deposit(fresh, Money::fromCents(1)) == TxnStatus::OK);
+    CHECK(largestId(bank, {fresh}) > recovered);
+    for (uint64_t old : ids) CHECK(bank.findAccount(old) && bank.findAccount(old)->getAccountId() == old);
+}
+
+struct Test {
+    const char* name;
+    void (*run)();
+};
+
+const Test TESTS[] = {
+    {"journal_replay", testJournalReplay},
+    {"snapshot_and_journal", testSnapshotAndJournal},
+    {"recovery_refusals", testRecoveryRefusals},
+    {"journal_failure", testJournalFailure},
+    {"create_status", testCreateStatus},
+    {"change_feed_retry", testChangeFeedRetry},
+    {"change_feed_full_ring", testChangeFeedFullRing},
+    {"risk_on_legs", testRiskOnLegs},
+    {"top_balances", testTopBalances},
+    {"transfer_coordinator", testTransferCoordinator},
+    {"name_index", testNameIndex},
+    {"ids_after_restart", testIdsAfterRestart},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool ran = false;
+    for (const Test& test : TESTS) {
+        if (argc > 1 && strcmp(argv[1], test.name) != 0) continue;
+        ran = true;
+        bool before = failed;
+        failed = false;
+        test.run();
+        cout << (failed ? "FAIL " : "ok   ") << test.name << endl;
+        failed = failed || before;
+    }
+    if (!ran) {
+        cerr << "No test named " << argv[1] << "!" << endl;
+        return 1;
+    }
+    return failed ? 1 : 0;
+}